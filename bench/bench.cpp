@@ -0,0 +1,2595 @@
+//
+// mixerbench - headless compositor benchmark
+//
+// drives a Composition with synthetic layers using the software (soft::)
+// backend and prints one JSON object per run so results from different
+// builds can be compared by a script.
+//
+// usage: mixerbench [--mode=compose|contention|hittest|dirty|mailbox|keyed|pool|pixels|capture|pacing|scheduler|visibility|stats|input|source] [--layers=4,16,64]
+//                   [--pattern=solid|gradient|noise|alpha|mixed]
+//                   [--layer-size=WxH] [--output=WxH] [--frames=N]
+//                   [--warmup=N] [--redraw=full|damage] [--readers=N]
+//                   [--duration=ms] [--seed=N] [--capture-path=dir/prefix]
+//
+#if defined(_WIN32)
+#include "platform.h"
+#include <psapi.h>
+#include <direct.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "capture.h"
+#include "composition.h"
+#include "crc32.h"
+#include "frame_pool.h"
+#include "input_queue.h"
+#include "keyed_sync.h"
+#include "mailbox.h"
+#include "partial_copy.h"
+#include "pixels.h"
+#include "scheduler.h"
+#include "source_dump.h"
+#include "stats_channel.h"
+#include "timing.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+	enum class Pattern
+	{
+		Solid,
+		Gradient,
+		Noise,
+		Alpha
+	};
+
+	struct Options
+	{
+		string mode;
+		vector<int> layers;
+		string pattern;
+		int layer_width;
+		int layer_height;
+		int output_width;
+		int output_height;
+		int frames;
+		int warmup;
+		bool full_redraw;
+		int readers;
+		int duration;
+		uint32_t seed;
+		string capture_path;
+	};
+
+	// small deterministic generator (xorshift32)
+	class Random
+	{
+	public:
+		Random(uint32_t seed) : state_(seed ? seed : 0x9e3779b9) {}
+
+		uint32_t next()
+		{
+			state_ ^= state_ << 13;
+			state_ ^= state_ >> 17;
+			state_ ^= state_ << 5;
+			return state_;
+		}
+
+		float unit() {
+			return (next() & 0xffffff) / float(0x1000000);
+		}
+
+	private:
+		uint32_t state_;
+	};
+
+	uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	//
+	// a layer with generated content ... noise layers regenerate every
+	// tick, the rest only redraw when invalidated
+	//
+	class SyntheticLayer : public Layer
+	{
+	public:
+		SyntheticLayer(Pattern pattern, int width, int height, uint32_t seed, bool redraw)
+			: Layer(nullptr, true, false)
+			, pattern_(pattern)
+			, surface_(make_shared<soft::Surface>(width, height))
+			, random_(seed)
+			, redraw_(redraw)
+		{
+			generate();
+			set_opaque(pattern != Pattern::Alpha);
+		}
+
+		void tick(double t) override
+		{
+			if (pattern_ == Pattern::Noise)
+			{
+				generate();
+				invalidate();
+			}
+			else if (redraw_) {
+				invalidate();
+			}
+			Layer::tick(t);
+		}
+
+		void render(shared_ptr<d3d11::Context> const&) override {
+		}
+
+		void render(shared_ptr<soft::Context> const& ctx) override {
+			render_surface(ctx, surface_);
+		}
+
+		size_t bytes() const {
+			return surface_->stride() * surface_->height();
+		}
+
+	private:
+
+		void generate()
+		{
+			auto const w = surface_->width();
+			auto const h = surface_->height();
+			switch (pattern_)
+			{
+				case Pattern::Solid:
+				{
+					auto const c = random_.next();
+					surface_->clear(((c >> 0) & 0xff) / 255.0f,
+						((c >> 8) & 0xff) / 255.0f, ((c >> 16) & 0xff) / 255.0f, 1.0f);
+				}
+				break;
+
+				case Pattern::Gradient:
+					for (int y = 0; y < h; ++y)
+					{
+						auto const row = surface_->row(y);
+						auto const g = static_cast<uint32_t>((y * 255) / max(1, h - 1));
+						for (int x = 0; x < w; ++x) {
+							row[x] = pack((x * 255) / max(1, w - 1), g, 128, 255);
+						}
+					}
+					break;
+
+				case Pattern::Noise:
+					for (int y = 0; y < h; ++y)
+					{
+						auto const row = surface_->row(y);
+						for (int x = 0; x < w; ++x) {
+							row[x] = random_.next() | 0xff000000;
+						}
+					}
+					break;
+
+				case Pattern::Alpha:
+					// premultiplied ... every pixel needs blending
+					for (int y = 0; y < h; ++y)
+					{
+						auto const row = surface_->row(y);
+						for (int x = 0; x < w; ++x)
+						{
+							auto const a = 64 + ((x + y) & 0x7f);
+							row[x] = pack((a * 3) / 4, a / 2, a / 4, a);
+						}
+					}
+					break;
+			}
+		}
+
+		Pattern const pattern_;
+		shared_ptr<soft::Surface> const surface_;
+		Random random_;
+		bool const redraw_;
+	};
+
+	//
+	// one opaque color everywhere (e.g. to check what a capture wrote)
+	//
+	class ColorLayer : public Layer
+	{
+	public:
+		ColorLayer(float red, float green, float blue)
+			: Layer(nullptr, true, false)
+			, surface_(make_shared<soft::Surface>(16, 16))
+		{
+			surface_->clear(red, green, blue, 1.0f);
+			set_opaque(true);
+		}
+
+		void render(shared_ptr<d3d11::Context> const&) override {
+		}
+
+		void render(shared_ptr<soft::Context> const& ctx) override {
+			render_surface(ctx, surface_);
+		}
+
+	private:
+		shared_ptr<soft::Surface> const surface_;
+	};
+
+	bool to_pattern(string const& name, Pattern& pattern)
+	{
+		if (name == "solid") { pattern = Pattern::Solid; return true; }
+		if (name == "gradient") { pattern = Pattern::Gradient; return true; }
+		if (name == "noise") { pattern = Pattern::Noise; return true; }
+		if (name == "alpha") { pattern = Pattern::Alpha; return true; }
+		return false;
+	}
+
+	//
+	// add count layers at random (overlapping) positions
+	//
+	size_t populate(shared_ptr<Composition> const& comp, Options const& opt, int count)
+	{
+		Pattern const cycle[] = {
+			Pattern::Solid, Pattern::Gradient, Pattern::Noise, Pattern::Alpha };
+
+		Random random(opt.seed);
+		size_t bytes = 0;
+		for (int n = 0; n < count; ++n)
+		{
+			Pattern pattern;
+			if (!to_pattern(opt.pattern, pattern)) {
+				pattern = cycle[n % 4];
+			}
+
+			auto const layer = make_shared<SyntheticLayer>(pattern,
+				opt.layer_width, opt.layer_height, random.next(), opt.full_redraw);
+			bytes += layer->bytes();
+
+			auto const w = min(1.0f, opt.layer_width / float(opt.output_width));
+			auto const h = min(1.0f, opt.layer_height / float(opt.output_height));
+			comp->add_layer(layer);
+			layer->move(random.unit() * (1.0f - w), random.unit() * (1.0f - h), w, h);
+		}
+		return bytes;
+	}
+
+	uint64_t peak_memory_kb()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+			return pmc.PeakWorkingSetSize / 1024;
+		}
+		return 0;
+#else
+		struct rusage usage = {};
+		getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+		return usage.ru_maxrss / 1024;
+#else
+		return usage.ru_maxrss;
+#endif
+#endif
+	}
+
+	//
+	// frames per second and cost per layer of composing everything
+	// into an output surface
+	//
+	void run_compose(Options const& opt, int count)
+	{
+		auto const comp = make_shared<Composition>(
+					nullptr, opt.output_width, opt.output_height);
+		auto const layer_bytes = populate(comp, opt, count);
+
+		auto const target = make_shared<soft::Surface>(opt.output_width, opt.output_height);
+		auto const ctx = make_shared<soft::Context>(target);
+
+		double t = 0.0;
+		for (int n = 0; n < opt.warmup; ++n)
+		{
+			comp->tick(t += 1.0 / 60.0);
+			comp->render(ctx);
+		}
+
+		Histogram frame_times;
+		uint64_t damaged = 0;
+		auto const start = time_now();
+		for (int n = 0; n < opt.frames; ++n)
+		{
+			auto const frame_start = time_now();
+			comp->tick(t += 1.0 / 60.0);
+			comp->render(ctx);
+			frame_times.record(static_cast<int64_t>(time_now() - frame_start));
+			damaged += comp->damage().area();
+		}
+		auto const elapsed = static_cast<double>(time_now() - start);
+
+		auto const frames = max(1, opt.frames);
+		auto const ns_per_frame = (elapsed * 1000.0) / frames;
+		printf("{\"mode\":\"compose\",\"pattern\":\"%s\",\"layers\":%d,"
+			"\"layer_size\":\"%dx%d\",\"output\":\"%dx%d\",\"redraw\":\"%s\","
+			"\"frames\":%d,\"fps\":%.2f,\"ns_per_frame\":%.0f,\"ns_per_layer\":%.0f,"
+			"\"p50_frame_us\":%lld,\"p99_frame_us\":%lld,\"damaged_pixels_per_frame\":%.0f,"
+			"\"layer_bytes\":%llu,\"peak_rss_kb\":%llu}\n",
+			opt.pattern.c_str(), count,
+			opt.layer_width, opt.layer_height, opt.output_width, opt.output_height,
+			opt.full_redraw ? "full" : "damage",
+			opt.frames,
+			elapsed > 0.0 ? (frames * 1000000.0) / elapsed : 0.0,
+			ns_per_frame,
+			ns_per_frame / max(1, count),
+			static_cast<long long>(frame_times.percentile(50.0)),
+			static_cast<long long>(frame_times.percentile(99.0)),
+			double(damaged) / frames,
+			static_cast<unsigned long long>(layer_bytes),
+			static_cast<unsigned long long>(peak_memory_kb()));
+	}
+
+	bool read_file(string const& path, vector<uint8_t>& data)
+	{
+		data.clear();
+		auto const file = fopen(path.c_str(), "rb");
+		if (!file) {
+			return false;
+		}
+		uint8_t buffer[65536];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			data.insert(data.end(), buffer, buffer + n);
+		}
+		fclose(file);
+		return true;
+	}
+
+	//
+	// the files a capture run wrote (so the bench leaves nothing behind)
+	//
+	void remove_capture(CaptureOptions const& options, uint64_t written, int width, int height)
+	{
+		if (options.format == CaptureFormat::Y4m) {
+			remove((options.path + ".y4m").c_str());
+		}
+		for (uint64_t n = 1; n <= written && options.format != CaptureFormat::Y4m; ++n)
+		{
+			char name[64];
+			if (options.format == CaptureFormat::Raw) {
+				snprintf(name, sizeof(name), "_%06llu_%dx%d.rgba", (unsigned long long)n, width, height);
+			}
+			else {
+				snprintf(name, sizeof(name), "_%06llu.png", (unsigned long long)n);
+			}
+			remove((options.path + name).c_str());
+		}
+
+		auto const slash = options.path.find_last_of("/\\");
+		if (slash != string::npos && slash > 0)
+		{
+#if defined(_WIN32)
+			_rmdir(options.path.substr(0, slash).c_str());
+#else
+			rmdir(options.path.substr(0, slash).c_str());
+#endif
+		}
+	}
+
+	//
+	// a red composition captured once in each format and read back from
+	// the file: the first pixel must still be red (raw and PNG) or the
+	// Y'CbCr of red (y4m) ... a swapped channel order turns it blue
+	//
+	bool check_capture_colors(Options const& opt)
+	{
+		int const width = 64;
+		int const height = 36;
+
+		// what red is in each format
+		uint8_t const red[] = { 255, 0, 0, 255, 255, 0, 0, 255 };
+		vector<uint8_t> i420;
+		encode_i420(red, 8, 2, 1, false, i420);
+		uint8_t const red_yuv[] = { i420[0], i420[2], i420[3] };
+
+		auto ok = true;
+		for (auto const format : { "raw", "png", "y4m" })
+		{
+			auto const comp = make_shared<Composition>(nullptr, width, height);
+			auto const layer = make_shared<ColorLayer>(1.0f, 0.0f, 0.0f);
+			comp->add_layer(layer);
+			layer->move(0.0f, 0.0f, 1.0f, 1.0f);
+
+			auto const target = make_shared<soft::Surface>(width, height);
+			auto const ctx = make_shared<soft::Context>(target);
+
+			auto options = default_capture_options();
+			options.every = 1;
+			options.path = opt.capture_path;
+			to_capture_format(format, options.format);
+			auto capture = create_capture(options);
+			comp->set_capture(capture);
+			comp->tick(0.0);
+			comp->render(ctx);
+			comp->set_capture(nullptr);
+			capture->flush();
+			auto const written = capture->stats().written;
+			capture.reset();		// closes the y4m stream
+
+			// the first pixel as written (3 bytes: RGB or YUV)
+			string name;
+			size_t offset[3] = {};
+			if (options.format == CaptureFormat::Raw)
+			{
+				char ext[64];
+				snprintf(ext, sizeof(ext), "_000001_%dx%d.rgba", width, height);
+				name = options.path + ext;
+				offset[1] = 1;
+				offset[2] = 2;
+			}
+			else if (options.format == CaptureFormat::Png)
+			{
+				// signature, IHDR, the IDAT header, zlib header, stored block header, filter
+				name = options.path + "_000001.png";
+				offset[0] = 8 + 25 + 8 + 2 + 5 + 1;
+				offset[1] = offset[0] + 1;
+				offset[2] = offset[0] + 2;
+			}
+			else
+			{
+				name = options.path + ".y4m";
+			}
+
+			vector<uint8_t> data;
+			auto valid = (written == 1) && read_file(name, data);
+			if (valid && options.format == CaptureFormat::Y4m)
+			{
+				// past the stream header and "FRAME\n" ... then the planes
+				auto const header = find(data.begin(), data.end(), '\n') - data.begin();
+				offset[0] = header + 1 + 6;
+				offset[1] = offset[0] + (width * height);
+				offset[2] = offset[1] + ((width + 1) / 2) * ((height + 1) / 2);
+			}
+			valid = valid && (offset[2] < data.size());
+
+			uint8_t pixel[3] = {};
+			for (int n = 0; valid && n < 3; ++n) {
+				pixel[n] = data[offset[n]];
+			}
+			if (options.format == CaptureFormat::Y4m) {
+				valid = valid && equal(pixel, pixel + 3, red_yuv);
+			}
+			else {
+				valid = valid && equal(pixel, pixel + 3, red);
+			}
+			remove_capture(options, written, width, height);
+			ok = ok && valid;
+
+			printf("{\"mode\":\"capture\",\"check\":\"colors\",\"format\":\"%s\","
+				"\"pixel\":[%u,%u,%u],\"ok\":%s}\n",
+				format, pixel[0], pixel[1], pixel[2], valid ? "true" : "false");
+		}
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// what capturing costs the render loop: frame times without a capture
+	// and with each format ... every 10th frame (the workers keep up) and
+	// every frame (they can't, so the queue applies backpressure)
+	//
+	bool run_capture(Options const& opt)
+	{
+		auto const ok = check_capture_colors(opt);
+
+		struct Run
+		{
+			char const* format;
+			uint32_t every;
+		};
+
+		vector<Run> runs;
+		runs.push_back({ "none", 0 });
+		for (auto const format : { "raw", "png", "y4m" })
+		{
+			runs.push_back({ format, 10 });
+			runs.push_back({ format, 1 });
+		}
+
+		auto const count = opt.layers.empty() ? 16 : opt.layers[0];
+		for (auto const& run : runs)
+		{
+			auto const comp = make_shared<Composition>(
+						nullptr, opt.output_width, opt.output_height);
+			populate(comp, opt, count);
+
+			auto const target = make_shared<soft::Surface>(opt.output_width, opt.output_height);
+			auto const ctx = make_shared<soft::Context>(target);
+
+			double t = 0.0;
+			for (int n = 0; n < opt.warmup; ++n)
+			{
+				comp->tick(t += 1.0 / 60.0);
+				comp->render(ctx);
+			}
+
+			auto options = default_capture_options();
+			options.every = run.every;
+			options.path = opt.capture_path;
+			shared_ptr<CapturePipeline> capture;
+			if (to_capture_format(run.format, options.format))
+			{
+				capture = create_capture(options);
+				comp->set_capture(capture);
+			}
+
+			Histogram frame_times;
+			for (int n = 0; n < opt.frames; ++n)
+			{
+				auto const frame_start = time_now();
+				comp->tick(t += 1.0 / 60.0);
+				comp->render(ctx);
+				frame_times.record(static_cast<int64_t>(time_now() - frame_start));
+			}
+
+			// what was still queued when the loop stopped
+			CaptureStats stats = {};
+			uint64_t flush_us = 0;
+			if (capture)
+			{
+				comp->set_capture(nullptr);
+				auto const start = time_now();
+				capture->flush();
+				flush_us = time_now() - start;
+				stats = capture->stats();
+				capture.reset();
+				remove_capture(options, stats.written, opt.output_width, opt.output_height);
+			}
+
+			printf("{\"mode\":\"capture\",\"format\":\"%s\",\"every\":%u,\"output\":\"%dx%d\","
+				"\"frames\":%d,\"p50_frame_us\":%lld,\"p99_frame_us\":%lld,\"max_frame_us\":%lld,"
+				"\"captured\":%llu,\"dropped\":%llu,\"written\":%llu,\"failed\":%llu,"
+				"\"max_queued\":%u,\"p50_encode_us\":%lld,\"p99_encode_us\":%lld,\"flush_us\":%llu}\n",
+				run.format, run.every, opt.output_width, opt.output_height, opt.frames,
+				static_cast<long long>(frame_times.percentile(50.0)),
+				static_cast<long long>(frame_times.percentile(99.0)),
+				static_cast<long long>(frame_times.max_value()),
+				static_cast<unsigned long long>(stats.captured),
+				static_cast<unsigned long long>(stats.dropped),
+				static_cast<unsigned long long>(stats.written),
+				static_cast<unsigned long long>(stats.failed),
+				stats.max_queued,
+				static_cast<long long>(stats.encode.p50),
+				static_cast<long long>(stats.encode.p99),
+				static_cast<unsigned long long>(flush_us));
+			fflush(stdout);
+		}
+		return ok;
+	}
+
+	//
+	// BeginFrame pacing on a simulated 60Hz composition tick (with 1ms of
+	// jitter): each page paints latency_us after a BeginFrame, or never
+	// when it has nothing new to draw ... ungated is what sending one
+	// every tick costs
+	//
+	void run_pacing(Options const& opt)
+	{
+		struct Page
+		{
+			char const* name;
+			double rate;
+			int64_t latency_us;		// 0 = never paints
+		};
+
+		vector<Page> pages;
+		pages.push_back({ "video_wall", 60.0, 4000 });
+		pages.push_back({ "ticker", 30.0, 3000 });
+		pages.push_back({ "hud", 5.0, 2000 });
+		pages.push_back({ "static", 0.0, 0 });
+		pages.push_back({ "slow_page", 0.0, 40000 });
+
+		int64_t const tick = 16667;
+		auto const duration = static_cast<int64_t>(opt.duration) * 1000;
+
+		for (auto const& page : pages)
+		{
+			Random random(opt.seed);
+			BeginFramePacer pacer(page.rate, default_begin_frame_timeout_ms * 1000ll);
+
+			uint64_t ticks = 0;
+			int64_t paint_at = -1;
+			for (int64_t t = 0; t < duration; t += tick)
+			{
+				auto const now = t + static_cast<int64_t>(random.next() % 1000);
+				if (paint_at >= 0 && paint_at <= now)
+				{
+					pacer.painted(paint_at);
+					paint_at = -1;
+				}
+
+				ticks++;
+				if (pacer.begin(now) && page.latency_us) {
+					paint_at = now + page.latency_us;
+				}
+			}
+
+			auto const stats = pacer.stats();
+			auto const seconds = duration / 1000000.0;
+			printf("{\"mode\":\"pacing\",\"page\":\"%s\",\"rate\":%.1f,\"duration_ms\":%d,"
+				"\"ungated_begin_frames\":%llu,\"begin_frames\":%llu,\"begin_fps\":%.2f,"
+				"\"painted\":%llu,\"timeouts\":%llu,\"throttled\":%llu,\"blocked\":%llu,"
+				"\"p50_begin_to_paint_us\":%lld,\"p99_begin_to_paint_us\":%lld}\n",
+				page.name, page.rate, opt.duration,
+				static_cast<unsigned long long>(ticks),
+				static_cast<unsigned long long>(stats.sent),
+				stats.sent / seconds,
+				static_cast<unsigned long long>(stats.painted),
+				static_cast<unsigned long long>(stats.timeouts),
+				static_cast<unsigned long long>(stats.throttled),
+				static_cast<unsigned long long>(stats.blocked),
+				static_cast<long long>(stats.begin_to_paint.p50),
+				static_cast<long long>(stats.begin_to_paint.p99));
+		}
+		fflush(stdout);
+	}
+
+	//
+	// the system clock's sleep: whole milliseconds only, anything shorter
+	// returns at once ... simulated time doesn't move then, so a wait that
+	// kept asking for one would never end (those are counted and spun)
+	//
+	class MillisecondClock : public ManualClock
+	{
+	public:
+		MillisecondClock(int64_t oversleep, int64_t spin_step)
+			: ManualClock(oversleep, spin_step)
+			, short_sleeps_(0)
+		{
+		}
+
+		bool sleep(int64_t microseconds) override
+		{
+			if (microseconds < 1000)
+			{
+				short_sleeps_++;
+				relax();
+				return true;
+			}
+			return ManualClock::sleep((microseconds / 1000) * 1000);
+		}
+
+		uint64_t short_sleeps() const { return short_sleeps_; }
+
+	private:
+		uint64_t short_sleeps_;
+	};
+
+	//
+	// FrameScheduler on a simulated clock: one 60 fps target rendering
+	// in 4ms, with every 50th frame taking 40ms (2 deadlines missed) and
+	// one taking 120ms (7 missed) ... for each late policy and an OS
+	// sleep that overshoots by 0, 1.5 and 4ms (the spin is 2ms).
+	//
+	// checked: a wait that had time to sleep wakes within a spin step of
+	// its deadline (unless the oversleep is past the spin), the late and
+	// dropped counts of each policy, and that waits sleep whole
+	// milliseconds and spin no more than the spin plus the millisecond
+	// left over.  Returns false on any mismatch.
+	//
+	bool run_scheduler(Options const& opt)
+	{
+		struct Policy
+		{
+			char const* name;
+			LatePolicy policy;
+		};
+
+		Policy const policies[] = {
+			{ "drop", LatePolicy::Drop },
+			{ "catch_up", LatePolicy::CatchUp },
+			{ "slip", LatePolicy::Slip } };
+		int64_t const oversleeps[] = { 0, 1500, 4000 };
+
+		int const frames = max(300, opt.frames);
+		int64_t const spin = 2000;
+		int64_t const spin_step = 50;
+		int64_t const render_us = 4000;
+		int64_t const interval = 16666;		// 60 fps
+
+		auto ok = true;
+		for (auto const& p : policies)
+		{
+			for (auto const oversleep : oversleeps)
+			{
+				auto const clock = make_shared<MillisecondClock>(oversleep, spin_step);
+				clock->advance(1000000);
+				FrameScheduler scheduler(clock, p.policy);
+				scheduler.set_spin(spin);
+				auto const id = scheduler.add(60.0);
+				auto const start = scheduler.next_deadline();
+
+				Histogram wake;
+				uint64_t waits = 0;
+				uint64_t missed_deadlines = 0;
+				uint64_t off_cadence = 0;
+				uint64_t slips = 0;
+				uint64_t expected_late = 0;
+				uint64_t expected_dropped = 0;
+				auto valid = true;
+
+				for (int n = 0; n < frames; ++n)
+				{
+					auto const deadline = scheduler.next_deadline();
+					auto const waited = (deadline > clock->now());
+					valid = scheduler.wait() && scheduler.due(id) && valid;
+					if (waited)
+					{
+						auto const late = clock->now() - deadline;
+						wake.record(late);
+						waits++;
+						if (late > spin_step) {
+							missed_deadlines++;
+						}
+					}
+					if ((deadline - start) % interval) {
+						off_cadence++;
+					}
+
+					// frame 150 misses 7 deadlines, every 50th otherwise 2
+					auto render = render_us;
+					int64_t missed = 0;
+					if (n == 150) {
+						render = 120000;
+					}
+					else if ((n % 50) == 25) {
+						render = 40000;
+					}
+					clock->advance(render);
+					if (render != render_us)
+					{
+						missed = (clock->now() - deadline) / interval;
+						expected_late++;
+						expected_dropped += (p.policy == LatePolicy::CatchUp)
+							? max<int64_t>(0, missed - 4) : missed;
+					}
+
+					scheduler.complete(id);
+					if (render != render_us && p.policy == LatePolicy::Slip &&
+						scheduler.next_deadline() == clock->now() + interval) {
+						slips++;
+					}
+				}
+
+				auto const stats = scheduler.stats(id);
+				auto const spun_per_wait = waits ? clock->spun() / static_cast<int64_t>(waits) : 0;
+				auto const total = clock->slept() + clock->spun();
+
+				valid = valid && (stats.frames == static_cast<uint64_t>(frames));
+				valid = valid && (stats.dropped == expected_dropped);
+				valid = valid && (clock->short_sleeps() == 0);
+				valid = valid && (spun_per_wait <= spin + 1000);
+				if (oversleep < spin) {
+					valid = valid && (missed_deadlines == 0);
+				}
+				switch (p.policy)
+				{
+					case LatePolicy::Drop:
+						// every deadline is on the original cadence
+						valid = valid && (stats.late == expected_late) && !off_cadence;
+						break;
+
+					case LatePolicy::CatchUp:
+						// the frames rendered back-to-back to catch up are late too
+						valid = valid && (stats.late >= expected_late);
+						break;
+
+					case LatePolicy::Slip:
+						// each late frame restarts the cadence from when it finished
+						valid = valid && (stats.late == expected_late) && (slips == expected_late);
+						break;
+				}
+				ok = ok && valid;
+
+				printf("{\"mode\":\"scheduler\",\"policy\":\"%s\",\"oversleep_us\":%lld,"
+					"\"frames\":%llu,\"late\":%llu,\"dropped\":%llu,\"max_lateness_us\":%lld,"
+					"\"waits\":%llu,\"p99_wake_late_us\":%lld,\"max_wake_late_us\":%lld,"
+					"\"missed_deadlines\":%llu,\"spin_us_per_wait\":%lld,\"sleep_share\":%.3f,"
+					"\"short_sleeps\":%llu,\"ok\":%s}\n",
+					p.name, static_cast<long long>(oversleep),
+					static_cast<unsigned long long>(stats.frames),
+					static_cast<unsigned long long>(stats.late),
+					static_cast<unsigned long long>(stats.dropped),
+					static_cast<long long>(stats.max_lateness),
+					static_cast<unsigned long long>(waits),
+					static_cast<long long>(wake.percentile(99.0)),
+					static_cast<long long>(wake.max_value()),
+					static_cast<unsigned long long>(missed_deadlines),
+					static_cast<long long>(spun_per_wait),
+					total ? double(clock->slept()) / total : 0.0,
+					static_cast<unsigned long long>(clock->short_sleeps()),
+					valid ? "true" : "false");
+			}
+		}
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// records the mouse events a layer is sent
+	//
+	class InputLayer : public Layer
+	{
+	public:
+		struct Event
+		{
+			bool leave;
+			int32_t x;
+			int32_t y;
+		};
+
+		InputLayer() : Layer(nullptr, true, false) {
+		}
+
+		void render(shared_ptr<d3d11::Context> const&) override {
+		}
+
+		void mouse_move(bool leave, int32_t x, int32_t y) override
+		{
+			Event const e = { leave, x, y };
+			events.push_back(e);
+		}
+
+		vector<Event> events;
+	};
+
+	//
+	// a 1000Hz digitizer over 60Hz frames (with a click every 250ms and
+	// the pen lifted out of range now and then) ... every frame's batch
+	// must keep the clicks in order, end on the last position reported
+	// and never hold two moves (or two leaves) in a row.  Then the mouse
+	// crosses from one layer to another and off the composition: each
+	// layer must be left where the mouse was.  Returns false on any
+	// mismatch.
+	//
+	bool run_input(Options const& opt)
+	{
+		typedef InputQueue::Type Type;
+
+		Random random(opt.seed);
+		InputQueue queue;
+		vector<InputQueue::Event> raw;
+		vector<InputQueue::Event> batch;
+
+		int64_t const frame = 16667;
+		auto const duration = static_cast<int64_t>(opt.duration) * 1000;
+
+		auto ok = true;
+		uint64_t frames = 0;
+		uint64_t clicks = 0;
+		auto next_frame = frame;
+		auto in_range = true;
+
+		for (int64_t t = 0; t < duration; t += 1000)
+		{
+			auto const x = static_cast<int32_t>(t / 1000 % 1920);
+			auto const y = static_cast<int32_t>(random.next() % 1080);
+
+			InputQueue::Event e = { Type::Move, MouseButton::Left, false, x, y, t };
+			auto report = in_range;
+			if (t % 250000 == 0 || t % 250000 == 1000)
+			{
+				e.type = Type::Click;
+				e.up = (t % 250000) != 0;
+				report = true;
+			}
+			else if (random.next() % 500 == 0)
+			{
+				in_range = !in_range;
+				e.type = in_range ? Type::Move : Type::Leave;
+				report = true;
+			}
+
+			if (report)
+			{
+				switch (e.type)
+				{
+					case Type::Click: queue.click(e.button, e.up, x, y, t); clicks++; break;
+					case Type::Leave: queue.leave(x, y, t); break;
+					default: queue.move(x, y, t); break;
+				}
+				raw.push_back(e);
+			}
+
+			if (t + 1000 < next_frame) {
+				continue;
+			}
+			next_frame += frame;
+			frames++;
+
+			queue.take(batch, t);
+
+			// clicks in order, and the batch ends where the raw input did
+			vector<InputQueue::Event> raw_clicks, batch_clicks;
+			for (auto const& r : raw) {
+				if (r.type == Type::Click) raw_clicks.push_back(r);
+			}
+			for (auto const& b : batch) {
+				if (b.type == Type::Click) batch_clicks.push_back(b);
+			}
+			auto valid = (raw_clicks.size() == batch_clicks.size());
+			for (size_t n = 0; valid && n < raw_clicks.size(); ++n) {
+				valid = raw_clicks[n].x == batch_clicks[n].x && raw_clicks[n].up == batch_clicks[n].up;
+			}
+			if (!raw.empty())
+			{
+				valid = valid && !batch.empty() &&
+					batch.back().type == raw.back().type &&
+					batch.back().x == raw.back().x && 
+					batch.back().y == raw.back().y;
+			}
+			for (size_t n = 1; valid && n < batch.size(); ++n)
+			{
+				valid = (batch[n].type == Type::Click) || 
+					(batch[n].type != batch[n - 1].type);
+			}
+			ok = ok && valid;
+			raw.clear();
+		}
+
+		queue.take(batch, duration);
+		auto const stats = queue.stats();
+		ok = ok && (stats.events == stats.coalesced + stats.dispatched);
+
+		// crossing from one layer to the next, then off the composition
+		auto const comp = make_shared<Composition>(nullptr, 200, 100);
+		auto const left = make_shared<InputLayer>();
+		auto const right = make_shared<InputLayer>();
+		comp->add_layer(left);
+		comp->add_layer(right);
+		left->move(0.0f, 0.0f, 0.5f, 1.0f);
+		right->move(0.5f, 0.0f, 0.5f, 1.0f);
+
+		comp->mouse_move(false, 50, 50);
+		comp->mouse_move(false, 90, 50);
+		comp->mouse_move(false, 110, 50);
+		comp->mouse_move(false, 150, 60);
+		comp->mouse_move(true, 210, 60);
+
+		auto const& l = left->events;
+		auto const& r = right->events;
+		auto const crossing = 
+			l.size() == 3 && !l[0].leave && !l[1].leave && 
+			l[2].leave && l[2].x == 110 && l[2].y == 50 &&
+			r.size() == 3 && !r[0].leave && r[0].x == 10 && !r[1].leave && 
+			r[2].leave && r[2].x == 110 && r[2].y == 60;
+		ok = ok && crossing;
+
+		printf("{\"mode\":\"input\",\"duration_ms\":%d,\"frames\":%llu,\"events\":%llu,"
+			"\"clicks\":%llu,\"coalesced\":%llu,\"dispatched\":%llu,\"events_per_frame\":%.2f,"
+			"\"p50_delay_us\":%lld,\"p99_delay_us\":%lld,\"crossing\":%s,\"ok\":%s}\n",
+			opt.duration,
+			static_cast<unsigned long long>(frames),
+			static_cast<unsigned long long>(stats.events),
+			static_cast<unsigned long long>(clicks),
+			static_cast<unsigned long long>(stats.coalesced),
+			static_cast<unsigned long long>(stats.dispatched),
+			frames ? double(stats.dispatched) / frames : 0.0,
+			static_cast<long long>(stats.delay.p50),
+			static_cast<long long>(stats.delay.p99),
+			crossing ? "true" : "false",
+			ok ? "true" : "false");
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// the stats channel on a simulated 60Hz tick: a third of the layers
+	// animate (their fps and counters change), the rest are static pages.
+	// Every message is decoded and must rebuild exactly what was encoded ...
+	// one message is lost (the decoder must notice and resync from a
+	// keyframe, unless the next message is one anyway) and a layer goes
+	// away (its stats must go with it).
+	// per_tick is what sending every stat on every tick would cost.
+	// Returns false on any mismatch.
+	//
+	bool run_stats(Options const& opt)
+	{
+		auto ok = true;
+		for (auto const count : opt.layers)
+		{
+			Random random(opt.seed);
+			StatsEncoder encoder(default_stats_rate, default_stats_keyframe_interval);
+			StatsDecoder decoder;
+
+			int64_t const tick = 16667;
+			auto const duration = static_cast<int64_t>(opt.duration) * 1000;
+
+			auto layers = count;
+			uint64_t ticks = 0;
+			uint64_t per_tick_values = 0;
+			uint64_t resyncs = 0;
+			auto lost = false;
+			auto after_loss = false;		// waiting for the first message after it
+			uint64_t expected_resyncs = 0;
+			auto valid = true;
+
+			for (int64_t t = 0; t < duration; t += tick)
+			{
+				ticks++;
+
+				// half way through the last layer is closed
+				if (t >= duration / 2 && layers == count && count > 1) {
+					layers--;
+				}
+
+				StatMap stats;
+				stats["fps"] = stat_double(60.0);
+				stats["time"] = stat_double(t / 1000000.0);
+				stats["vsync"] = stat_bool(true);
+				for (int n = 0; n < layers; ++n)
+				{
+					auto const layer = stat_path("layers", to_string(n));
+					auto const animated = (n % 3) == 0;
+					auto const frames = animated ? (t / tick) : 1;
+					stats[stat_path(layer, "name")] = stat_string(
+						"http://example.com/page/" + to_string(n));
+					stats[stat_path(layer, "fps")] = stat_double(
+						animated ? 59.0 + (random.next() % 200) / 100.0 : 0.0);
+					stats[stat_path(layer, "frames")] = stat_int(frames);
+					stats[stat_path(layer, "latency_ms")] = stat_double(animated ? 8.0 : 0.0);
+					stats[stat_path(layer, "dropped")] = stat_int(frames / 100);
+					stats[stat_path(layer, "delivery")] = stat_string("latest");
+					stats[stat_path(layer, "hidden")] = stat_bool(false);
+				}
+				per_tick_values += stats.size();
+
+				if (!encoder.due(t)) {
+					continue;
+				}
+
+				StatsDelta delta;
+				if (!encoder.encode(stats, delta)) {
+					continue;
+				}
+
+				// one message (not a keyframe) never arrives
+				if (!lost && !delta.keyframe && t >= duration / 4)
+				{
+					lost = true;
+					after_loss = true;
+					continue;
+				}
+
+				// only a delta can show the gap ... a keyframe just resyncs
+				if (after_loss)
+				{
+					after_loss = false;
+					expected_resyncs = delta.keyframe ? 0 : 1;
+				}
+
+				if (!decoder.apply(delta))
+				{
+					// the page asks for a keyframe
+					resyncs++;
+					encoder.reset();
+					continue;
+				}
+
+				if (decoder.values() != stats) {
+					valid = false;
+				}
+			}
+
+			valid = valid && decoder.synced() && (resyncs == expected_resyncs);
+			ok = ok && valid;
+
+			auto const channel = encoder.stats();
+			printf("{\"mode\":\"stats\",\"layers\":%d,\"duration_ms\":%d,\"ticks\":%llu,"
+				"\"per_tick_messages\":%llu,\"per_tick_values\":%llu,"
+				"\"messages\":%llu,\"keyframes\":%llu,\"values\":%llu,\"unchanged\":%llu,"
+				"\"values_per_message\":%.1f,\"resyncs\":%llu,\"ok\":%s}\n",
+				count, opt.duration,
+				static_cast<unsigned long long>(ticks),
+				static_cast<unsigned long long>(ticks),
+				static_cast<unsigned long long>(per_tick_values),
+				static_cast<unsigned long long>(channel.messages),
+				static_cast<unsigned long long>(channel.keyframes),
+				static_cast<unsigned long long>(channel.values),
+				static_cast<unsigned long long>(channel.unchanged),
+				channel.messages ? double(channel.values) / channel.messages : 0.0,
+				static_cast<unsigned long long>(resyncs),
+				valid ? "true" : "false");
+		}
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// generated markup of about size bytes ... repetitive like a real DOM
+	// (with some non-ASCII text so a cap can land inside a UTF-8 sequence)
+	//
+	string synthetic_markup(size_t size, Random& random)
+	{
+		string html = "<!DOCTYPE html>\n<html><head><title>bench</title></head><body>\n";
+		for (uint32_t row = 0; html.size() < size; ++row)
+		{
+			html += "<div class=\"row r" + to_string(row % 7) + "\"><span id=\"c" + to_string(row) +
+				"\">" + to_string(random.next() % 100000) + "</span><p>caf\xc3\xa9 cr\xc3\xa8me</p></div>\n";
+		}
+		html += "</body></html>\n";
+		return html;
+	}
+
+	//
+	// what CEF hands HtmlSourceWriter is UTF-16 ... the page sources are
+	// kept that way so each run pays for the conversion where the real
+	// one does (util.h only converts on Windows)
+	//
+	u16string utf8_to_utf16(string const& utf8)
+	{
+		u16string utf16;
+		utf16.reserve(utf8.size());
+		for (size_t i = 0; i < utf8.size(); )
+		{
+			auto const c = static_cast<uint8_t>(utf8[i]);
+			auto const extra = (c >= 0xf0) ? 3 : (c >= 0xe0) ? 2 : (c >= 0xc0) ? 1 : 0;
+			uint32_t cp = (extra == 0) ? c : (c & (0x3f >> extra));
+			for (int n = 1; n <= extra && i + n < utf8.size(); ++n) {
+				cp = (cp << 6) | (static_cast<uint8_t>(utf8[i + n]) & 0x3f);
+			}
+			i += extra + 1;
+
+			if (cp >= 0x10000)
+			{
+				cp -= 0x10000;
+				utf16.push_back(static_cast<char16_t>(0xd800 + (cp >> 10)));
+				utf16.push_back(static_cast<char16_t>(0xdc00 + (cp & 0x3ff)));
+			}
+			else {
+				utf16.push_back(static_cast<char16_t>(cp));
+			}
+		}
+		return utf16;
+	}
+
+	string utf16_to_utf8(u16string const& utf16)
+	{
+		string utf8;
+		utf8.reserve(utf16.size());
+		for (size_t i = 0; i < utf16.size(); ++i)
+		{
+			uint32_t cp = utf16[i];
+			if (cp >= 0xd800 && cp < 0xdc00)
+			{
+				// a pair cut in half (e.g. by a cap) is dropped
+				if (i + 1 == utf16.size()) {
+					break;
+				}
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (utf16[++i] - 0xdc00);
+			}
+
+			if (cp < 0x80) {
+				utf8.push_back(static_cast<char>(cp));
+			}
+			else if (cp < 0x800)
+			{
+				utf8.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+				utf8.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+			else if (cp < 0x10000)
+			{
+				utf8.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+				utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+				utf8.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+			else
+			{
+				utf8.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+				utf8.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+				utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+				utf8.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+		}
+		return utf8;
+	}
+
+	//
+	// decode a gzip member written by encode_gzip (one fixed-Huffman
+	// block) ... false if it is malformed or fails its CRC / size
+	//
+	bool inflate_fixed(vector<uint8_t> const& gz, string& out)
+	{
+		out.clear();
+		if (gz.size() < 18 || gz[0] != 0x1f || gz[1] != 0x8b || gz[2] != 8 || gz[3] != 0) {
+			return false;
+		}
+
+		size_t pos = 10;
+		uint32_t bits = 0;
+		int count = 0;
+		auto overrun = false;
+		auto const bit = [&]() -> uint32_t {
+			if (!count)
+			{
+				if (pos >= gz.size() - 8)
+				{
+					overrun = true;
+					return 0;
+				}
+				bits = gz[pos++];
+				count = 8;
+			}
+			auto const b = bits & 1;
+			bits >>= 1;
+			count--;
+			return b;
+		};
+		auto const get = [&](int n) {
+			uint32_t v = 0;
+			for (int i = 0; i < n; ++i) {
+				v |= bit() << i;
+			}
+			return v;
+		};
+
+		uint16_t const length_base[29] = {
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		uint16_t const distance_base[30] = {
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+
+		if (get(1) != 1 || get(2) != 1) {
+			return false;
+		}
+
+		for (;;)
+		{
+			// fixed codes are 7, 8 or 9 bits (most-significant bit first)
+			uint32_t code = 0;
+			for (int n = 0; n < 7; ++n) {
+				code = (code << 1) | bit();
+			}
+			uint32_t symbol;
+			if (code <= 0x17) {
+				symbol = 256 + code;
+			}
+			else
+			{
+				code = (code << 1) | bit();
+				if (code >= 0x30 && code <= 0xbf) {
+					symbol = code - 0x30;
+				}
+				else if (code >= 0xc0 && code <= 0xc7) {
+					symbol = 280 + (code - 0xc0);
+				}
+				else {
+					symbol = 144 + (((code << 1) | bit()) - 0x190);
+				}
+			}
+			if (overrun || symbol > 285) {
+				return false;
+			}
+
+			if (symbol < 256) {
+				out.push_back(static_cast<char>(symbol));
+			}
+			else if (symbol == 256) {
+				break;
+			}
+			else
+			{
+				auto const l = symbol - 257;
+				auto const length = length_base[l] + get((l < 8 || l == 28) ? 0 : (l - 4) / 4);
+				uint32_t d = 0;
+				for (int n = 0; n < 5; ++n) {
+					d = (d << 1) | bit();
+				}
+				if (d > 29) {
+					return false;
+				}
+				auto const distance = distance_base[d] + get(d < 4 ? 0 : (d - 2) / 2);
+				if (overrun || distance > out.size()) {
+					return false;
+				}
+				for (uint32_t n = 0; n < length; ++n) {
+					out.push_back(out[out.size() - distance]);
+				}
+			}
+		}
+
+		auto const trailer = gz.data() + gz.size() - 8;
+		auto const le32 = [](const uint8_t* p) {
+			return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+		};
+		return le32(trailer) == crc32(0, reinterpret_cast<const uint8_t*>(out.data()), out.size())
+			&& le32(trailer + 4) == static_cast<uint32_t>(out.size());
+	}
+
+	//
+	// a burst of page loads (one per layer, 64K to 4M of markup) dumping
+	// their UTF-16 source on the thread that called OnLoadEnd: converted
+	// and written right there (sync, as before) or copied (no further
+	// than the cap) and handed to a SourceDumper that converts it ...
+	// plain, gzipped and capped at 64K.  Every file written must hold the
+	// source (cut at a character boundary when capped).  Returns false on
+	// any mismatch.
+	//
+	bool run_source(Options const& opt)
+	{
+		struct Run
+		{
+			char const* name;
+			bool async;
+			bool compress;
+			uint64_t max_bytes;
+		};
+
+		vector<Run> runs;
+		runs.push_back({ "sync", false, false, 0 });
+		runs.push_back({ "async", true, false, 0 });
+		runs.push_back({ "gzip", true, true, 0 });
+		runs.push_back({ "capped", true, false, 64 * 1024 });
+
+		auto const pages = opt.layers.empty() ? 16 : opt.layers[0];
+		size_t const sizes[] = { 64 * 1024, 512 * 1024, 4 * 1024 * 1024 };
+
+		Random random(opt.seed);
+		vector<string> sources;
+		vector<u16string> sources16;
+		uint64_t total = 0;
+		for (int n = 0; n < pages; ++n)
+		{
+			sources.push_back(synthetic_markup(sizes[n % 3], random));
+			sources16.push_back(utf8_to_utf16(sources.back()));
+			total += sources.back().size();
+		}
+
+		auto ok = true;
+		for (auto const& run : runs)
+		{
+			auto options = default_source_dump_options();
+			options.compress = run.compress;
+			options.max_bytes = run.max_bytes;
+			auto dumper = run.async ? create_source_dumper(options) : nullptr;
+
+			auto const path = [&](int n) {
+				return "mixerbench_source_" + to_string(n) + ".html";
+			};
+
+			Histogram ui;
+			auto const start = time_now();
+			for (int n = 0; n < pages; ++n)
+			{
+				auto const call_start = time_now();
+				if (dumper)
+				{
+					// as HtmlSourceWriter does: copy up to the cap, convert later
+					auto length = sources16[n].size();
+					if (options.max_bytes && length > options.max_bytes) {
+						length = static_cast<size_t>(options.max_bytes);
+					}
+					auto const source = make_shared<u16string>(sources16[n], 0, length);
+					dumper->submit(path(n), [source]() { return utf16_to_utf8(*source); });
+				}
+				else
+				{
+					// as HtmlSourceWriter did: convert and write
+					auto const utf8 = utf16_to_utf8(sources16[n]);
+					ofstream fout(path(n));
+					fout.write(utf8.c_str(), utf8.size());
+				}
+				ui.record(static_cast<int64_t>(time_now() - call_start));
+			}
+
+			uint64_t flush_us = 0;
+			SourceDumpStats stats = {};
+			if (dumper)
+			{
+				auto const flush_start = time_now();
+				dumper->flush();
+				flush_us = time_now() - flush_start;
+				stats = dumper->stats();
+				dumper.reset();
+			}
+			auto const elapsed = time_now() - start;
+
+			// what was written must match what was dumped
+			auto valid = true;
+			uint64_t files = 0;
+			uint64_t truncated = 0;
+			for (int n = 0; n < pages; ++n)
+			{
+				auto const name = path(n) + (run.compress ? ".gz" : "");
+				vector<uint8_t> data;
+				if (!read_file(name, data)) {
+					continue;
+				}
+				files++;
+				remove(name.c_str());
+
+				string content;
+				if (run.compress)
+				{
+					if (!inflate_fixed(data, content))
+					{
+						valid = false;
+						continue;
+					}
+				}
+				else {
+					content.assign(data.begin(), data.end());
+				}
+
+				auto expected = sources[n];
+				if (run.max_bytes && expected.size() > run.max_bytes)
+				{
+					auto cut = static_cast<size_t>(run.max_bytes);
+					while (cut > 0 && (static_cast<uint8_t>(expected[cut]) & 0xc0) == 0x80) {
+						--cut;
+					}
+					expected.resize(cut);
+					truncated++;
+				}
+				if (content != expected) {
+					valid = false;
+				}
+			}
+
+			if (run.async)
+			{
+				valid = valid
+					&& (stats.written == files)
+					&& (stats.written + stats.dropped == stats.submitted)
+					&& (stats.submitted == static_cast<uint64_t>(pages))
+					&& (stats.failed == 0)
+					&& (stats.truncated == truncated);
+			}
+			else {
+				valid = valid && (files == static_cast<uint64_t>(pages));
+			}
+			ok = ok && valid;
+
+			printf("{\"mode\":\"source\",\"run\":\"%s\",\"pages\":%d,\"bytes\":%llu,"
+				"\"p50_call_us\":%lld,\"p99_call_us\":%lld,\"max_call_us\":%lld,"
+				"\"written\":%llu,\"dropped\":%llu,\"truncated\":%llu,\"bytes_out\":%llu,"
+				"\"ratio\":%.2f,\"p99_write_us\":%lld,\"flush_us\":%llu,\"total_us\":%llu,\"ok\":%s}\n",
+				run.name, pages,
+				static_cast<unsigned long long>(total),
+				static_cast<long long>(ui.percentile(50.0)),
+				static_cast<long long>(ui.percentile(99.0)),
+				static_cast<long long>(ui.max_value()),
+				static_cast<unsigned long long>(run.async ? stats.written : files),
+				static_cast<unsigned long long>(stats.dropped),
+				static_cast<unsigned long long>(stats.truncated),
+				static_cast<unsigned long long>(stats.bytes_out),
+				stats.bytes_out ? double(stats.bytes_in) / stats.bytes_out : 1.0,
+				static_cast<long long>(stats.write.p99),
+				static_cast<unsigned long long>(flush_us),
+				static_cast<unsigned long long>(elapsed),
+				valid ? "true" : "false");
+			fflush(stdout);
+		}
+		return ok;
+	}
+
+	//
+	// a playlist: pages preloaded behind the active one (all opaque and
+	// full-screen) plus layers that are off-screen, zero-sized and fully
+	// transparent ... only the active page may be visible() after a frame,
+	// and the next page must be visible on the frame after the active
+	// one moves away.  Returns false on any mismatch.
+	//
+	bool run_visibility(Options const& opt)
+	{
+		auto const comp = make_shared<Composition>(
+					nullptr, opt.output_width, opt.output_height);
+		auto const target = make_shared<soft::Surface>(opt.output_width, opt.output_height);
+		auto const ctx = make_shared<soft::Context>(target);
+
+		int const pages = 21;
+		vector<shared_ptr<Layer>> playlist;
+		for (int n = 0; n < pages; ++n)
+		{
+			auto const page = make_shared<SyntheticLayer>(
+				Pattern::Solid, 64, 36, opt.seed + n, false);
+			comp->add_layer(page);
+			page->move(0.0f, 0.0f, 1.0f, 1.0f);
+			playlist.push_back(page);
+		}
+
+		auto const offscreen = make_shared<SyntheticLayer>(Pattern::Alpha, 64, 36, 1, false);
+		comp->add_layer(offscreen);
+		offscreen->move(1.5f, 0.0f, 0.25f, 0.25f);
+
+		auto const zero = make_shared<SyntheticLayer>(Pattern::Alpha, 64, 36, 2, false);
+		comp->add_layer(zero);
+		zero->move(0.25f, 0.25f, 0.0f, 0.0f);
+
+		auto const transparent = make_shared<SyntheticLayer>(Pattern::Alpha, 64, 36, 3, false);
+		comp->add_layer(transparent);
+		transparent->move(0.25f, 0.25f, 0.25f, 0.25f);
+		auto t = identity_transform();
+		t.opacity = 0.0f;
+		transparent->set_transform(t);
+
+		auto const count_visible = [&]()
+		{
+			int visible = 0;
+			for (auto const& layer : comp->layers()->layers) {
+				visible += layer->visible() ? 1 : 0;
+			}
+			return visible;
+		};
+
+		comp->tick(0.0);
+		comp->render(ctx);
+		auto const before = count_visible();
+		auto ok = (before == 1) && playlist.back()->visible();
+
+		// the active page leaves ... the one behind it takes over
+		playlist.back()->move(0.0f, 1.5f, 1.0f, 1.0f);
+		comp->tick(1.0 / 60.0);
+		comp->render(ctx);
+		auto const after = count_visible();
+		ok = ok && (after == 1) && playlist[pages - 2]->visible();
+
+		printf("{\"mode\":\"visibility\",\"layers\":%zu,\"visible\":%d,"
+			"\"visible_after_switch\":%d,\"ok\":%s}\n",
+			comp->layers()->layers.size(), before, after, ok ? "true" : "false");
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// the pre-snapshot way of sharing the layer list ... every reader
+	// takes the lock and copies the list
+	//
+	class LockedList
+	{
+	public:
+		void add(shared_ptr<Layer> const& layer)
+		{
+			lock_guard<mutex> guard(lock_);
+			layers_.push_back(layer);
+		}
+
+		void remove(shared_ptr<Layer> const& layer)
+		{
+			lock_guard<mutex> guard(lock_);
+			layers_.erase(std::remove(layers_.begin(), layers_.end(), layer), layers_.end());
+		}
+
+		vector<shared_ptr<Layer>> layers()
+		{
+			lock_guard<mutex> guard(lock_);
+			return layers_;
+		}
+
+	private:
+		mutex lock_;
+		vector<shared_ptr<Layer>> layers_;
+	};
+
+	//
+	// readers walking the layer list while a writer adds/removes a layer:
+	// lock-free snapshots (Composition::layers) vs. lock + copy
+	//
+	void run_contention(Options const& opt, int count)
+	{
+		auto const comp = make_shared<Composition>(
+					nullptr, opt.output_width, opt.output_height);
+		populate(comp, opt, count);
+
+		LockedList locked;
+		for (auto const& layer : comp->layers()->layers) {
+			locked.add(layer);
+		}
+
+		auto const spare = make_shared<SyntheticLayer>(
+				Pattern::Solid, 16, 16, opt.seed, false);
+
+		auto measure = [&](bool snapshots, uint64_t& reads, uint64_t& writes)
+		{
+			atomic_bool stop(false);
+			atomic<uint64_t> total(0);
+			atomic<uint64_t> sink(0);
+
+			vector<thread> readers;
+			for (int n = 0; n < opt.readers; ++n)
+			{
+				readers.push_back(thread([&]()
+				{
+					uint64_t local = 0;
+					size_t visited = 0;
+					while (!stop)
+					{
+						if (snapshots)
+						{
+							auto const snapshot = comp->layers();
+							for (auto const& layer : snapshot->layers) {
+								visited += layer->opaque() ? 1 : 0;
+							}
+						}
+						else
+						{
+							auto const layers = locked.layers();
+							for (auto const& layer : layers) {
+								visited += layer->opaque() ? 1 : 0;
+							}
+						}
+						++local;
+					}
+					total += local;
+					sink += visited;
+				}));
+			}
+
+			uint64_t changes = 0;
+			auto const start = time_now();
+			auto const limit = static_cast<uint64_t>(opt.duration) * 1000;
+			while ((time_now() - start) < limit)
+			{
+				if (snapshots)
+				{
+					comp->add_layer(spare);
+					comp->remove_layer(spare);
+				}
+				else
+				{
+					locked.add(spare);
+					locked.remove(spare);
+				}
+				changes += 2;
+				this_thread::yield();
+			}
+
+			stop = true;
+			for (auto& r : readers) {
+				r.join();
+			}
+
+			auto const seconds = (time_now() - start) / 1000000.0;
+			reads = static_cast<uint64_t>(total / seconds);
+			writes = static_cast<uint64_t>(changes / seconds);
+		};
+
+		uint64_t snapshot_reads, snapshot_writes, locked_reads, locked_writes;
+		measure(true, snapshot_reads, snapshot_writes);
+		measure(false, locked_reads, locked_writes);
+
+		printf("{\"mode\":\"contention\",\"layers\":%d,\"readers\":%d,\"duration_ms\":%d,"
+			"\"snapshot_reads_per_sec\":%llu,\"snapshot_writes_per_sec\":%llu,"
+			"\"locked_reads_per_sec\":%llu,\"locked_writes_per_sec\":%llu}\n",
+			count, opt.readers, opt.duration,
+			static_cast<unsigned long long>(snapshot_reads),
+			static_cast<unsigned long long>(snapshot_writes),
+			static_cast<unsigned long long>(locked_reads),
+			static_cast<unsigned long long>(locked_writes));
+	}
+
+	//
+	// cost of finding the layer under the mouse: the hit-test grid
+	// vs. walking every layer front to back
+	//
+	void run_hittest(Options const& opt, int count)
+	{
+		auto const comp = make_shared<Composition>(
+					nullptr, opt.output_width, opt.output_height);
+		populate(comp, opt, count);
+
+		int const queries = max(1, opt.frames) * 100;
+		vector<int32_t> points;
+		points.reserve(queries * 2);
+		Random random(opt.seed ^ 0x5bd1e995);
+		for (int n = 0; n < queries; ++n)
+		{
+			points.push_back(static_cast<int32_t>(random.unit() * opt.output_width));
+			points.push_back(static_cast<int32_t>(random.unit() * opt.output_height));
+		}
+
+		auto start = time_now();
+		for (int n = 0; n < queries; ++n) {
+			comp->mouse_move(false, points[n * 2], points[(n * 2) + 1]);
+		}
+		auto const grid_ns = ((time_now() - start) * 1000.0) / queries;
+
+		auto const snapshot = comp->layers();
+		auto const w = static_cast<float>(opt.output_width);
+		auto const h = static_cast<float>(opt.output_height);
+		size_t hits = 0;
+		start = time_now();
+		for (int n = 0; n < queries; ++n)
+		{
+			auto const x = points[n * 2] / w;
+			auto const y = points[(n * 2) + 1] / h;
+			auto const& layers = snapshot->layers;
+			for (auto i = layers.rbegin(); i != layers.rend(); ++i)
+			{
+				auto const r = (*i)->extent();
+				if (x >= r.x && x < (r.x + r.width) && y >= r.y && y < (r.y + r.height))
+				{
+					++hits;
+					break;
+				}
+			}
+		}
+		auto const linear_ns = ((time_now() - start) * 1000.0) / queries;
+
+		printf("{\"mode\":\"hittest\",\"layers\":%d,\"queries\":%d,"
+			"\"grid_ns_per_query\":%.1f,\"linear_ns_per_query\":%.1f,\"hit_ratio\":%.3f}\n",
+			count, queries, grid_ns, linear_ns, double(hits) / queries);
+	}
+
+	//
+	// bytes moved per software paint by FrameBuffer for typical damage:
+	// copying + uploading the whole frame vs. only the dirty rects
+	// (the output size is used as the browser size)
+	//
+	void run_dirty(Options const& opt)
+	{
+		auto const w = opt.output_width;
+		auto const h = opt.output_height;
+
+		struct Pattern
+		{
+			char const* name;
+			vector<IntRect> rects;
+		};
+
+		vector<Pattern> patterns;
+		patterns.push_back({ "cursor", { IntRect{ w / 2, h / 2, 2, 18 } } });
+		patterns.push_back({ "typing", { 
+			IntRect{ w / 2, h / 2, 2, 18 }, IntRect{ w / 4, h / 2, w / 4, 20 } } });
+		patterns.push_back({ "ticker", { IntRect{ 0, h - (h / 12), w, h / 12 } } });
+		patterns.push_back({ "widgets", { 
+			IntRect{ w / 10, h / 10, w / 5, h / 5 }, 
+			IntRect{ w / 2, h / 2, w / 5, h / 5 } } });
+		patterns.push_back({ "video", { IntRect{ w / 4, h / 4, w / 2, h / 2 } } });
+		patterns.push_back({ "full", { IntRect{ 0, 0, w, h } } });
+
+		auto const stride = static_cast<uint32_t>(w) * 4;
+		vector<uint8_t> src(stride * h, 0x80);
+		vector<uint8_t> dst(stride * h, 0);
+
+		auto const frames = max(1, opt.frames);
+		for (auto const& pattern : patterns)
+		{
+			Region region;
+			for (auto const& r : pattern.rects) {
+				region.add(r);
+			}
+			region.clip(w, h);
+
+			auto start = time_now();
+			for (int n = 0; n < frames; ++n) {
+				memcpy(dst.data(), src.data(), src.size());
+			}
+			auto const full_ns = ((time_now() - start) * 1000.0) / frames;
+
+			size_t copied = 0;
+			start = time_now();
+			for (int n = 0; n < frames; ++n) {
+				copied = copy_region(dst.data(), stride, src.data(), stride, w, h, region);
+			}
+			auto const dirty_ns = ((time_now() - start) * 1000.0) / frames;
+
+			// one copy into the staging buffer and one upload to the texture
+			printf("{\"mode\":\"dirty\",\"pattern\":\"%s\",\"frame\":\"%dx%d\",\"rects\":%zu,"
+				"\"full_bytes_per_frame\":%llu,\"dirty_bytes_per_frame\":%llu,"
+				"\"full_copy_ns\":%.0f,\"dirty_copy_ns\":%.0f}\n",
+				pattern.name, w, h, region.rects().size(),
+				static_cast<unsigned long long>(src.size() * 2),
+				static_cast<unsigned long long>(copied * 2),
+				full_ns, dirty_ns);
+		}
+	}
+
+	struct StressFrame
+	{
+		uint64_t sequence;
+		int64_t painted;
+		uint64_t payload[512];
+	};
+
+	struct StressRate
+	{
+		char const* name;
+		int producer_us;
+		int consumer_us;
+	};
+
+	// frames handed over but never taken (the containers do not count them)
+	inline uint64_t lost_frames(Mailbox<StressFrame>& mailbox) {
+		return mailbox.published() - mailbox.consumed() - mailbox.superseded();
+	}
+
+	inline uint64_t lost_frames(FrameQueue<StressFrame>& queue) {
+		return queue.published() - queue.consumed();
+	}
+
+	inline uint64_t dropped_frames(Mailbox<StressFrame>& mailbox) {
+		return mailbox.superseded();
+	}
+
+	inline uint64_t dropped_frames(FrameQueue<StressFrame>& queue) {
+		return queue.dropped();
+	}
+
+	//
+	// one producer and one consumer thread through a frame container
+	//
+	// every frame is filled with its sequence number so the consumer can
+	// check it never sees a torn frame or one older than the last ...
+	// once both threads stop the rest is drained so nothing may be lost
+	//
+	// frames are reported to a LayerTiming the way FrameBuffer does, its
+	// dropped count has to agree with the container's (a queue refusing
+	// the last few paints drops them without a later frame being drawn)
+	//
+	template <class Container>
+	bool stress(Options const& opt, char const* name, Container& frames, StressRate const& rate)
+	{
+		atomic_bool producing(true);
+		atomic_bool consuming(true);
+		uint64_t publish_max = 0;
+		uint64_t acquire_max = 0;
+		uint64_t torn = 0;
+		uint64_t reordered = 0;
+		uint64_t last = 0;
+		uint64_t painted = 0;
+		LayerTiming timing;
+
+		auto const check = [&]()
+		{
+			auto const& frame = frames.front();
+			timing.drawn(frame.sequence, frame.painted);
+			timing.composite(static_cast<int64_t>(time_now()));
+			if (frame.sequence <= last) {
+				reordered++;
+			}
+			last = frame.sequence;
+			for (auto const v : frame.payload)
+			{
+				if (v != frame.sequence)
+				{
+					torn++;
+					break;
+				}
+			}
+		};
+
+		thread producer([&]()
+		{
+			auto& sequence = painted;
+			while (producing)
+			{
+				auto& frame = frames.back();
+				++sequence;
+				for (auto& v : frame.payload) {
+					v = sequence;
+				}
+				frame.sequence = sequence;
+				frame.painted = static_cast<int64_t>(time_now());
+
+				auto const start = time_now();
+				frames.publish();
+				publish_max = max(publish_max, time_now() - start);
+				timing.paint(sequence, static_cast<int64_t>(start));
+
+				if (rate.producer_us) {
+					this_thread::sleep_for(chrono::microseconds(rate.producer_us));
+				}
+			}
+		});
+
+		thread consumer([&]()
+		{
+			while (consuming)
+			{
+				auto const start = time_now();
+				auto const fresh = frames.acquire();
+				acquire_max = max(acquire_max, time_now() - start);
+				if (fresh) {
+					check();
+				}
+
+				if (rate.consumer_us) {
+					this_thread::sleep_for(chrono::microseconds(rate.consumer_us));
+				}
+			}
+		});
+
+		this_thread::sleep_for(chrono::milliseconds(opt.duration));
+		producing = false;
+		producer.join();
+		consuming = false;
+		consumer.join();
+
+		while (frames.acquire()) {
+			check();
+		}
+		auto const lost = lost_frames(frames);
+		auto const report = timing.report();
+		auto const timed = (report.frames == painted) && 
+			(report.dropped + (painted - last) == dropped_frames(frames));
+
+		printf("{\"mode\":\"mailbox\",\"container\":\"%s\",\"rate\":\"%s\","
+			"\"duration_ms\":%d,\"published\":%llu,\"consumed\":%llu,\"dropped\":%llu,"
+			"\"timing_dropped\":%llu,\"max_publish_us\":%llu,\"max_acquire_us\":%llu,"
+			"\"torn\":%llu,\"reordered\":%llu,\"lost\":%llu}\n",
+			name, rate.name, opt.duration,
+			static_cast<unsigned long long>(frames.published()),
+			static_cast<unsigned long long>(frames.consumed()),
+			static_cast<unsigned long long>(dropped_frames(frames)),
+			static_cast<unsigned long long>(report.dropped),
+			static_cast<unsigned long long>(publish_max),
+			static_cast<unsigned long long>(acquire_max),
+			static_cast<unsigned long long>(torn),
+			static_cast<unsigned long long>(reordered),
+			static_cast<unsigned long long>(lost));
+		fflush(stdout);
+
+		return !torn && !reordered && !lost && timed;
+	}
+
+	//
+	// stress the FrameBuffer containers (latest-wins triple buffer and
+	// the queue used for queue / hold delivery) with producer and
+	// consumer at mismatched rates (and one pair with no sleeps at all)
+	// ... returns false on any violation
+	//
+	bool run_mailbox(Options const& opt)
+	{
+		vector<StressRate> rates;
+		rates.push_back({ "fast_producer", 250, 1000 });
+		rates.push_back({ "slow_producer", 2000, 250 });
+		rates.push_back({ "unthrottled", 0, 0 });
+
+		bool ok = true;
+		for (auto const& rate : rates)
+		{
+			{
+				Mailbox<StressFrame> mailbox;
+				ok = stress(opt, "latest", mailbox, rate) && ok;
+			}
+			{
+				FrameQueue<StressFrame> queue(3);
+				ok = stress(opt, "queue3", queue, rate) && ok;
+			}
+			{
+				FrameQueue<StressFrame> queue(1);
+				ok = stress(opt, "hold", queue, rate) && ok;
+			}
+		}
+		return ok;
+	}
+
+	//
+	// the keyed-mutex protocol against a mock mutex, first a scripted run
+	// whose order of acquires / releases is checked step by step
+	// (including a consumer timeout while the producer holds the key and
+	// drawing the last frame again) ... then a producer and consumer
+	// thread sharing one "texture"
+	//
+	bool check_keyed_order()
+	{
+		typedef MockKeyedMutex::Op Op;
+
+		MockKeyedMutex mutex(true);
+		FrameSync sync(2);
+		int draws = 0;
+		auto const draw = [&]() { draws++; };
+
+		bool ok = true;
+
+		// nothing announced ... the mutex is not touched
+		ok = !sync.take(&mutex, false, draw) && ok;
+
+		// the producer is still drawing when the frame is announced
+		ok = mutex.acquire(FrameSync::producer_key, 0) && ok;
+		ok = !sync.take(&mutex, true, draw) && sync.pending() && ok;
+
+		// ... so there is nothing to draw again either
+		ok = !sync.repeat(&mutex, 0, draw) && ok;
+
+		// once it is released to the consumer the pending frame is taken
+		mutex.release(FrameSync::consumer_key);
+		ok = sync.take(&mutex, false, draw) && !sync.pending() && ok;
+
+		// drawn again while the producer leaves it alone (key 0 stays put)
+		ok = sync.repeat(&mutex, 0, draw) && ok;
+
+		// and the producer can draw the next one
+		ok = mutex.acquire(FrameSync::producer_key, 0) && ok;
+
+		MockKeyedMutex::Event const expected[] = {
+			{ Op::Acquire, FrameSync::producer_key },
+			{ Op::Timeout, FrameSync::consumer_key },
+			{ Op::Timeout, FrameSync::producer_key },
+			{ Op::Timeout, FrameSync::consumer_key },
+			{ Op::Release, FrameSync::consumer_key },
+			{ Op::Acquire, FrameSync::consumer_key },
+			{ Op::Release, FrameSync::producer_key },
+			{ Op::Acquire, FrameSync::producer_key },
+			{ Op::Release, FrameSync::producer_key },
+			{ Op::Acquire, FrameSync::producer_key }
+		};
+
+		auto const history = mutex.history();
+		ok = (history.size() == sizeof(expected) / sizeof(expected[0])) && ok;
+		for (size_t n = 0; ok && n < history.size(); ++n)
+		{
+			ok = (history[n].op == expected[n].op) && 
+				(history[n].key == expected[n].key);
+		}
+
+		auto const stats = sync.stats();
+		ok = (draws == 2) && (stats.taken == 1) && (stats.timeouts == 1) && 
+			(stats.repeated == 2) && (stats.missed == 1) && ok;
+
+		printf("{\"mode\":\"keyed\",\"check\":\"order\",\"events\":%zu,\"ok\":%s}\n",
+			history.size(), ok ? "true" : "false");
+		fflush(stdout);
+		return ok;
+	}
+
+	//
+	// producer_us is how long the producer holds the key drawing a frame
+	// (it announces the frame before releasing, like a paint notification
+	// racing the GPU process) and consumer_us the time between draws ...
+	// every frame must be taken exactly once and no draw (a take or a
+	// repeat) may see a torn frame
+	//
+	bool stress_keyed(Options const& opt, StressRate const& rate)
+	{
+		MockKeyedMutex mutex(false);
+		FrameSync sync(2);
+		StressFrame shared = {};
+		StressFrame copy = {};
+		atomic<uint64_t> announced(0);
+		atomic_bool producing(true);
+		atomic_bool consuming(true);
+		uint64_t torn = 0;
+		uint64_t skipped = 0;
+		uint64_t last = 0;
+
+		thread producer([&]()
+		{
+			uint64_t sequence = 0;
+			while (producing)
+			{
+				if (!mutex.acquire(FrameSync::producer_key, 10)) {
+					continue;
+				}
+
+				++sequence;
+				announced = sequence;
+				for (auto& v : shared.payload) {
+					v = sequence;
+				}
+				shared.sequence = sequence;
+
+				if (rate.producer_us) {
+					this_thread::sleep_for(chrono::microseconds(rate.producer_us));
+				}
+				mutex.release(FrameSync::consumer_key);
+			}
+		});
+
+		thread consumer([&]()
+		{
+			auto const check_torn = [&]()
+			{
+				for (auto const v : copy.payload)
+				{
+					if (v != copy.sequence)
+					{
+						torn++;
+						break;
+					}
+				}
+			};
+
+			uint64_t seen = 0;
+			while (consuming)
+			{
+				auto const sequence = announced.load();
+				auto const fresh = (sequence != seen);
+				seen = sequence;
+
+				// "drawing" reads the shared frame while the key is held
+				auto const taken = sync.take(&mutex, fresh, [&]() { copy = shared; });
+				if (!taken && last)
+				{
+					if (sync.repeat(&mutex, 0, [&]() { copy = shared; })) {
+						check_torn();
+					}
+				}
+				if (taken)
+				{
+					if (copy.sequence != last + 1) {
+						skipped++;
+					}
+					last = copy.sequence;
+					check_torn();
+				}
+
+				if (rate.consumer_us) {
+					this_thread::sleep_for(chrono::microseconds(rate.consumer_us));
+				}
+			}
+		});
+
+		this_thread::sleep_for(chrono::milliseconds(opt.duration));
+		producing = false;
+		producer.join();
+		consuming = false;
+		consumer.join();
+
+		auto const stats = sync.stats();
+		printf("{\"mode\":\"keyed\",\"rate\":\"%s\",\"duration_ms\":%d,"
+			"\"timeout_ms\":%u,\"taken\":%llu,\"timeouts\":%llu,"
+			"\"repeated\":%llu,\"missed\":%llu,"
+			"\"torn\":%llu,\"skipped\":%llu}\n",
+			rate.name, opt.duration, sync.timeout(),
+			static_cast<unsigned long long>(stats.taken),
+			static_cast<unsigned long long>(stats.timeouts),
+			static_cast<unsigned long long>(stats.repeated),
+			static_cast<unsigned long long>(stats.missed),
+			static_cast<unsigned long long>(torn),
+			static_cast<unsigned long long>(skipped));
+		fflush(stdout);
+
+		return !torn && !skipped;
+	}
+
+	bool run_keyed(Options const& opt)
+	{
+		vector<StressRate> rates;
+		rates.push_back({ "short_draw", 500, 1000 });
+		rates.push_back({ "long_draw", 4000, 250 });
+		rates.push_back({ "unthrottled", 0, 0 });
+
+		auto ok = check_keyed_order();
+		for (auto const& rate : rates) {
+			ok = stress_keyed(opt, rate) && ok;
+		}
+		return ok;
+	}
+
+	//
+	// paint buffers during a window drag: a new size every frame going
+	// from the output size down to half and back, three buffers alive
+	// (like the FrameBuffer slots) ... malloc/free vs. the frame pool
+	//
+	void run_pool(Options const& opt)
+	{
+		auto const frames = max(1, opt.frames);
+		vector<size_t> sizes;
+		for (int n = 0; n < frames; ++n)
+		{
+			auto const t = (n < frames / 2) ? 
+				(n / double(frames / 2)) : ((frames - n) / double(frames - (frames / 2)));
+			auto const w = static_cast<size_t>(opt.output_width * (1.0 - (t * 0.5)));
+			auto const h = static_cast<size_t>(opt.output_height * (1.0 - (t * 0.5)));
+			sizes.push_back(w * h * 4);
+		}
+
+		// touch every page so first-use faults are part of the cost
+		auto const touch = [](uint8_t* p, size_t size)
+		{
+			for (size_t n = 0; n < size; n += 4096) {
+				p[n] = 1;
+			}
+		};
+
+		shared_ptr<uint8_t> heap[3];
+		auto start = time_now();
+		for (int n = 0; n < frames; ++n)
+		{
+			auto& slot = heap[n % 3];
+			slot.reset();
+			slot = shared_ptr<uint8_t>((uint8_t*)malloc(sizes[n]), free);
+			touch(slot.get(), sizes[n]);
+		}
+		auto const heap_ns = ((time_now() - start) * 1000.0) / frames;
+		for (auto& slot : heap) {
+			slot.reset();
+		}
+
+		auto const pool = create_frame_pool(256 * 1024 * 1024, true);
+		shared_ptr<uint8_t> pooled[3];
+		start = time_now();
+		for (int n = 0; n < frames; ++n)
+		{
+			auto& slot = pooled[n % 3];
+			slot.reset();
+			slot = pool->acquire(sizes[n]);
+			touch(slot.get(), sizes[n]);
+		}
+		auto const pool_ns = ((time_now() - start) * 1000.0) / frames;
+		for (auto& slot : pooled) {
+			slot.reset();
+		}
+
+		auto const stats = pool->stats();
+		printf("{\"mode\":\"pool\",\"output\":\"%dx%d\",\"frames\":%d,"
+			"\"heap_ns_per_frame\":%.0f,\"pool_ns_per_frame\":%.0f,"
+			"\"allocations\":%llu,\"reuses\":%llu,\"frees\":%llu,"
+			"\"high_water_bytes\":%llu,\"cached_bytes\":%llu}\n",
+			opt.output_width, opt.output_height, frames, heap_ns, pool_ns,
+			static_cast<unsigned long long>(stats.allocations),
+			static_cast<unsigned long long>(stats.reuses),
+			static_cast<unsigned long long>(stats.frees),
+			static_cast<unsigned long long>(stats.high_water),
+			static_cast<unsigned long long>(stats.cached));
+	}
+
+	//
+	// compare a SIMD kernel against the scalar reference ... every
+	// offset and a few tail lengths so the scalar remainder is covered
+	//
+	uint64_t check_kernel(
+			void (*kernel)(uint32_t*, const uint32_t*, int),
+			void (*reference)(uint32_t*, const uint32_t*, int),
+			vector<uint32_t> const& src,
+			vector<uint32_t> const& dst)
+	{
+		uint64_t mismatches = 0;
+		auto expected = dst;
+		auto actual = dst;
+		reference(expected.data(), src.data(), static_cast<int>(src.size()));
+		kernel(actual.data(), src.data(), static_cast<int>(src.size()));
+		for (size_t n = 0; n < src.size(); ++n) {
+			mismatches += (expected[n] != actual[n]) ? 1 : 0;
+		}
+
+		for (int offset = 0; offset < 8; ++offset)
+		{
+			for (int count = 0; count < 20; ++count)
+			{
+				auto e = dst;
+				auto a = dst;
+				reference(e.data() + offset, src.data() + offset, count);
+				kernel(a.data() + offset, src.data() + offset, count);
+				mismatches += (e != a) ? 1 : 0;
+			}
+		}
+		return mismatches;
+	}
+
+	// megapixels per second of a kernel over a whole frame
+	double time_kernel(
+			void (*kernel)(uint32_t*, const uint32_t*, int),
+			vector<uint32_t>& dst,
+			vector<uint32_t> const& src,
+			int iterations)
+	{
+		auto const start = time_now();
+		for (int n = 0; n < iterations; ++n) {
+			kernel(dst.data(), src.data(), static_cast<int>(src.size()));
+		}
+		auto const us = max<uint64_t>(1, time_now() - start);
+		return (double(src.size()) * iterations) / us;
+	}
+
+	//
+	// pixel kernels: every SIMD variant this CPU supports is checked
+	// exhaustively against the scalar reference, then timed on a frame
+	// of the output size ... returns false on any mismatch
+	//
+	bool run_pixels(Options const& opt)
+	{
+		using namespace pixels;
+		auto const scalar = kernels(Isa::Scalar);
+
+		// every (channel, alpha) pair
+		vector<uint32_t> pairs;
+		pairs.reserve(65536);
+		for (uint32_t a = 0; a < 256; ++a)
+		{
+			for (uint32_t c = 0; c < 256; ++c) {
+				pairs.push_back(c | ((255 - c) << 8) | ((c ^ 0x5a) << 16) | (a << 24));
+			}
+		}
+
+		Random random(opt.seed);
+		vector<uint32_t> noise(65536);
+		for (auto& p : noise) {
+			p = random.next();
+		}
+
+		// the largest error of the fixed-point unpremultiply vs. exact
+		// rounding for valid (c <= a) premultiplied input
+		int unpremultiply_error = 0;
+		for (int a = 1; a < 256; ++a)
+		{
+			for (int c = 0; c <= a; ++c)
+			{
+				auto const exact = ((c * 255) + (a / 2)) / a;
+				auto const v = min(255, (c * unpremultiply_factor(uint8_t(a))) >> 8);
+				unpremultiply_error = max(unpremultiply_error, abs(v - exact));
+			}
+		}
+
+		auto const pixels = static_cast<size_t>(opt.output_width) * opt.output_height;
+		vector<uint32_t> frame_src(pixels);
+		vector<uint32_t> frame_dst(pixels);
+		for (size_t n = 0; n < pixels; ++n)
+		{
+			frame_src[n] = random.next();
+			frame_dst[n] = random.next() | 0xff000000;
+		}
+		auto const iterations = max(1, opt.frames / 10);
+
+		bool ok = true;
+		Isa const all[] = { Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::NEON };
+		for (auto const isa : all)
+		{
+			auto const k = kernels(isa);
+			if (!k) {
+				continue;
+			}
+
+			uint64_t mismatches = 0;
+			if (isa != Isa::Scalar)
+			{
+				vector<uint32_t> const zeros(65536, 0);
+				mismatches += check_kernel(k->swizzle, scalar->swizzle, noise, zeros);
+				mismatches += check_kernel(k->swizzle, scalar->swizzle, pairs, zeros);
+				mismatches += check_kernel(k->premultiply, scalar->premultiply, pairs, zeros);
+				mismatches += check_kernel(k->premultiply, scalar->premultiply, noise, zeros);
+				mismatches += check_kernel(k->unpremultiply, scalar->unpremultiply, pairs, zeros);
+				mismatches += check_kernel(k->unpremultiply, scalar->unpremultiply, noise, zeros);
+				mismatches += check_kernel(k->over, scalar->over, noise, noise);
+
+				// alpha-over for every (source channel, source alpha, destination)
+				vector<uint32_t> src(65536), dst(65536);
+				for (uint32_t a = 0; a < 256; ++a)
+				{
+					for (uint32_t c = 0; c < 256; ++c)
+					{
+						for (uint32_t d = 0; d < 256; ++d)
+						{
+							src[(c << 8) | d] = c | (c << 8) | (c << 16) | (a << 24);
+							dst[(c << 8) | d] = d | (d << 8) | (d << 16) | (d << 24);
+						}
+					}
+					auto expected = dst;
+					auto actual = dst;
+					scalar->over(expected.data(), src.data(), 65536);
+					k->over(actual.data(), src.data(), 65536);
+					mismatches += (expected != actual) ? 1 : 0;
+				}
+			}
+
+			if (mismatches) {
+				ok = false;
+			}
+
+			auto dst = frame_dst;
+			auto const swizzle = time_kernel(k->swizzle, dst, frame_src, iterations);
+			auto const premultiply = time_kernel(k->premultiply, dst, frame_src, iterations);
+			auto const unpremultiply = time_kernel(k->unpremultiply, dst, frame_src, iterations);
+			dst = frame_dst;
+			auto const over = time_kernel(k->over, dst, frame_src, iterations);
+
+			printf("{\"mode\":\"pixels\",\"isa\":\"%s\",\"best\":%s,\"mismatches\":%llu,"
+				"\"unpremultiply_max_error\":%d,\"swizzle_mpix_per_sec\":%.0f,"
+				"\"premultiply_mpix_per_sec\":%.0f,\"unpremultiply_mpix_per_sec\":%.0f,"
+				"\"over_mpix_per_sec\":%.0f}\n",
+				to_string(isa), (isa == best_isa()) ? "true" : "false",
+				static_cast<unsigned long long>(mismatches), unpremultiply_error,
+				swizzle, premultiply, unpremultiply, over);
+			fflush(stdout);
+		}
+		return ok;
+	}
+
+	bool parse_size(string const& value, int& width, int& height)
+	{
+		auto const x = value.find('x');
+		if (x == string::npos) {
+			return false;
+		}
+		width = to_int(value.substr(0, x), 0);
+		height = to_int(value.substr(x + 1), 0);
+		return (width > 0 && height > 0);
+	}
+
+	vector<int> parse_list(string const& value)
+	{
+		vector<int> list;
+		istringstream in(value);
+		string item;
+		while (getline(in, item, ','))
+		{
+			auto const n = to_int(item, 0);
+			if (n > 0) {
+				list.push_back(n);
+			}
+		}
+		return list;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options opt;
+	opt.mode = "compose";
+	opt.pattern = "mixed";
+	opt.layer_width = 640;
+	opt.layer_height = 360;
+	opt.output_width = 1920;
+	opt.output_height = 1080;
+	opt.frames = 200;
+	opt.warmup = 10;
+	opt.full_redraw = true;
+	opt.readers = 4;
+	opt.duration = 1000;
+	opt.seed = 1;
+	opt.capture_path = "mixerbench_capture/frame";
+
+	for (int n = 1; n < argc; ++n)
+	{
+		string option(argv[n]);
+		if (option.substr(0, 2) != "--")
+		{
+			fprintf(stderr, "unexpected argument: %s\n", option.c_str());
+			return 1;
+		}
+
+		option = option.substr(2);
+
+		string key, value;
+		auto const eq = option.find('=');
+		if (eq != string::npos)
+		{
+			key = option.substr(0, eq);
+			value = option.substr(eq + 1);
+		}
+		else {
+			key = option;
+		}
+
+		if (key == "mode") {
+			opt.mode = value;
+		}
+		else if (key == "layers") {
+			opt.layers = parse_list(value);
+		}
+		else if (key == "pattern") {
+			opt.pattern = value;
+		}
+		else if (key == "layer-size") {
+			parse_size(value, opt.layer_width, opt.layer_height);
+		}
+		else if (key == "output") {
+			parse_size(value, opt.output_width, opt.output_height);
+		}
+		else if (key == "frames") {
+			opt.frames = max(1, to_int(value, opt.frames));
+		}
+		else if (key == "warmup") {
+			opt.warmup = max(0, to_int(value, opt.warmup));
+		}
+		else if (key == "redraw") {
+			opt.full_redraw = (value != "damage");
+		}
+		else if (key == "readers") {
+			opt.readers = max(1, to_int(value, opt.readers));
+		}
+		else if (key == "duration") {
+			opt.duration = max(1, to_int(value, opt.duration));
+		}
+		else if (key == "seed") {
+			opt.seed = static_cast<uint32_t>(to_int(value, 1));
+		}
+		else if (key == "capture-path") {
+			opt.capture_path = value;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option: --%s\n", key.c_str());
+			return 1;
+		}
+	}
+
+	Pattern unused;
+	if (opt.pattern != "mixed" && !to_pattern(opt.pattern, unused))
+	{
+		fprintf(stderr, "unknown pattern: %s\n", opt.pattern.c_str());
+		return 1;
+	}
+
+	if (opt.layers.empty()) {
+		opt.layers.push_back(16);
+	}
+
+	if (opt.mode == "dirty")
+	{
+		run_dirty(opt);
+		return 0;
+	}
+
+	if (opt.mode == "pool")
+	{
+		run_pool(opt);
+		return 0;
+	}
+
+	if (opt.mode == "input") {
+		return run_input(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "source") {
+		return run_source(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "stats") {
+		return run_stats(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "visibility") {
+		return run_visibility(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "pacing")
+	{
+		run_pacing(opt);
+		return 0;
+	}
+
+	if (opt.mode == "scheduler") {
+		return run_scheduler(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "capture") {
+		return run_capture(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "pixels") {
+		return run_pixels(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "mailbox") {
+		return run_mailbox(opt) ? 0 : 2;
+	}
+
+	if (opt.mode == "keyed") {
+		return run_keyed(opt) ? 0 : 2;
+	}
+
+	for (auto const count : opt.layers)
+	{
+		if (opt.mode == "compose") {
+			run_compose(opt, count);
+		}
+		else if (opt.mode == "contention") {
+			run_contention(opt, count);
+		}
+		else if (opt.mode == "hittest") {
+			run_hittest(opt, count);
+		}
+		else
+		{
+			fprintf(stderr, "unknown mode: %s\n", opt.mode.c_str());
+			return 1;
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include "batch.h"
+
+using namespace std;
+
+QuadBatch::QuadBatch()
+{
+	clear();
+}
+
+void QuadBatch::clear()
+{
+	// keep the capacity ... batches are rebuilt every frame
+	vertices_.clear();
+	commands_.clear();
+	stats_.quads = 0;
+	stats_.draws = 0;
+	stats_.texture_binds = 0;
+	stats_.blend_changes = 0;
+}
+
+namespace {
+
+	//
+	// every layer is drawn from the same unit quad ... only the 
+	// matrix differs (two triangles: tl, tr, bl and bl, tr, br)
+	//
+	struct Corner
+	{
+		float u;
+		float v;
+	};
+
+	Corner const unit_quad[QuadBatch::vertices_per_quad] = {
+		{ 0.0f, 0.0f },
+		{ 1.0f, 0.0f },
+		{ 0.0f, 1.0f },
+		{ 0.0f, 1.0f },
+		{ 1.0f, 0.0f },
+		{ 1.0f, 1.0f }
+	};
+}
+
+void QuadBatch::add(shared_ptr<d3d11::Texture2D> const& texture,
+		Affine const& matrix, bool flip, bool blend, float opacity)
+{
+	if (!texture) {
+		return;
+	}
+
+	auto const first = static_cast<uint32_t>(vertices_.size());
+	for (auto const& corner : unit_quad)
+	{
+		float x, y;
+		matrix.apply(corner.u, corner.v, x, y);
+
+		// convert to clip space (same as d3d11::Device::create_quad)
+		Vertex vertex;
+		vertex.x = (x * 2.0f) - 1.0f;
+		vertex.y = 1.0f - (y * 2.0f);
+		vertex.z = 1.0f;
+		vertex.u = corner.u;
+		vertex.v = flip ? (1.0f - corner.v) : corner.v;
+		vertex.alpha = opacity;
+		vertices_.push_back(vertex);
+	}
+
+	stats_.quads++;
+
+	// extend the previous draw if nothing changes
+	if (!commands_.empty())
+	{
+		auto& last = commands_.back();
+		if (last.texture == texture && last.blend == blend)
+		{
+			last.count += vertices_per_quad;
+			return;
+		}
+	}
+
+	if (commands_.empty() || commands_.back().texture != texture) {
+		stats_.texture_binds++;
+	}
+
+	// the pipeline starts out blending (see SwapChain::bind)
+	if ((commands_.empty() ? true : commands_.back().blend) != blend) {
+		stats_.blend_changes++;
+	}
+
+	Command cmd;
+	cmd.texture = texture;
+	cmd.blend = blend;
+	cmd.first = first;
+	cmd.count = vertices_per_quad;
+	commands_.push_back(cmd);
+
+	stats_.draws++;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "transform.h"
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+namespace d3d11 {
+	class Texture2D;
+}
+
+//
+// records textured quads for a frame so they can be submitted from a
+// single vertex buffer with the shader bound once
+//
+// quads are kept in painter's order; consecutive quads that use the same
+// texture and blend state are folded into a single draw command.  The
+// recorded commands are exactly what gets submitted, so the stats can be
+// checked without a GPU.
+//
+class QuadBatch
+{
+public:
+
+	// must match the input layout of d3d11::Device::create_default_effect
+	struct Vertex
+	{
+		float x;
+		float y;
+		float z;
+		float u;
+		float v;
+		float alpha;
+	};
+
+	struct Command
+	{
+		std::shared_ptr<d3d11::Texture2D> texture;
+		bool blend;
+		uint32_t first;   // first vertex
+		uint32_t count;   // vertex count
+	};
+
+	struct Stats
+	{
+		uint32_t quads;
+		uint32_t draws;
+		uint32_t texture_binds;
+		uint32_t blend_changes;
+	};
+
+	// triangle list ... two triangles per quad
+	static uint32_t const vertices_per_quad = 6;
+
+	QuadBatch();
+
+	void clear();
+
+	//
+	// add the unit quad placed by the matrix (in normalized 0..1 
+	// composition units, y down) ... see to_affine
+	//
+	void add(std::shared_ptr<d3d11::Texture2D> const& texture,
+			Affine const& matrix, bool flip, bool blend, float opacity);
+
+	std::vector<Vertex> const& vertices() const { return vertices_; }
+	std::vector<Command> const& commands() const { return commands_; }
+
+	Stats stats() const { return stats_; }
+
+private:
+
+	std::vector<Vertex> vertices_;
+	std::vector<Command> commands_;
+	Stats stats_;
+};
@@ -0,0 +1,569 @@
+#include "capture.h"
+#include "crc32.h"
+#include "frame_pool.h"
+#include "pixels.h"
+#include "util.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <signal.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+	// the directory part of a file prefix (empty if there is none)
+	string parent_directory(string const& path)
+	{
+		auto const slash = path.find_last_of("/\\");
+		if (slash == string::npos || slash == 0) {
+			return string();
+		}
+		return path.substr(0, slash);
+	}
+
+	void make_directory(string const& dir)
+	{
+		if (dir.empty()) {
+			return;
+		}
+#if defined(_WIN32)
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+
+	FILE* open_pipe(string const& command)
+	{
+#if defined(_WIN32)
+		return _popen(command.c_str(), "wb");
+#else
+		// an encoder that exits early must not take us down with it
+		signal(SIGPIPE, SIG_IGN);
+		return popen(command.c_str(), "w");
+#endif
+	}
+
+	void close_pipe(FILE* pipe)
+	{
+#if defined(_WIN32)
+		_pclose(pipe);
+#else
+		pclose(pipe);
+#endif
+	}
+
+	uint32_t adler32(const uint8_t* data, size_t size)
+	{
+		// 5552 bytes is the most that can be summed before b overflows
+		uint32_t a = 1, b = 0;
+		while (size)
+		{
+			auto const block = min<size_t>(size, 5552);
+			for (size_t n = 0; n < block; ++n)
+			{
+				a += data[n];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += block;
+			size -= block;
+		}
+		return (b << 16) | a;
+	}
+
+	void put_u32(vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back(static_cast<uint8_t>(v >> 24));
+		out.push_back(static_cast<uint8_t>(v >> 16));
+		out.push_back(static_cast<uint8_t>(v >> 8));
+		out.push_back(static_cast<uint8_t>(v));
+	}
+
+	// append a chunk with the data from out[start] on (already appended)
+	void end_chunk(vector<uint8_t>& out, size_t start)
+	{
+		auto const size = static_cast<uint32_t>(out.size() - start - 8);
+		out[start] = static_cast<uint8_t>(size >> 24);
+		out[start + 1] = static_cast<uint8_t>(size >> 16);
+		out[start + 2] = static_cast<uint8_t>(size >> 8);
+		out[start + 3] = static_cast<uint8_t>(size);
+		put_u32(out, crc32(0, out.data() + start + 4, out.size() - start - 4));
+	}
+
+	size_t begin_chunk(vector<uint8_t>& out, char const* type)
+	{
+		auto const start = out.size();
+		put_u32(out, 0);
+		out.insert(out.end(), type, type + 4);
+		return start;
+	}
+}
+
+CaptureOptions default_capture_options()
+{
+	CaptureOptions options;
+	options.format = CaptureFormat::Png;
+	options.every = 60;
+	options.depth = 4;
+	options.workers = 2;
+	options.drop = CaptureDrop::Newest;
+	options.path = "capture/frame";
+	options.fps = 60;
+	return options;
+}
+
+char const* to_string(CaptureFormat format)
+{
+	switch (format)
+	{
+		case CaptureFormat::Raw: return "raw";
+		case CaptureFormat::Y4m: return "y4m";
+		default: return "png";
+	}
+}
+
+char const* to_string(CaptureDrop drop)
+{
+	return (drop == CaptureDrop::Oldest) ? "oldest" : "newest";
+}
+
+bool to_capture_format(string const& name, CaptureFormat& format)
+{
+	if (name == "raw") {
+		format = CaptureFormat::Raw;
+	}
+	else if (name == "png") {
+		format = CaptureFormat::Png;
+	}
+	else if (name == "y4m") {
+		format = CaptureFormat::Y4m;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool to_capture_drop(string const& name, CaptureDrop& drop)
+{
+	if (name == "newest") {
+		drop = CaptureDrop::Newest;
+	}
+	else if (name == "oldest") {
+		drop = CaptureDrop::Oldest;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+CapturePipeline::CapturePipeline(CaptureOptions const& options)
+	: options_(options)
+	, frames_(0)
+	, next_index_(0)
+	, busy_(0)
+	, stopping_(false)
+	, next_write_(0)
+	, stream_(nullptr)
+	, piped_(false)
+	, stream_width_(0)
+	, stream_height_(0)
+{
+	memset(&stats_, 0, sizeof(stats_));
+
+	if (options_.format != CaptureFormat::Y4m || options_.command.empty()) {
+		make_directory(parent_directory(options_.path));
+	}
+
+	auto const workers = max(1u, options_.workers);
+	for (uint32_t n = 0; n < workers; ++n) {
+		workers_.push_back(thread([this]() { run(); }));
+	}
+}
+
+CapturePipeline::~CapturePipeline()
+{
+	{
+		lock_guard<mutex> guard(lock_);
+		stopping_ = true;
+	}
+	queued_.notify_all();
+
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+	close_stream();
+}
+
+bool CapturePipeline::due()
+{
+	auto const every = max(1u, options_.every);
+	if ((frames_++ % every) != 0) {
+		return false;
+	}
+
+	lock_guard<mutex> guard(lock_);
+
+	// the snapshot would be dropped anyway ... don't read it back
+	if (options_.drop == CaptureDrop::Newest && queue_.size() >= max(1u, options_.depth))
+	{
+		stats_.dropped++;
+		return false;
+	}
+	return true;
+}
+
+bool CapturePipeline::submit(
+	const uint8_t* pixels,
+	uint32_t stride,
+	uint32_t width,
+	uint32_t height,
+	bool bgra)
+{
+	if (!pixels || !width || !height) {
+		return false;
+	}
+
+	auto const depth = max(1u, options_.depth);
+	{
+		lock_guard<mutex> guard(lock_);
+		if (options_.drop == CaptureDrop::Newest && queue_.size() >= depth)
+		{
+			stats_.dropped++;
+			return false;
+		}
+	}
+
+	// copy outside the lock so the workers are never held up by it
+	Job job;
+	job.stride = width * 4;
+	job.width = width;
+	job.height = height;
+	job.bgra = bgra;
+	job.index = 0;
+	job.pixels = frame_pool()->acquire(job.stride * height);
+	if (!job.pixels)
+	{
+		drop();
+		return false;
+	}
+
+	for (uint32_t y = 0; y < height; ++y) {
+		memcpy(job.pixels.get() + (y * job.stride), pixels + (y * stride), job.stride);
+	}
+
+	{
+		lock_guard<mutex> guard(lock_);
+		while (queue_.size() >= depth)
+		{
+			// oldest first ... (a newer snapshot may have raced us for Newest)
+			queue_.pop_front();
+			stats_.dropped++;
+		}
+		queue_.push_back(job);
+		stats_.captured++;
+		stats_.max_queued = max(stats_.max_queued, static_cast<uint32_t>(queue_.size()));
+	}
+	queued_.notify_one();
+	return true;
+}
+
+void CapturePipeline::drop()
+{
+	lock_guard<mutex> guard(lock_);
+	stats_.dropped++;
+}
+
+void CapturePipeline::flush()
+{
+	unique_lock<mutex> guard(lock_);
+	idle_.wait(guard, [this]() { return queue_.empty() && !busy_; });
+}
+
+CaptureStats CapturePipeline::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	auto stats = stats_;
+	stats.frames = frames_;
+	stats.queued = static_cast<uint32_t>(queue_.size());
+	stats.encode = encode_.summary();
+	return stats;
+}
+
+void CapturePipeline::run()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> guard(lock_);
+			queued_.wait(guard, [this]() { return stopping_ || !queue_.empty(); });
+			if (queue_.empty()) {
+				return;
+			}
+
+			// numbered when taken so dropped snapshots leave no gaps
+			job = queue_.front();
+			queue_.pop_front();
+			job.index = next_index_++;
+			busy_++;
+		}
+
+		auto const start = time_now();
+		auto const ok = write(job);
+		auto const elapsed = time_now() - start;
+
+		job.pixels.reset();
+		{
+			lock_guard<mutex> guard(lock_);
+			encode_.record(static_cast<int64_t>(elapsed));
+			if (ok) {
+				stats_.written++;
+			}
+			else {
+				stats_.failed++;
+			}
+			busy_--;
+		}
+		idle_.notify_all();
+	}
+}
+
+bool CapturePipeline::write(Job const& job)
+{
+	switch (options_.format)
+	{
+		case CaptureFormat::Raw:
+		{
+			// the pixels exactly as composed (the size is in the name)
+			char ext[64];
+			snprintf(ext, sizeof(ext), "_%ux%u.%s",
+				job.width, job.height, job.bgra ? "bgra" : "rgba");
+			return write_file(job, job.pixels.get(), job.stride * job.height, ext);
+		}
+
+		case CaptureFormat::Png:
+		{
+			vector<uint8_t> png;
+			encode_png(job.pixels.get(), job.stride, job.width, job.height, job.bgra, png);
+			return write_file(job, png.data(), png.size(), ".png");
+		}
+
+		default: break;
+	}
+	return write_stream(job);
+}
+
+bool CapturePipeline::write_file(Job const& job, const uint8_t* data, size_t size, char const* ext)
+{
+	char number[32];
+	snprintf(number, sizeof(number), "_%06llu", static_cast<unsigned long long>(job.index + 1));
+	auto const name = options_.path + number + ext;
+
+	auto const file = fopen(name.c_str(), "wb");
+	if (!file)
+	{
+		log_message("capture: could not create %s\n", name.c_str());
+		return false;
+	}
+	auto const ok = (fwrite(data, 1, size, file) == size);
+	return (fclose(file) == 0) && ok;
+}
+
+//
+// convert in parallel ... then wait for our turn so frames reach the
+// stream in capture order
+//
+bool CapturePipeline::write_stream(Job const& job)
+{
+	vector<uint8_t> yuv;
+	encode_i420(job.pixels.get(), job.stride, job.width, job.height, job.bgra, yuv);
+
+	unique_lock<mutex> guard(stream_lock_);
+	stream_turn_.wait(guard, [&]() { return next_write_ == job.index; });
+
+	auto ok = false;
+	if (!stream_)
+	{
+		piped_ = !options_.command.empty();
+		stream_ = piped_ ? open_pipe(options_.command) :
+			fopen((options_.path + ".y4m").c_str(), "wb");
+		if (stream_)
+		{
+			// the frame rate of the capture (not the composition)
+			stream_width_ = job.width;
+			stream_height_ = job.height;
+			fprintf(stream_, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n",
+				job.width, job.height, max(1u, options_.fps), max(1u, options_.every));
+		}
+		else {
+			log_message("capture: could not open %s\n",
+				piped_ ? options_.command.c_str() : options_.path.c_str());
+		}
+	}
+
+	// a stream can't change size ... frames after a resize are not written
+	if (stream_ && job.width == stream_width_ && job.height == stream_height_)
+	{
+		fputs("FRAME\n", stream_);
+		ok = (fwrite(yuv.data(), 1, yuv.size(), stream_) == yuv.size());
+	}
+
+	next_write_++;
+	guard.unlock();
+	stream_turn_.notify_all();
+	return ok;
+}
+
+void CapturePipeline::close_stream()
+{
+	lock_guard<mutex> guard(stream_lock_);
+	if (stream_)
+	{
+		if (piped_) {
+			close_pipe(stream_);
+		}
+		else {
+			fclose(stream_);
+		}
+		stream_ = nullptr;
+	}
+}
+
+shared_ptr<CapturePipeline> create_capture(CaptureOptions const& options)
+{
+	return make_shared<CapturePipeline>(options);
+}
+
+void encode_png(
+	const uint8_t* pixels,
+	uint32_t stride,
+	uint32_t width,
+	uint32_t height,
+	bool bgra,
+	vector<uint8_t>& png)
+{
+	// the scanlines (filter byte 0 + straight-alpha RGBA)
+	auto const row_size = 1 + (width * 4);
+	vector<uint8_t> raw(row_size * height);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		auto const row = raw.data() + (y * row_size);
+		row[0] = 0;
+		auto const dst = reinterpret_cast<uint32_t*>(row + 1);
+		auto const src = reinterpret_cast<const uint32_t*>(pixels + (y * stride));
+		memcpy(dst, src, width * 4);
+		if (bgra) {
+			pixels::swizzle(dst, dst, static_cast<int>(width));
+		}
+		pixels::unpremultiply(dst, dst, static_cast<int>(width));
+	}
+
+	png.clear();
+	png.reserve(raw.size() + (raw.size() / 65535 + 1) * 5 + 128);
+
+	static uint8_t const signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	png.insert(png.end(), signature, signature + sizeof(signature));
+
+	auto chunk = begin_chunk(png, "IHDR");
+	put_u32(png, width);
+	put_u32(png, height);
+	png.push_back(8);		// bits per channel
+	png.push_back(6);		// RGBA
+	png.push_back(0);
+	png.push_back(0);
+	png.push_back(0);
+	end_chunk(png, chunk);
+
+	//
+	// a zlib stream of stored (uncompressed) blocks ... the encoders are
+	// there to get frames out quickly, an archive can be recompressed
+	//
+	chunk = begin_chunk(png, "IDAT");
+	png.push_back(0x78);
+	png.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		auto const size = min<size_t>(65535, raw.size() - offset);
+		auto const last = (offset + size) == raw.size();
+		png.push_back(last ? 1 : 0);
+		png.push_back(static_cast<uint8_t>(size));
+		png.push_back(static_cast<uint8_t>(size >> 8));
+		png.push_back(static_cast<uint8_t>(~size));
+		png.push_back(static_cast<uint8_t>(~size >> 8));
+		png.insert(png.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+		offset += size;
+	}
+	while (offset < raw.size());
+	put_u32(png, adler32(raw.data(), raw.size()));
+	end_chunk(png, chunk);
+
+	chunk = begin_chunk(png, "IEND");
+	end_chunk(png, chunk);
+}
+
+void encode_i420(
+	const uint8_t* pixels,
+	uint32_t stride,
+	uint32_t width,
+	uint32_t height,
+	bool bgra,
+	vector<uint8_t>& yuv)
+{
+	auto const cw = (width + 1) / 2;
+	auto const ch = (height + 1) / 2;
+	yuv.resize((width * height) + (cw * ch * 2));
+
+	auto const y_plane = yuv.data();
+	auto const u_plane = y_plane + (width * height);
+	auto const v_plane = u_plane + (cw * ch);
+
+	// byte offsets of red and blue (alpha is ignored ... shown over black)
+	auto const r = bgra ? 2 : 0;
+	auto const b = bgra ? 0 : 2;
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		auto const src = pixels + (y * stride);
+		auto const dst = y_plane + (y * width);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			auto const p = src + (x * 4);
+			dst[x] = static_cast<uint8_t>(
+				((66 * p[r] + 129 * p[1] + 25 * p[b] + 128) >> 8) + 16);
+		}
+	}
+
+	// chroma from the average of each 2x2 block (clamped at the edges)
+	for (uint32_t y = 0; y < ch; ++y)
+	{
+		auto const row0 = pixels + ((y * 2) * stride);
+		auto const row1 = pixels + (min(y * 2 + 1, height - 1) * stride);
+		for (uint32_t x = 0; x < cw; ++x)
+		{
+			auto const x0 = (x * 2) * 4;
+			auto const x1 = min(x * 2 + 1, width - 1) * 4;
+			int const red = (row0[x0 + r] + row0[x1 + r] + row1[x0 + r] + row1[x1 + r] + 2) >> 2;
+			int const green = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+			int const blue = (row0[x0 + b] + row0[x1 + b] + row1[x0 + b] + row1[x1 + b] + 2) >> 2;
+
+			u_plane[y * cw + x] = static_cast<uint8_t>(
+				((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+			v_plane[y * cw + x] = static_cast<uint8_t>(
+				((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+		}
+	}
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// how captured frames are written:
+//
+//   Raw - one file per frame with the pixels as composed (no header)
+//   Png - one PNG file per frame (straight alpha)
+//   Y4m - a single YUV4MPEG2 (4:2:0) stream to a file or to the stdin
+//         of an encoder process (e.g. "ffmpeg -i - -c:v libx264 out.mp4")
+//
+enum class CaptureFormat
+{
+	Raw,
+	Png,
+	Y4m
+};
+
+//
+// what happens to a snapshot when the queue is full:
+//
+//   Newest - the new snapshot is dropped (it isn't even read back)
+//   Oldest - the oldest waiting snapshot is dropped to make room
+//
+enum class CaptureDrop
+{
+	Newest,
+	Oldest
+};
+
+struct CaptureOptions
+{
+	CaptureFormat format;
+	uint32_t every;				// snapshot every N composed frames
+	uint32_t depth;				// snapshots waiting to be written
+	uint32_t workers;			// convert / write threads
+	CaptureDrop drop;
+	std::string path;			// file prefix (e.g. "capture/frame")
+	std::string command;		// Y4m: pipe to this process instead of a file
+	uint32_t fps;				// Y4m: rate of the composition (before every)
+};
+
+CaptureOptions default_capture_options();
+
+char const* to_string(CaptureFormat format);
+char const* to_string(CaptureDrop drop);
+
+// "raw", "png" or "y4m" ... returns false for anything else
+bool to_capture_format(std::string const& name, CaptureFormat& format);
+
+// "newest" or "oldest" ... returns false for anything else
+bool to_capture_drop(std::string const& name, CaptureDrop& drop);
+
+//
+// capture counters (encode times in microseconds):
+//
+//   frames     - composed frames seen
+//   captured   - snapshots queued for writing
+//   dropped    - snapshots lost to backpressure (queue or readback full)
+//   written    - snapshots written out
+//   failed     - snapshots that could not be written
+//   queued     - snapshots waiting right now (max_queued at most)
+//   encode     - convert + write time of a snapshot
+//
+struct CaptureStats
+{
+	uint64_t frames;
+	uint64_t captured;
+	uint64_t dropped;
+	uint64_t written;
+	uint64_t failed;
+	uint32_t queued;
+	uint32_t max_queued;
+	Histogram::Summary encode;
+};
+
+//
+// snapshots of the composed output written by worker threads
+//
+// the render thread asks due() every frame and, when it is, hands over
+// the pixels with submit() ... which copies them into a pooled buffer
+// and queues them without ever waiting on a worker.  The queue is
+// bounded by depth and the drop policy decides what gives when the
+// workers can't keep up.  due() already says no while the queue is full
+// (for Newest) so no readback is wasted on a frame that would be dropped.
+//
+// snapshots are converted in parallel but a Y4m stream is always
+// written in capture order.  Destroying the pipeline writes out
+// whatever is still queued.
+//
+class CapturePipeline
+{
+public:
+	CapturePipeline(CaptureOptions const& options);
+	~CapturePipeline();
+
+	CaptureOptions const& options() const { return options_; }
+
+	//
+	// render thread: count a composed frame ... true if it should be
+	// snapshot and submitted
+	//
+	bool due();
+
+	//
+	// render thread: queue a copy of a snapshot (alpha in the last byte,
+	// premultiplied) ... returns false if it was dropped
+	//
+	bool submit(
+		const uint8_t* pixels,
+		uint32_t stride,
+		uint32_t width,
+		uint32_t height,
+		bool bgra);
+
+	// a due snapshot could not be taken (e.g. no readback was free)
+	void drop();
+
+	// wait until everything queued has been written (never from the render loop)
+	void flush();
+
+	CaptureStats stats() const;
+
+private:
+
+	struct Job
+	{
+		std::shared_ptr<uint8_t> pixels;
+		uint32_t stride;
+		uint32_t width;
+		uint32_t height;
+		bool bgra;
+		uint64_t index;
+	};
+
+	CapturePipeline(CapturePipeline const&);
+	CapturePipeline& operator=(CapturePipeline const&);
+
+	void run();
+	bool write(Job const& job);
+	bool write_file(Job const& job, const uint8_t* data, size_t size, char const* ext);
+	bool write_stream(Job const& job);
+	void close_stream();
+
+	CaptureOptions const options_;
+
+	// counted by the render thread
+	std::atomic<uint64_t> frames_;
+
+	mutable std::mutex lock_;
+	std::condition_variable queued_;
+	std::condition_variable idle_;
+	std::deque<Job> queue_;
+	std::vector<std::thread> workers_;
+	uint64_t next_index_;
+	uint32_t busy_;
+	bool stopping_;
+	CaptureStats stats_;
+	Histogram encode_;
+
+	// the Y4m stream ... written strictly in index order
+	std::mutex stream_lock_;
+	std::condition_variable stream_turn_;
+	uint64_t next_write_;
+	FILE* stream_;
+	bool piped_;
+	uint32_t stream_width_;
+	uint32_t stream_height_;
+};
+
+std::shared_ptr<CapturePipeline> create_capture(CaptureOptions const& options);
+
+//
+// encoders used by the pipeline (pixels with alpha in the last byte)
+//
+
+// a PNG (8-bit RGBA, stored deflate blocks) ... premultiplied input is unpremultiplied
+void encode_png(
+	const uint8_t* pixels,
+	uint32_t stride,
+	uint32_t width,
+	uint32_t height,
+	bool bgra,
+	std::vector<uint8_t>& png);
+
+// BT.601 (limited range) I420 planes ... odd sizes round the chroma up
+void encode_i420(
+	const uint8_t* pixels,
+	uint32_t stride,
+	uint32_t width,
+	uint32_t height,
+	bool bgra,
+	std::vector<uint8_t>& yuv);
@@ -1,7 +1,12 @@
 #include "composition.h"
 #include "util.h"
 
+#include <algorithm>
+#include <math.h>
+
+#if defined(_WIN32)
 #include <include/cef_parser.h>
+#endif
 
 using namespace std;
 
@@ -10,6 +15,11 @@ Layer::Layer(
 	: device_(device)
 	, flip_(flip)
 	, want_input_(want_input)
+	, opaque_(false)
+	, timing_(make_shared<LayerTiming>())
+	, transform_(identity_transform())
+	, animation_start_(-1.0)
+	, visible_(true)
 {
 	bounds_.x = bounds_.y = bounds_.width = bounds_.height = 0.0f;
 }
@@ -29,10 +39,126 @@ Rect Layer::bounds() const {
 	return bounds_;
 }
 
+namespace {
+
+	//
+	// axis-aligned box around a rect (in normalized layer units)
+	// after mapping it with a layer matrix
+	//
+	Rect bounding_box(Affine const& m, Rect const& r)
+	{
+		float const u[] = { r.x, r.x + r.width, r.x, r.x + r.width };
+		float const v[] = { r.y, r.y, r.y + r.height, r.y + r.height };
+
+		float x0, y0, x1, y1;
+		m.apply(u[0], v[0], x0, y0);
+		x1 = x0;
+		y1 = y0;
+		for (int n = 1; n < 4; ++n)
+		{
+			float x, y;
+			m.apply(u[n], v[n], x, y);
+			x0 = min(x0, x);
+			y0 = min(y0, y);
+			x1 = max(x1, x);
+			y1 = max(y1, y);
+		}
+		return Rect{ x0, y0, x1 - x0, y1 - y0 };
+	}
+}
+
+float Layer::aspect() const
+{
+	auto const comp = composition();
+	if (comp && comp->width() > 0 && comp->height() > 0) {
+		return static_cast<float>(comp->width()) / comp->height();
+	}
+	return 1.0f;
+}
+
+Affine Layer::matrix() const
+{
+	return to_affine(bounds_.x, bounds_.y, bounds_.width, bounds_.height, 
+				transform_, aspect());
+}
+
+Rect Layer::extent() const
+{
+	Rect const all = { 0.0f, 0.0f, 1.0f, 1.0f };
+	return bounding_box(matrix(), all);
+}
+
+Transform Layer::transform() const {
+	return transform_;
+}
+
+void Layer::set_transform(Transform const& transform)
+{
+	if (transform == transform_) {
+		return;
+	}
+
+	// both where we were and where we're going need to be redrawn
+	invalidate();
+	transform_ = transform;
+	invalidate();
+
+	auto const comp = composition();
+	if (comp) {
+		comp->layer_moved(this);
+	}
+}
+
+void Layer::animate(shared_ptr<Animation const> const& animation)
+{
+	animation_start_ = -1.0;
+	atomic_store(&animation_, animation);
+}
+
 bool Layer::want_input() const {
 	return want_input_;
 }
 
+string Layer::name() const {
+	return name_;
+}
+
+void Layer::set_name(string const& name) {
+	name_ = name;
+}
+
+shared_ptr<LayerTiming> const& Layer::timing() const {
+	return timing_;
+}
+
+bool Layer::opaque() const {
+	return opaque_;
+}
+
+bool Layer::occludes() const
+{
+	return opaque_ && 
+		transform_.opacity >= 1.0f && 
+		fmod(transform_.rotation, 360.0f) == 0.0f;
+}
+
+bool Layer::visible() const {
+	return visible_;
+}
+
+void Layer::set_visible(bool visible) {
+	visible_ = visible;
+}
+
+void Layer::set_opaque(bool opaque) 
+{
+	if (opaque != opaque_) 
+	{
+		opaque_ = opaque;
+		invalidate();
+	}
+}
+
 void Layer::mouse_click(MouseButton, bool, int32_t, int32_t)
 {
 	// default is to do nothing with input
@@ -43,49 +169,113 @@ void Layer::mouse_move(bool, int32_t, int32_t)
 	// default is to do nothing with input
 }
 
+void Layer::invalidate()
+{
+	Rect const all = { 0.0f, 0.0f, 1.0f, 1.0f };
+	invalidate(all);
+}
+
+void Layer::invalidate(Rect const& rect)
+{
+	// convert to composition space using our current bounds and transform
+	auto const r = bounding_box(matrix(), rect);
+	if (r.width > 0.0f && r.height > 0.0f)
+	{
+		lock_guard<mutex> guard(damage_lock_);
+		damage_.push_back(r);
+	}
+}
+
+void Layer::take_damage(vector<Rect>& damage)
+{
+	lock_guard<mutex> guard(damage_lock_);
+	damage.insert(damage.end(), damage_.begin(), damage_.end());
+	damage_.clear();
+}
+
+DeliveryStats Layer::delivery() const {
+	return no_delivery();
+}
+
 void Layer::move(float x, float y, float width, float height)
 {	
+	// both where we were and where we're going need to be redrawn
+	invalidate();
+
 	bounds_.x = x;
 	bounds_.y = y;
 	bounds_.width = width;
 	bounds_.height = height;
 
-	// obviously, it is not efficient to create the quad everytime we
-	// move ... but for now we're just trying to get something on-screen
-	geometry_.reset();
+	invalidate();
+
+	auto const comp = composition();
+	if (comp) {
+		comp->layer_moved(this);
+	}
 }
 
-void Layer::tick(double)
+void Layer::tick(double t)
 {
-	// nothing to update in the base class
+	auto animation = atomic_load(&animation_);
+	if (animation)
+	{
+		if (animation_start_ < 0.0) {
+			animation_start_ = t;
+		}
+
+		auto const elapsed = t - animation_start_;
+		set_transform(animation->evaluate(elapsed));
+
+		// done (unless a new animation was started meanwhile)
+		if (animation->finished(elapsed)) {
+			atomic_compare_exchange_strong(
+				&animation_, &animation, shared_ptr<Animation const>());
+		}
+	}
+}
+
+void Layer::render(shared_ptr<soft::Context> const&)
+{
+	// layers without CPU-side content draw nothing in the software backend
+}
+
+//
+// helper method for derived classes to draw a CPU surface
+// with the software backend
+//
+// note: the software backend only applies the offset and scale 
+// of the transform (not rotation or opacity)
+//
+void Layer::render_surface(
+		shared_ptr<soft::Context> const& ctx,
+		shared_ptr<soft::Surface> const& surface)
+{
+	if (ctx && surface) 
+	{
+		auto transform = transform_;
+		transform.rotation = 0.0f;
+		auto const m = to_affine(bounds_.x, bounds_.y, bounds_.width, bounds_.height, 
+					transform, aspect());
+		ctx->draw(surface, m.dx, m.dy, m.m11, m.m22, flip_, !opaque_);
+	}
 }
 
 //
 // helper method for derived classes to draw a textured-quad.
 //
+// the quad is recorded into the composition's batch and 
+// submitted with all other layers once they have rendered
+//
 void Layer::render_texture(
-		shared_ptr<d3d11::Context> const& ctx, 
+		shared_ptr<d3d11::Context> const&, 
 		shared_ptr<d3d11::Texture2D> const& texture)
 {
-	if (!geometry_) {
-		geometry_ = device_->create_quad(bounds_.x, 
-			bounds_.y, bounds_.width, bounds_.height, flip_);
-	}
-	
-	if (geometry_ && texture)
+	auto const comp = composition();
+	if (comp && texture)
 	{
-		// we need a shader
-		if (!effect_) {
-			effect_ = device_->create_default_effect();
-		}
-
-		// bind our states/resource to the pipeline
-		d3d11::ScopedBinder<d3d11::Geometry> quad_binder(ctx, geometry_);
-		d3d11::ScopedBinder<d3d11::Effect> fx_binder(ctx, effect_);
-		d3d11::ScopedBinder<d3d11::Texture2D> tex_binder(ctx, texture);
-
-		// actually draw the quad
-		geometry_->draw();
+		auto const blend = !opaque_ || (transform_.opacity < 1.0f);
+		comp->batch_.add(texture, matrix(), flip_, blend, transform_.opacity);
 	}
 }
 
@@ -96,7 +286,13 @@ Composition::Composition(shared_ptr<d3d11::Device> const& device,
 	, height_(height)
 	, vsync_(true)
 	, device_(device)
+	, layers_(make_shared<LayerList const>())
+	, full_damage_(true)
+	, next_order_(0)
 {
+	batch_stats_ = batch_.stats();
+	hit_grid_.reset(width, height);
+
 	fps_ = 0.0;
 	time_ = 0.0;
 	frame_ = 0;
@@ -118,16 +314,38 @@ double Composition::fps() const
 	return fps_;
 }
 
+shared_ptr<LayerList const> Composition::layers() const
+{
+	return atomic_load(&layers_);
+}
+
 void Composition::add_layer(shared_ptr<Layer> const& layer)
 {
 	if (layer) 
 	{
 		lock_guard<mutex> guard(lock_);
 
-		layers_.push_back(layer);
+		// copy-on-write ... then publish the new list
+		auto const current = atomic_load(&layers_);
+		auto const next = make_shared<LayerList>(*current);
+		next->version = current->version + 1;
+		next->layers.push_back(layer);
 
 		// attach ourself as the parent
 		layer->attach(shared_from_this());
+
+		atomic_store(&layers_, shared_ptr<LayerList const>(next));
+	}
+
+	if (layer) 
+	{
+		layer->invalidate();
+
+		if (layer->want_input()) 
+		{
+			lock_guard<mutex> guard(hit_lock_);
+			hit_grid_.insert(layer, to_hit_rect(layer->extent()), next_order_++);
+		}
 	}
 }
 
@@ -137,37 +355,285 @@ bool Composition::remove_layer(std::shared_ptr<Layer> const& layer)
 	if (layer)
 	{
 		lock_guard<mutex> guard(lock_);
-		for (auto i = layers_.begin(); i != layers_.end(); )
+
+		auto const current = atomic_load(&layers_);
+		auto const next = make_shared<LayerList>();
+		next->version = current->version + 1;
+		next->layers.reserve(current->layers.size());
+		for (auto const& i : current->layers)
 		{
-			if ((*i).get() == layer.get()) {
-				i = layers_.erase(i);
+			if (i.get() == layer.get()) {
 				++match;
 			}
 			else {
-				i++;
+				next->layers.push_back(i);
 			}
 		}
+
+		// the area the layer covered needs to be redrawn
+		if (match) 
+		{
+			atomic_store(&layers_, shared_ptr<LayerList const>(next));
+			pending_damage_.push_back(layer->extent());
+		}
+	}
+
+	if (match)
+	{
+		lock_guard<mutex> guard(hit_lock_);
+		hit_grid_.remove(layer.get());
 	}
 	return (match > 0);
 }
 
+//
+// screen-space rect used for hit-testing (same truncation as 
+// mouse coordinates relative to the layer)
+//
+IntRect Composition::to_hit_rect(Rect const& bounds) const
+{
+	auto const w = width();
+	auto const h = height();
+	return IntRect{
+		static_cast<int32_t>(bounds.x * w),
+		static_cast<int32_t>(bounds.y * h),
+		static_cast<int32_t>(bounds.width * w),
+		static_cast<int32_t>(bounds.height * h) };
+}
+
+void Composition::layer_moved(Layer const* layer)
+{
+	if (layer && layer->want_input())
+	{
+		lock_guard<mutex> guard(hit_lock_);
+		hit_grid_.move(layer, to_hit_rect(layer->extent()));
+	}
+}
+
+//
+// re-index all layers (the screen size changed)
+//
+void Composition::rebuild_hit_grid()
+{
+	auto const snapshot = layers();
+
+	lock_guard<mutex> guard(hit_lock_);
+	hit_grid_.reset(width(), height());
+	for (auto const& layer : snapshot->layers)
+	{
+		if (layer->want_input()) {
+			hit_grid_.insert(layer, to_hit_rect(layer->extent()), next_order_++);
+		}
+	}
+}
+
 void Composition::resize(bool vsync, int width, int height)
 {
 	vsync_ = vsync;
+
+	auto const changed = (width != width_) || (height != height_);
 	width_ = width;
 	height_ = height;
+
+	if (changed) {
+		rebuild_hit_grid();
+	}
+
+	lock_guard<mutex> guard(lock_);
+	full_damage_ = true;
 }
 
-void Composition::tick(double t)
+namespace {
+
+	//
+	// pixels touched by a normalized rect (rounded outwards)
+	//
+	IntRect to_outer_pixels(Rect const& r, int32_t w, int32_t h)
+	{
+		auto const x0 = static_cast<int32_t>(floor(r.x * w));
+		auto const y0 = static_cast<int32_t>(floor(r.y * h));
+		auto const x1 = static_cast<int32_t>(ceil((r.x + r.width) * w));
+		auto const y1 = static_cast<int32_t>(ceil((r.y + r.height) * h));
+		return IntRect{ x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	//
+	// pixels fully written by a normalized rect ... those with centers 
+	// inside the rect, same rule as the rasterizer (and soft::Context)
+	//
+	IntRect to_covered_pixels(Rect const& r, int32_t w, int32_t h)
+	{
+		auto const x0 = static_cast<int32_t>(ceil((r.x * w) - 0.5f));
+		auto const y0 = static_cast<int32_t>(ceil((r.y * h) - 0.5f));
+		auto const x1 = static_cast<int32_t>(ceil(((r.x + r.width) * w) - 0.5f));
+		auto const y1 = static_cast<int32_t>(ceil(((r.y + r.height) * h) - 0.5f));
+		return IntRect{ x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	// beyond this a layer is just drawn in full rather than in pieces
+	size_t const max_visible_pieces = 32;
+}
+
+Region Composition::damage() const
 {
-	time_ = t;
+	return damage_;
+}
 
-	// don't hold a lock during tick()
-	decltype(layers_) layers;
+QuadBatch::Stats Composition::batch_stats() const
+{
+	return batch_stats_;
+}
+
+//
+// every layer drawn in this frame has consumed its latest frame
+//
+void Composition::record_composite(vector<shared_ptr<Layer>> const& layers)
+{
+	auto const now = static_cast<int64_t>(time_now());
+	for (size_t n = 0; n < layers.size(); ++n)
+	{
+		if (!visible_[n].empty()) {
+			layers[n]->timing()->composite(now);
+		}
+	}
+}
+
+void Composition::presented()
+{
+	auto const now = static_cast<int64_t>(time_now());
+	auto const snapshot = this->layers();
+	for (auto const& layer : snapshot->layers) {
+		layer->timing()->present(now);
+	}
+}
+
+vector<LayerTimingReport> Composition::timing_report() const
+{
+	auto const snapshot = this->layers();
+
+	vector<LayerTimingReport> reports;
+	reports.reserve(snapshot->layers.size());
+	for (auto const& layer : snapshot->layers)
+	{
+		LayerTimingReport report;
+		report.layer = layer;
+		report.name = layer->name();
+		report.timing = layer->timing()->report();
+		report.delivery = layer->delivery();
+		reports.push_back(report);
+	}
+	return reports;
+}
+
+void Composition::reset_timing()
+{
+	auto const snapshot = this->layers();
+	for (auto const& layer : snapshot->layers) {
+		layer->timing()->reset();
+	}
+}
+
+//
+// gather damage from all layers and map it to output pixels
+//
+Region Composition::collect_damage(vector<shared_ptr<Layer>> const& layers)
+{
+	auto const w = width();
+	auto const h = height();
+
+	bool full;
+	vector<Rect> rects;
 	{
 		lock_guard<mutex> guard(lock_);
-		layers.assign(layers_.begin(), layers_.end());
+		rects.swap(pending_damage_);
+		full = full_damage_;
+		full_damage_ = false;
+	}
+
+	// always drain layers so damage does not pile up
+	for (auto const& layer : layers) {
+		layer->take_damage(rects);
+	}
+
+	Region region;
+	if (full) {
+		region.add(IntRect{ 0, 0, w, h });
+	}
+	else
+	{
+		// round outwards so partially covered pixels are included
+		for (auto const& r : rects) {
+			region.add(to_outer_pixels(r, w, h));
+		}
+	}
+	region.clip(w, h);
+	return region;
+}
+
+//
+// walk layers front to back and compute the visible pieces of each
+// (in output pixels) by removing the areas covered by opaque layers above
+//
+// visible_[n] is empty if layer n is completely hidden
+//
+void Composition::cull(vector<shared_ptr<Layer>> const& layers)
+{
+	auto const w = width();
+	auto const h = height();
+	IntRect const screen{ 0, 0, w, h };
+
+	if (visible_.size() < layers.size()) {
+		visible_.resize(layers.size());
+	}
+	occluders_.clear();
+
+	vector<IntRect> remaining;
+	for (auto n = layers.size(); n-- > 0; )
+	{
+		auto& pieces = visible_[n];
+		pieces.clear();
+
+		// nothing to draw if it is off-screen, zero-sized or transparent
+		auto const bounds = layers[n]->extent();
+		auto const rect = to_outer_pixels(bounds, w, h).intersect(screen);
+		if (rect.empty() || layers[n]->transform().opacity <= 0.0f) 
+		{
+			layers[n]->set_visible(false);
+			continue;
+		}
+
+		pieces.push_back(rect);
+		for (auto const& occluder : occluders_)
+		{
+			if (pieces.empty() || pieces.size() > max_visible_pieces) {
+				break;
+			}
+			remaining.clear();
+			for (auto const& p : pieces) {
+				subtract(p, occluder, remaining);
+			}
+			pieces.swap(remaining);
+		}
+		layers[n]->set_visible(!pieces.empty());
+
+		// only visible opaque layers hide what is beneath them
+		if (!pieces.empty() && layers[n]->occludes())
+		{
+			auto const covered = to_covered_pixels(bounds, w, h).intersect(screen);
+			if (!covered.empty()) {
+				occluders_.push_back(covered);
+			}
+		}
 	}
+}
+
+void Composition::tick(double t)
+{
+	time_ = t;
+
+	// lock-free snapshot ... layers may be added/removed while we tick()
+	auto const snapshot = this->layers();
+	auto const& layers = snapshot->layers;
 
 	for (auto const& layer : layers) {
 		layer->tick(t);
@@ -176,19 +642,113 @@ void Composition::tick(double t)
 
 void Composition::render(shared_ptr<d3d11::Context> const& ctx)
 {
-	// don't hold a lock during render()
-	decltype(layers_) layers;
+	// lock-free snapshot ... layers may be added/removed while we render()
+	auto const snapshot = this->layers();
+	auto const& layers = snapshot->layers;
+
+	// the swapchain is cleared and fully redrawn every frame ... 
+	// damage is only tracked so a presenter can do partial presents
+	damage_ = collect_damage(layers);
+
+	cull(layers);
+
+	// pretty simple ... just use painter's algorithm and render 
+	// our layers in order (not doing any depth or 3D here) ... skipping 
+	// layers completely hidden under opaque layers
+	batch_.clear();
+	for (size_t n = 0; n < layers.size(); ++n) 
 	{
-		lock_guard<mutex> guard(lock_);
-		layers.assign(layers_.begin(), layers_.end());
+		if (!visible_[n].empty()) {
+			layers[n]->render(ctx);
+		}
 	}
 
-	// pretty simple ... just use painter's algorithm and render 
-	// our layers in order (not doing any depth or 3D here)
-	for (auto const& layer : layers) {
-		layer->render(ctx);
+	// layers only recorded their quads ... draw them all now
+	submit(ctx);
+	batch_stats_ = batch_.stats();
+	batch_.clear();
+
+	record_composite(layers);
+
+	capture_output(ctx);
+
+	update_fps();
+}
+
+void Composition::render(shared_ptr<soft::Context> const& ctx)
+{
+	// lock-free snapshot ... layers may be added/removed while we render()
+	auto const snapshot = this->layers();
+	auto const& layers = snapshot->layers;
+
+	damage_ = collect_damage(layers);
+
+	cull(layers);
+
+	//
+	// the target keeps its contents between frames so we only
+	// recompose damaged areas: each one is cleared (transparent) and the
+	// visible pieces of each layer within it are drawn with the same 
+	// painter's algorithm and pre-multiplied blending as the D3D11 path
+	//
+	for (auto const& r : damage_.rects())
+	{
+		ctx->set_clip(r.x, r.y, r.width, r.height);
+		ctx->clear(0.0f, 0.0f, 0.0f, 0.0f);
+
+		for (size_t n = 0; n < layers.size(); ++n)
+		{
+			for (auto const& piece : visible_[n])
+			{
+				auto const clip = piece.intersect(r);
+				if (!clip.empty())
+				{
+					ctx->set_clip(clip.x, clip.y, clip.width, clip.height);
+					layers[n]->render(ctx);
+				}
+			}
+		}
+	}
+	ctx->reset_clip();
+
+	record_composite(layers);
+
+	capture_output(ctx);
+
+	update_fps();
+}
+
+void Composition::set_capture(shared_ptr<CapturePipeline> const& capture) {
+	atomic_store(&capture_, capture);
+}
+
+shared_ptr<CapturePipeline> Composition::capture() const {
+	return atomic_load(&capture_);
+}
+
+void Composition::capture_output(shared_ptr<soft::Context> const& ctx)
+{
+	auto const capture = atomic_load(&capture_);
+	if (!capture || !capture->due()) {
+		return;
 	}
 
+	//
+	// soft surfaces hold RGBA (clear() puts red first and image layers
+	// upload RGBA) ... web layers never render through this backend
+	//
+	auto const target = ctx->target();
+	if (!target)
+	{
+		capture->drop();
+		return;
+	}
+	capture->submit(target->data(), target->stride(), 
+		target->width(), target->height(), false);
+}
+
+void Composition::update_fps()
+{
 	frame_++;
 	auto const now = time_now();
 	if ((now - fps_start_) > 1000000)
@@ -203,7 +763,10 @@ void Composition::render(shared_ptr<d3d11::Context> const& ctx)
 void Composition::mouse_click(MouseButton button, bool up, int32_t x, int32_t y)
 {
 	// forward to layer - making x, y relative to layer
+	auto const sx = x;
+	auto const sy = y;
 	auto const layer = layer_from_point(x, y);
+	hover(layer, sx, sy);
 	if (layer) {
 		layer->mouse_click(button, up, x, y);
 	}
@@ -211,55 +774,165 @@ void Composition::mouse_click(MouseButton button, bool up, int32_t x, int32_t y)
 
 void Composition::mouse_move(bool leave, int32_t x, int32_t y)
 {
+	// the mouse left the composition
+	if (leave) 
+	{
+		hover(nullptr, x, y);
+		return;
+	}
+
 	// forward to layer - making x, y relative to layer
+	auto const sx = x;
+	auto const sy = y;
 	auto const layer = layer_from_point(x, y);
+	hover(layer, sx, sy);
 	if (layer) {
-		layer->mouse_move(leave, x, y);
+		layer->mouse_move(false, x, y);
 	}
 }
 
-shared_ptr<Layer> Composition::layer_from_point(int32_t& x, int32_t& y)
+//
+// layers only see the mouse while it is over them ... moving onto 
+// another layer (or off the composition) leaves the last one at the
+// point (relative to it) where the mouse is now
+//
+void Composition::hover(shared_ptr<Layer> const& layer, int32_t x, int32_t y)
 {
-	auto const w = width();
-	auto const h = height();
+	auto const last = hover_.lock();
+	if (last == layer) {
+		return;
+	}
+	hover_ = layer;
 
-	// get thread-safe copy
-	decltype(layers_) layers;
+	if (last)
 	{
-		lock_guard<mutex> guard(lock_);
-		layers.assign(layers_.begin(), layers_.end());
+		auto const rect = to_hit_rect(last->extent());
+		last->mouse_move(true, x - rect.x, y - rect.y);
 	}
+}
 
+shared_ptr<Layer> Composition::layer_from_point(int32_t& x, int32_t& y)
+{
 	//
-	// walk layers from front to back and find one 
-	// that contains the mouse point (and wants input)
+	// the grid only holds layers that want input and returns 
+	// the front-most one that contains the mouse point
 	//
-	for (auto i = layers.rbegin(); i != layers.rend(); i++)
+	IntRect rect;
+	shared_ptr<Layer> layer;
+	{
+		lock_guard<mutex> guard(hit_lock_);
+		layer = hit_grid_.find(x, y, rect);
+	}
+
+	if (layer)
+	{
+		// convert points to relative
+		x = x - rect.x;
+		y = y - rect.y;
+	}
+	return layer;
+}
+
+#if defined(_WIN32)
+
+//
+// draw the recorded quads from a single dynamic vertex buffer ... 
+// the shader is bound once and only texture/blend changes are made 
+// between draws (as recorded by the batch)
+//
+void Composition::submit(shared_ptr<d3d11::Context> const& ctx)
+{
+	auto const& vertices = batch_.vertices();
+	if (vertices.empty() || !device_ || !ctx) {
+		return;
+	}
+
+	auto const count = static_cast<uint32_t>(vertices.size());
+	if (!batch_geometry_ || batch_geometry_->capacity() < count)
+	{
+		// grow geometrically so this is rare
+		uint32_t capacity = QuadBatch::vertices_per_quad * 16;
+		while (capacity < count) {
+			capacity *= 2;
+		}
+		batch_geometry_ = device_->create_dynamic_geometry(
+				capacity, static_cast<uint32_t>(sizeof(QuadBatch::Vertex)));
+	}
+
+	// we need a shader
+	if (!effect_) {
+		effect_ = device_->create_default_effect();
+	}
+
+	if (!batch_geometry_ || !effect_) {
+		return;
+	}
+
+	d3d11::ScopedBinder<d3d11::Geometry> quad_binder(ctx, batch_geometry_);
+	d3d11::ScopedBinder<d3d11::Effect> fx_binder(ctx, effect_);
+
+	if (!batch_geometry_->update(vertices.data(), count)) {
+		return;
+	}
+
+	bool blending = true;
+	d3d11::Texture2D* bound = nullptr;
+	for (auto const& cmd : batch_.commands())
 	{
-		auto const l = (*i);
-		if (l->want_input())
+		if (cmd.texture.get() != bound) 
 		{
-			auto bounds = l->bounds();
-
-			// convert to screen space
-			auto const sx = static_cast<int32_t>(bounds.x * w);
-			auto const sw = static_cast<int32_t>(bounds.width * w);
-			auto const sy = static_cast<int32_t>(bounds.y * h);
-			auto const sh = static_cast<int32_t>(bounds.height * h);
-			if (x >= sx && x < (sx + sw))
+			cmd.texture->bind(ctx);
+			bound = cmd.texture.get();
+		}
+
+		// opaque layers are drawn without blending
+		if (cmd.blend != blending)
+		{
+			if (!opaque_blend_) {
+				opaque_blend_ = device_->create_blend_state(false);
+			}
+			if (opaque_blend_)
 			{
-				if (y >= sy && y < (sy + sh)) 
-				{
-					// convert points to relative
-					x = x - sx;
-					y = y - sy;
-					return l;
+				if (cmd.blend) {
+					opaque_blend_->unbind();
+				}
+				else {
+					opaque_blend_->bind(ctx);
 				}
 			}
+			blending = cmd.blend;
 		}
+
+		batch_geometry_->draw(cmd.first, cmd.count);
 	}
 
-	return nullptr;
+	if (!blending && opaque_blend_) {
+		opaque_blend_->unbind();
+	}
+}
+
+//
+// hand over the oldest readback the GPU is done with ... then start a
+// new one if a snapshot is due (dropped if all readbacks are in flight)
+//
+void Composition::capture_output(shared_ptr<d3d11::Context> const& ctx)
+{
+	auto const capture = atomic_load(&capture_);
+	if (!capture || !device_ || !ctx) {
+		return;
+	}
+
+	if (!readback_) {
+		readback_ = device_->create_readback();
+	}
+
+	readback_->read(ctx, [&](const uint8_t* pixels, uint32_t stride, uint32_t width, uint32_t height) {
+		capture->submit(pixels, stride, width, height, false);
+	});
+
+	if (capture->due() && !readback_->copy(ctx)) {
+		capture->drop();
+	}
 }
 
 int to_int(CefRefPtr<CefDictionaryValue> const& dict, string const& key, int default_value)
@@ -292,6 +965,71 @@ float to_float(CefRefPtr<CefDictionaryValue> const& dict, string const& key, flo
 	return default_value;
 }
 
+//
+// read a transform from a dictionary ... missing values are 
+// taken from the given defaults
+//
+Transform to_transform(
+		CefRefPtr<CefDictionaryValue> const& dict, Transform const& defaults)
+{
+	Transform t;
+	t.x = to_float(dict, "x", defaults.x);
+	t.y = to_float(dict, "y", defaults.y);
+	t.scale_x = to_float(dict, "scale_x", to_float(dict, "scale", defaults.scale_x));
+	t.scale_y = to_float(dict, "scale_y", to_float(dict, "scale", defaults.scale_y));
+	t.rotation = to_float(dict, "rotation", defaults.rotation);
+	t.opacity = to_float(dict, "opacity", defaults.opacity);
+	return t;
+}
+
+//
+// an animation is given as:
+//
+//   { "loop": true, "keyframes": [ { "time": 0.0, "x": 0.1, "easing": "ease-in-out" }, ... ] }
+//
+// each keyframe starts from the values of the previous one
+//
+shared_ptr<Animation const> to_animation(CefRefPtr<CefDictionaryValue> const& dict)
+{
+	if (!dict || dict->GetType("keyframes") != VTYPE_LIST) {
+		return nullptr;
+	}
+
+	auto const loop = dict->GetType("loop") == VTYPE_BOOL && dict->GetBool("loop");
+	auto const animation = make_shared<Animation>(loop);
+
+	auto value = identity_transform();
+	auto const keyframes = dict->GetList("keyframes");
+	for (size_t n = 0; n < keyframes->GetSize(); ++n)
+	{
+		if (keyframes->GetType(n) != VTYPE_DICTIONARY) {
+			continue;
+		}
+
+		auto const key = keyframes->GetDictionary(n);
+		value = to_transform(key, value);
+
+		auto easing = Animation::Easing::Linear;
+		if (key->GetType("easing") == VTYPE_STRING)
+		{
+			auto const name = key->GetString("easing").ToString();
+			if (name == "ease-in-out") {
+				easing = Animation::Easing::EaseInOut;
+			}
+			else if (name == "step") {
+				easing = Animation::Easing::Step;
+			}
+		}
+
+		animation->add_keyframe(to_float(key, "time", 0.0f), value, easing);
+	}
+
+	if (animation->empty()) {
+		return nullptr;
+	}
+	return animation;
+}
+
 //
 // create a composition layer from the given dictionary
 //
@@ -325,13 +1063,90 @@ shared_ptr<Layer> to_layer(
 		auto const want_input = dict->GetBool("want_input");
 		auto const view_source = dict->GetBool("view_source");
 
+		// "delivery": "latest" (default), "queue" (with "queue_depth") or "hold"
+		auto delivery = latest_delivery();
+		if (dict->GetType("delivery") == VTYPE_STRING)
+		{
+			auto const name = dict->GetString("delivery").ToString();
+			auto const depth = static_cast<uint32_t>(max(1, to_int(dict, "queue_depth", 3)));
+			if (!to_delivery(name, depth, delivery)) {
+				log_message("unknown delivery: %s\n", name.c_str());
+			}
+		}
+
+		// how long to wait for a keyed shared texture before drawing the last frame
+		delivery.sync_timeout_ms = static_cast<uint32_t>(max(0,
+			to_int(dict, "sync_timeout_ms", static_cast<int>(default_sync_timeout_ms))));
+
+		// "frame_rate": BeginFrames per second (0 = every tick) ... the browser 
+		// isn't asked again until it painted or "begin_frame_timeout_ms" passed
+		delivery.frame_rate = max(0.0f, to_float(dict, "frame_rate", 0.0f));
+		delivery.begin_frame_timeout_ms = static_cast<uint32_t>(max(1, to_int(
+			dict, "begin_frame_timeout_ms", static_cast<int>(default_begin_frame_timeout_ms))));
+
 		return create_web_layer(
-			device, src, width, height, want_input, view_source);
+			device, src, width, height, want_input, view_source, delivery);
 	}
 
 	return nullptr;
 }
 
+//
+// capture options are given as:
+//
+//   { "format": "png", "every": 60, "queue": 4, "workers": 2, "drop": "newest",
+//     "path": "capture/frame", "command": "ffmpeg -i - out.mp4", "fps": 60 }
+//
+// ("command" only applies to the y4m format)
+//
+shared_ptr<CapturePipeline> to_capture(CefRefPtr<CefDictionaryValue> const& dict)
+{
+	auto options = default_capture_options();
+	if (dict->GetType("format") == VTYPE_STRING)
+	{
+		auto const name = dict->GetString("format").ToString();
+		if (!to_capture_format(name, options.format)) {
+			log_message("unknown capture format: %s\n", name.c_str());
+		}
+	}
+	if (dict->GetType("drop") == VTYPE_STRING)
+	{
+		auto const name = dict->GetString("drop").ToString();
+		if (!to_capture_drop(name, options.drop)) {
+			log_message("unknown capture drop: %s\n", name.c_str());
+		}
+	}
+	if (dict->GetType("path") == VTYPE_STRING) {
+		options.path = dict->GetString("path").ToString();
+	}
+	if (dict->GetType("command") == VTYPE_STRING) {
+		options.command = dict->GetString("command").ToString();
+	}
+	options.every = static_cast<uint32_t>(max(1, to_int(dict, "every", static_cast<int>(options.every))));
+	options.depth = static_cast<uint32_t>(max(1, to_int(dict, "queue", static_cast<int>(options.depth))));
+	options.workers = static_cast<uint32_t>(max(1, to_int(dict, "workers", static_cast<int>(options.workers))));
+	options.fps = static_cast<uint32_t>(max(1, to_int(dict, "fps", static_cast<int>(options.fps))));
+	return create_capture(options);
+}
+
+//
+// view_source dumps are given as:
+//
+//   { "queue": 8, "max_bytes": 16777216, "compress": true }
+//
+// (max_bytes 0 writes sources of any size)
+//
+SourceDumpOptions to_source_dump(CefRefPtr<CefDictionaryValue> const& dict)
+{
+	auto options = default_source_dump_options();
+	options.depth = static_cast<uint32_t>(max(1, to_int(dict, "queue", static_cast<int>(options.depth))));
+	options.max_bytes = static_cast<uint64_t>(max(0, to_int(dict, "max_bytes", static_cast<int>(options.max_bytes))));
+	if (dict->GetType("compress") == VTYPE_BOOL) {
+		options.compress = dict->GetBool("compress");
+	}
+	return options;
+}
+
 shared_ptr<Composition> create_composition(
 	shared_ptr<d3d11::Device> const& device,
 	string const& json)
@@ -370,7 +1185,18 @@ shared_ptr<Composition> create_composition(
 						if (!layer) {
 							continue;
 						}
+
+						// name the layer for timing reports (default is the src)
+						auto const name_key = 
+							(obj->GetType("name") == VTYPE_STRING) ? "name" : "src";
+						layer->set_name(obj->GetString(name_key).ToString());
 						
+						// layers can declare themselves opaque so the
+						// composition can skip what is hidden beneath them
+						if (obj->GetType("opaque") == VTYPE_BOOL && obj->GetBool("opaque")) {
+							layer->set_opaque(true);
+						}
+
 						// add the layer to the composition
 						composition->add_layer(layer);
 
@@ -381,11 +1207,59 @@ shared_ptr<Composition> create_composition(
 						auto const h = to_float(obj, "height", 1.0f);
 
 						layer->move(x, y, w, h);
+
+						// optional transform and/or animation of the transform
+						if (obj->GetType("transform") == VTYPE_DICTIONARY) 
+						{
+							layer->set_transform(to_transform(
+								obj->GetDictionary("transform"), identity_transform()));
+						}
+						if (obj->GetType("animation") == VTYPE_DICTIONARY) 
+						{
+							auto const animation = to_animation(obj->GetDictionary("animation"));
+							if (animation) {
+								layer->animate(animation);
+							}
+						}
 					}
 				}
 			}		
 		}	
 	}
+
+	// "browser_pool": browsers kept warm so later web layers (popups, 
+	// another window) don't wait for one to start ... started after our
+	// own layers, which could not have used them yet.  The pool is shared
+	// by every composition ... one without the key leaves it as it is
+	if (dict->HasKey("browser_pool")) {
+		set_browser_pool(device, max(0, to_int(dict, "browser_pool", 0)), width, height);
+	}
+
+	// page sources (view_source) are written in the background
+	if (dict->GetType("source_dump") == VTYPE_DICTIONARY) {
+		set_source_dump(to_source_dump(dict->GetDictionary("source_dump")));
+	}
+
+	// optionally archive what was shown
+	if (dict->GetType("capture") == VTYPE_DICTIONARY) {
+		composition->set_capture(to_capture(dict->GetDictionary("capture")));
+	}
 	
 	return composition;
-}
\ No newline at end of file
+}
+
+#else
+
+//
+// no D3D11 without Windows ... the batch is still recorded so 
+// draw-call counts can be checked headless
+//
+void Composition::submit(shared_ptr<d3d11::Context> const&)
+{
+}
+
+void Composition::capture_output(shared_ptr<d3d11::Context> const&)
+{
+}
+
+#endif
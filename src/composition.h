@@ -1,6 +1,32 @@
 #pragma once
 
+#if defined(_WIN32)
 #include "d3d11.h"
+#else
+namespace d3d11 {
+	class Device;
+	class Context;
+	class Texture2D;
+	class Geometry;
+	class Effect;
+	class BlendState;
+	class Readback;
+}
+#endif
+
+#include "soft.h"
+#include "region.h"
+#include "hit_grid.h"
+#include "batch.h"
+#include "transform.h"
+#include "timing.h"
+#include "delivery.h"
+#include "capture.h"
+#include "source_dump.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
 #include <vector>
 #include <mutex>
 
@@ -30,6 +56,8 @@ enum class MouseButton
 //
 class Layer
 {
+	friend class Composition;
+
 public:
 	Layer(std::shared_ptr<d3d11::Device> const& device, bool want_input, bool flip);
 	~Layer();
@@ -40,11 +68,59 @@ public:
 	
 	virtual void tick(double);
 	virtual void render(std::shared_ptr<d3d11::Context> const&) = 0;
+	virtual void render(std::shared_ptr<soft::Context> const&);
 	
 	virtual void mouse_click(MouseButton button, bool up, int32_t x, int32_t y);
 	virtual void mouse_move(bool leave, int32_t x, int32_t y);
 
+	// mark the whole layer (or a rect in normalized layer units) as changed
+	void invalidate();
+	void invalidate(Rect const& rect);
+
+	// append damage since the last call in normalized composition units
+	virtual void take_damage(std::vector<Rect>& damage);
+
+	//
+	// an opaque layer covers everything beneath it ... the composition
+	// will cull what it hides and draw it without blending
+	//
+	bool opaque() const;
+	void set_opaque(bool opaque);
+
+	// opaque, fully visible and axis-aligned ... hides its extent()
+	bool occludes() const;
+
+	//
+	// was any of the layer drawn in the last composed frame? ... false
+	// when it is covered by opaque layers, off-screen, zero-sized or
+	// fully transparent (true until the composition has culled it)
+	//
+	bool visible() const;
+
+	//
+	// position, scale, rotation and opacity applied on top of the 
+	// bounds ... cheap to change every frame (nothing is reallocated)
+	//
+	Transform transform() const;
+	void set_transform(Transform const& transform);
+
+	// run a keyframe animation of the transform (starting on the next tick)
+	void animate(std::shared_ptr<Animation const> const& animation);
+
 	Rect bounds() const;
+
+	// a name to identify the layer in reports (e.g. its url)
+	std::string name() const;
+	void set_name(std::string const& name);
+
+	// frame latency and jitter for this layer
+	std::shared_ptr<LayerTiming> const& timing() const;
+
+	// how frames from the source reach this layer (if it has one)
+	virtual DeliveryStats delivery() const;
+
+	// the area covered on-screen with the transform applied
+	Rect extent() const;
 	
 	std::shared_ptr<Composition> composition() const;
 
@@ -56,24 +132,67 @@ protected:
 			std::shared_ptr<d3d11::Context> const& ctx, 
 			std::shared_ptr<d3d11::Texture2D> const& texture);
 
+	void render_surface(
+			std::shared_ptr<soft::Context> const& ctx,
+			std::shared_ptr<soft::Surface> const& surface);
+
+	// maps the unit quad to this layer in composition units
+	Affine matrix() const;
+
 	bool flip_;
 	Rect bounds_;
 	bool want_input_;
+	bool opaque_;
 
-	std::shared_ptr<d3d11::Geometry> geometry_;
-	std::shared_ptr<d3d11::Effect> effect_;
 	std::shared_ptr<d3d11::Device> const device_;
 
 private:	
+	float aspect() const;
+
+	// set by the composition as it culls
+	void set_visible(bool visible);
+
 	std::weak_ptr<Composition> composition_;
+	std::string name_;
+	std::shared_ptr<LayerTiming> const timing_;
+	Transform transform_;
+	std::shared_ptr<Animation const> animation_;
+	double animation_start_;
+	std::atomic<bool> visible_;
+	std::mutex damage_lock_;
+	std::vector<Rect> damage_;
+};
+
+//
+// an immutable snapshot of the layers in a composition (back to front)
+//
+// a composition never modifies a published list ... add_layer and 
+// remove_layer publish a new one with a higher version, so readers can
+// hold on to a snapshot without any locking
+//
+struct LayerList
+{
+	uint64_t version;
+	std::vector<std::shared_ptr<Layer>> layers;
+};
+
+struct LayerTimingReport
+{
+	std::shared_ptr<Layer> layer;
+	std::string name;
+	LayerTiming::Report timing;
+	DeliveryStats delivery;
 };
 
 //
 // A collection of layers. 
 // A composition will render 1-N layers to a D3D11 device
+// (or to a CPU surface using the soft:: backend)
 //
 class Composition : public std::enable_shared_from_this<Composition>
 {
+	friend class Layer;
+
 public:
 	Composition(std::shared_ptr<d3d11::Device> const& device, 
 			int width, int height);
@@ -88,12 +207,41 @@ public:
 
 	void tick(double);
 	void render(std::shared_ptr<d3d11::Context> const&);
+	void render(std::shared_ptr<soft::Context> const&);
 	
 	void add_layer(std::shared_ptr<Layer> const& layer);
 	bool remove_layer(std::shared_ptr<Layer> const& layer);
 
+	// the current layers (a single atomic load)
+	std::shared_ptr<LayerList const> layers() const;
+
 	void resize(bool vsync, int width, int height);
 
+	//
+	// the area of the output (in pixels) that changed in the
+	// last call to render() ... a presenter can use this for partial
+	// presents.  The software backend only redraws these areas.
+	//
+	Region damage() const;
+
+	// draw calls and state changes submitted by the last D3D11 render()
+	QuadBatch::Stats batch_stats() const;
+
+	// call once the output of the last render() has been presented
+	void presented();
+
+	//
+	// snapshot the composed output into a capture pipeline every few
+	// frames (nullptr to stop) ... D3D11 frames are read back a few
+	// frames later so render() never waits on the GPU
+	//
+	void set_capture(std::shared_ptr<CapturePipeline> const& capture);
+	std::shared_ptr<CapturePipeline> capture() const;
+
+	// frame timing and delivery for every layer (back to front)
+	std::vector<LayerTimingReport> timing_report() const;
+	void reset_timing();
+
 	void mouse_click(MouseButton button, bool up, int32_t x, int32_t y);
 	void mouse_move(bool leave, int32_t x, int32_t y);
 
@@ -101,6 +249,28 @@ private:
 
 	std::shared_ptr<Layer> layer_from_point(int32_t& x, int32_t& y);
 
+	// the mouse is over layer now ... the last one is told it was left
+	void hover(std::shared_ptr<Layer> const& layer, int32_t x, int32_t y);
+
+	// called by Layer::move to keep the hit-test grid current
+	void layer_moved(Layer const* layer);
+
+	IntRect to_hit_rect(Rect const& bounds) const;
+	void rebuild_hit_grid();
+
+	void update_fps();
+
+	Region collect_damage(std::vector<std::shared_ptr<Layer>> const& layers);
+
+	void cull(std::vector<std::shared_ptr<Layer>> const& layers);
+
+	void submit(std::shared_ptr<d3d11::Context> const& ctx);
+
+	void record_composite(std::vector<std::shared_ptr<Layer>> const& layers);
+
+	void capture_output(std::shared_ptr<d3d11::Context> const& ctx);
+	void capture_output(std::shared_ptr<soft::Context> const& ctx);
+
 	int width_;
 	int height_;
 	uint32_t frame_;
@@ -109,11 +279,38 @@ private:
 	double time_;
 	bool vsync_;
 	std::shared_ptr<d3d11::Device> const device_;
-	std::vector<std::shared_ptr<Layer>> layers_;
+	std::shared_ptr<LayerList const> layers_;
+	std::vector<Rect> pending_damage_;
+	bool full_damage_;
+	Region damage_;
+	std::vector<std::vector<IntRect>> visible_;
+	std::vector<IntRect> occluders_;
+
+	// all layer quads for a D3D11 frame
+	QuadBatch batch_;
+	QuadBatch::Stats batch_stats_;
+	std::shared_ptr<d3d11::Geometry> batch_geometry_;
+	std::shared_ptr<d3d11::Effect> effect_;
+	std::shared_ptr<d3d11::BlendState> opaque_blend_;
+
+	std::shared_ptr<CapturePipeline> capture_;
+	std::shared_ptr<d3d11::Readback> readback_;
+
+	// serializes writers (and pending damage) ... readers never take it
 	std::mutex lock_;
+
+	// layers that want input, indexed by screen rect
+	HitGrid hit_grid_;
+	uint64_t next_order_;
+	std::mutex hit_lock_;
+
+	// the layer the mouse was last over (input thread)
+	std::weak_ptr<Layer> hover_;
 };
 
+#if defined(_WIN32)
 int cef_initialize(HINSTANCE);
+#endif
 void cef_uninitialize();
 std::string cef_version();
 
@@ -134,4 +331,15 @@ std::shared_ptr<Layer> create_web_layer(
 			int width,
 			int height,
 			bool want_input,
-			bool view_source);
\ No newline at end of file
+			bool view_source,
+			DeliveryPolicy const& delivery);
+
+// keep size browsers loaded (about:blank) for new web layers to claim ... 0 closes them
+void set_browser_pool(
+			std::shared_ptr<d3d11::Device> const& device,
+			int size,
+			int width,
+			int height);
+
+// how view_source page dumps are written (a new background writer unless the settings are the same)
+void set_source_dump(SourceDumpOptions const& options);
\ No newline at end of file
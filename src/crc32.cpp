@@ -0,0 +1,26 @@
+#include "crc32.h"
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static struct Table
+	{
+		Table()
+		{
+			for (uint32_t n = 0; n < 256; ++n)
+			{
+				auto c = n;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+				}
+				values[n] = c;
+			}
+		}
+		uint32_t values[256];
+	} const table;
+
+	crc = ~crc;
+	for (size_t n = 0; n < size; ++n) {
+		crc = table.values[(crc ^ data[n]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (PNG, gzip) of data continuing from crc (0 to start)
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size);
@@ -4,6 +4,8 @@
 #include <d3dcompiler.h>
 #include <directxmath.h>
 
+#include <algorithm>
+
 using namespace std;
 
 namespace d3d11 {
@@ -12,6 +14,7 @@ namespace d3d11 {
 	{
 		DirectX::XMFLOAT3 pos;
 		DirectX::XMFLOAT2 tex;
+		float alpha;
 	};
 
 	Context::Context(ID3D11DeviceContext* ctx)
@@ -137,6 +140,38 @@ namespace d3d11 {
 	}
 
 
+	BlendState::BlendState(ID3D11BlendState* state)
+		: state_(to_com_ptr(state))
+		, previous_mask_(0xffffffff)
+	{
+		previous_factor_[0] = previous_factor_[1] = 0.0f;
+		previous_factor_[2] = previous_factor_[3] = 0.0f;
+	}
+
+	void BlendState::bind(shared_ptr<Context> const& ctx)
+	{
+		ctx_ = ctx;
+		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx_);
+
+		ID3D11BlendState* previous = nullptr;
+		d3d11_ctx->OMGetBlendState(&previous, previous_factor_, &previous_mask_);
+		previous_ = to_com_ptr(previous);
+
+		float factor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		d3d11_ctx->OMSetBlendState(state_.get(), factor, 0xffffffff);
+	}
+
+	void BlendState::unbind()
+	{
+		if (ctx_)
+		{
+			ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx_);
+			d3d11_ctx->OMSetBlendState(previous_.get(), previous_factor_, previous_mask_);
+		}
+		previous_.reset();
+		ctx_.reset();
+	}
+
 	Effect::Effect(
 		ID3D11VertexShader* vsh,
 		ID3D11PixelShader* psh,
@@ -199,6 +234,33 @@ namespace d3d11 {
 		d3d11_ctx->Draw(vertices_, 0);
 	}
 
+	void Geometry::draw(uint32_t first, uint32_t count)
+	{
+		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx_);
+		assert(d3d11_ctx);
+
+		d3d11_ctx->Draw(count, first);
+	}
+
+	bool Geometry::update(const void* vertices, uint32_t count)
+	{
+		if (!vertices || count > vertices_) {
+			return false;
+		}
+
+		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx_);
+		assert(d3d11_ctx);
+
+		D3D11_MAPPED_SUBRESOURCE res;
+		auto const hr = d3d11_ctx->Map(buffer_.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+		if (FAILED(hr)) {
+			return false;
+		}
+		memcpy(res.pData, vertices, count * stride_);
+		d3d11_ctx->Unmap(buffer_.get(), 0);
+		return true;
+	}
+
 	
 	Texture2D::Texture2D(
 		ID3D11Texture2D* tex,
@@ -252,8 +314,9 @@ namespace d3d11 {
 	bool Texture2D::lock_key(uint64_t key, uint32_t timeout_ms)
 	{
 		if (keyed_mutex_) {
+			// WAIT_TIMEOUT and WAIT_ABANDONED are success codes
 			auto const hr = keyed_mutex_->AcquireSync(key, timeout_ms);
-			return SUCCEEDED(hr);
+			return (hr == S_OK);
 		}
 		return true;
 	}
@@ -295,6 +358,21 @@ namespace d3d11 {
 	}
 
 	void Texture2D::copy_from(const void* buffer, uint32_t stride, uint32_t rows)
+	{
+		if (rows != height()) {
+			return;
+		}
+
+		Region all;
+		all.add(IntRect{ 0, 0, static_cast<int32_t>(width()), static_cast<int32_t>(rows) });
+		copy_from(buffer, stride, all);
+	}
+
+	//
+	// textures are created with DEFAULT usage so we can update parts of
+	// them ... a Map with WRITE_DISCARD would force a full upload
+	//
+	void Texture2D::copy_from(const void* buffer, uint32_t stride, Region const& region)
 	{
 		if (!buffer) {
 			return;
@@ -303,29 +381,26 @@ namespace d3d11 {
 		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx_);
 		assert(d3d11_ctx);
 
-		D3D11_MAPPED_SUBRESOURCE res;
-		auto const hr = d3d11_ctx->Map(texture_.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
-		if (SUCCEEDED(hr))
+		IntRect const bounds{ 0, 0, 
+			static_cast<int32_t>(width()), static_cast<int32_t>(height()) };
+
+		for (auto const& rect : region.rects())
 		{
-			if (rows == height())
-			{
-				if (res.RowPitch == stride) {
-					memcpy(res.pData, buffer, stride * rows);
-				}
-				else {
-					const uint8_t* src = (const uint8_t*)buffer;
-					uint8_t* dst = (uint8_t*)res.pData;
-					uint32_t cb = res.RowPitch < stride ? res.RowPitch : stride;
-					for (uint32_t y = 0; y < rows; ++y)
-					{
-						memcpy(dst, src, cb);
-						src += stride;
-						dst += res.RowPitch;					
-					}
-				}
+			auto const r = rect.intersect(bounds);
+			if (r.empty()) {
+				continue;
 			}
 
-			d3d11_ctx->Unmap(texture_.get(), 0);	
+			D3D11_BOX box;
+			box.left = r.x;
+			box.top = r.y;
+			box.front = 0;
+			box.right = r.x + r.width;
+			box.bottom = r.y + r.height;
+			box.back = 1;
+
+			auto const src = (const uint8_t*)buffer + (r.y * stride) + (r.x * 4);
+			d3d11_ctx->UpdateSubresource(texture_.get(), 0, &box, src, stride, 0);
 		}
 	}
 
@@ -334,6 +409,19 @@ namespace d3d11 {
 		, ctx_(make_shared<Context>(pctx))
 	{
 		_lib_compiler = LoadLibrary(L"d3dcompiler_47.dll");
+
+		// a couple of 4K frames worth of upload textures
+		texture_pool_ = make_shared<TexturePool>(this, 64 * 1024 * 1024);
+	}
+
+	shared_ptr<TexturePool> Device::texture_pool()
+	{
+		return texture_pool_;
+	}
+
+	shared_ptr<Readback> Device::create_readback()
+	{
+		return make_shared<Readback>(device_.get());
 	}
 
 	string Device::adapter_name() const
@@ -537,10 +625,10 @@ namespace d3d11 {
 
 		SimpleVertex vertices[] = {
 
-			{ DirectX::XMFLOAT3(x, y, z), DirectX::XMFLOAT2(0.0f, 0.0f) },
-			{ DirectX::XMFLOAT3(x + width, y, z), DirectX::XMFLOAT2(1.0f, 0.0f) },
-			{ DirectX::XMFLOAT3(x, y - height, z), DirectX::XMFLOAT2(0.0f, 1.0f) },
-			{ DirectX::XMFLOAT3(x + width, y - height, z), DirectX::XMFLOAT2(1.0f, 1.0f) }
+			{ DirectX::XMFLOAT3(x, y, z), DirectX::XMFLOAT2(0.0f, 0.0f), 1.0f },
+			{ DirectX::XMFLOAT3(x + width, y, z), DirectX::XMFLOAT2(1.0f, 0.0f), 1.0f },
+			{ DirectX::XMFLOAT3(x, y - height, z), DirectX::XMFLOAT2(0.0f, 1.0f), 1.0f },
+			{ DirectX::XMFLOAT3(x + width, y - height, z), DirectX::XMFLOAT2(1.0f, 1.0f), 1.0f }
 		};
 
 		if (flip) 
@@ -573,6 +661,249 @@ namespace d3d11 {
 		return nullptr;
 	}
 
+	shared_ptr<Geometry> Device::create_dynamic_geometry(
+			uint32_t max_vertices, uint32_t stride)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = max_vertices * stride;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		ID3D11Buffer* buffer = nullptr;
+		auto const hr = device_->CreateBuffer(&desc, nullptr, &buffer);
+		if (SUCCEEDED(hr)) {
+			return make_shared<Geometry>(
+				D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, max_vertices, stride, buffer);
+		}
+
+		return nullptr;
+	}
+
+	Readback::Readback(ID3D11Device* device)
+		: device_(to_com_ptr(device))
+		, next_copy_(0)
+		, next_read_(0)
+	{
+		// the reference released by device_ (the Device keeps its own)
+		if (device) {
+			device->AddRef();
+		}
+		for (auto& p : pending_) {
+			p = false;
+		}
+	}
+
+	bool Readback::copy(shared_ptr<Context> const& ctx)
+	{
+		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx);
+		if (!d3d11_ctx || pending_[next_copy_]) {
+			return false;
+		}
+
+		ID3D11RenderTargetView* rtv = nullptr;
+		d3d11_ctx->OMGetRenderTargets(1, &rtv, nullptr);
+		if (!rtv) {
+			return false;
+		}
+
+		ID3D11Resource* res = nullptr;
+		rtv->GetResource(&res);
+		rtv->Release();
+
+		ID3D11Texture2D* target = nullptr;
+		if (res)
+		{
+			res->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&target);
+			res->Release();
+		}
+		if (!target) {
+			return false;
+		}
+
+		D3D11_TEXTURE2D_DESC desc;
+		target->GetDesc(&desc);
+
+		// (re)create the staging texture for this slot to match the target
+		auto& staging = staging_[next_copy_];
+		if (staging)
+		{
+			D3D11_TEXTURE2D_DESC current;
+			staging->GetDesc(&current);
+			if (current.Width != desc.Width || 
+				current.Height != desc.Height || 
+				current.Format != desc.Format) {
+				staging.reset();
+			}
+		}
+
+		if (!staging)
+		{
+			D3D11_TEXTURE2D_DESC sd = {};
+			sd.Width = desc.Width;
+			sd.Height = desc.Height;
+			sd.MipLevels = 1;
+			sd.ArraySize = 1;
+			sd.Format = desc.Format;
+			sd.SampleDesc.Count = 1;
+			sd.Usage = D3D11_USAGE_STAGING;
+			sd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+			ID3D11Texture2D* tex = nullptr;
+			if (FAILED(device_->CreateTexture2D(&sd, nullptr, &tex)))
+			{
+				target->Release();
+				return false;
+			}
+			staging = to_com_ptr(tex);
+		}
+
+		d3d11_ctx->CopyResource(staging.get(), target);
+		target->Release();
+
+		pending_[next_copy_] = true;
+		next_copy_ = (next_copy_ + 1) % slots;
+		return true;
+	}
+
+	bool Readback::read(shared_ptr<Context> const& ctx, Reader const& reader)
+	{
+		ID3D11DeviceContext* d3d11_ctx = (ID3D11DeviceContext*)(*ctx);
+		if (!d3d11_ctx || !pending_[next_read_]) {
+			return false;
+		}
+
+		auto const staging = staging_[next_read_];
+
+		// DXGI_ERROR_WAS_STILL_DRAWING ... try again next frame
+		D3D11_MAPPED_SUBRESOURCE res;
+		auto const hr = d3d11_ctx->Map(
+			staging.get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &res);
+		if (FAILED(hr)) {
+			return false;
+		}
+
+		D3D11_TEXTURE2D_DESC desc;
+		staging->GetDesc(&desc);
+		reader(static_cast<const uint8_t*>(res.pData), res.RowPitch, desc.Width, desc.Height);
+		d3d11_ctx->Unmap(staging.get(), 0);
+
+		pending_[next_read_] = false;
+		next_read_ = (next_read_ + 1) % slots;
+		return true;
+	}
+
+	namespace {
+
+		size_t bytes_per_pixel(DXGI_FORMAT format)
+		{
+			switch (format)
+			{
+				case DXGI_FORMAT_R8_UNORM: return 1;
+				case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+				case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+				default: return 4;
+			}
+		}
+	}
+
+	TexturePool::TexturePool(Device* device, size_t max_cached)
+		: device_(device)
+		, max_cached_(max_cached)
+	{
+		stats_.creates = 0;
+		stats_.reuses = 0;
+		stats_.frees = 0;
+		stats_.in_use = 0;
+		stats_.cached = 0;
+		stats_.high_water = 0;
+	}
+
+	shared_ptr<Texture2D> TexturePool::acquire(int width, int height, DXGI_FORMAT format)
+	{
+		Entry entry;
+		entry.width = width;
+		entry.height = height;
+		entry.format = format;
+		entry.bytes = size_t(width) * height * bytes_per_pixel(format);
+
+		{
+			lock_guard<mutex> guard(lock_);
+			for (auto i = cache_.rbegin(); i != cache_.rend(); ++i)
+			{
+				if (i->width == width && i->height == height && i->format == format)
+				{
+					entry.texture = i->texture;
+					cache_.erase(next(i).base());
+					stats_.cached -= entry.bytes;
+					stats_.reuses++;
+					break;
+				}
+			}
+		}
+
+		if (!entry.texture)
+		{
+			entry.texture = device_->create_texture(width, height, format, nullptr, 0);
+			if (!entry.texture) {
+				return nullptr;
+			}
+			lock_guard<mutex> guard(lock_);
+			stats_.creates++;
+		}
+
+		{
+			lock_guard<mutex> guard(lock_);
+			stats_.in_use += entry.bytes;
+			stats_.high_water = max(stats_.high_water, stats_.in_use + stats_.cached);
+		}
+
+		// the pool may be gone by the time the texture is released
+		weak_ptr<TexturePool> const pool = shared_from_this();
+		return shared_ptr<Texture2D>(entry.texture.get(), [pool, entry](Texture2D*)
+		{
+			auto const p = pool.lock();
+			if (p) {
+				p->release(entry);
+			}
+		});
+	}
+
+	void TexturePool::release(Entry const& entry)
+	{
+		lock_guard<mutex> guard(lock_);
+		stats_.in_use -= entry.bytes;
+		cache_.push_back(entry);
+		stats_.cached += entry.bytes;
+
+		evict(max_cached_);
+	}
+
+	void TexturePool::trim(size_t keep)
+	{
+		lock_guard<mutex> guard(lock_);
+		evict(keep);
+	}
+
+	//
+	// the lock should be held by the caller
+	//
+	void TexturePool::evict(size_t keep)
+	{
+		while (stats_.cached > keep && !cache_.empty())
+		{
+			stats_.cached -= cache_.front().bytes;
+			stats_.frees++;
+			cache_.erase(cache_.begin());
+		}
+	}
+
+	TexturePool::Stats TexturePool::stats() const
+	{
+		lock_guard<mutex> guard(lock_);
+		return stats_;
+	}
+
 	shared_ptr<Texture2D> Device::open_shared_texture(void* handle)
 	{
 		ID3D11Texture2D* tex = nullptr;
@@ -616,7 +947,7 @@ namespace d3d11 {
 		D3D11_TEXTURE2D_DESC td;
 		td.ArraySize = 1;
 		td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		td.CPUAccessFlags = data ? 0 : D3D11_CPU_ACCESS_WRITE;
+		td.CPUAccessFlags = 0;
 		td.Format = format;
 		td.Width = width;
 		td.Height = height;
@@ -624,7 +955,7 @@ namespace d3d11 {
 		td.MiscFlags = 0;
 		td.SampleDesc.Count = 1;
 		td.SampleDesc.Quality = 0;
-		td.Usage = data ? D3D11_USAGE_DEFAULT : D3D11_USAGE_DYNAMIC;
+		td.Usage = D3D11_USAGE_DEFAULT;
 
 		D3D11_SUBRESOURCE_DATA srd;
 		srd.pSysMem = data;
@@ -727,12 +1058,14 @@ R"--(struct VS_INPUT
 {
 	float4 pos : POSITION;
 	float2 tex : TEXCOORD0;
+	float alpha : COLOR0;
 };
 
 struct VS_OUTPUT
 {
 	float4 pos : SV_POSITION;
 	float2 tex : TEXCOORD0;
+	float alpha : COLOR0;
 };
 
 VS_OUTPUT main(VS_INPUT input)
@@ -740,6 +1073,7 @@ VS_OUTPUT main(VS_INPUT input)
 	VS_OUTPUT output;
 	output.pos = input.pos;
 	output.tex = input.tex;
+	output.alpha = input.alpha;
 	return output;
 })--";
 
@@ -751,11 +1085,13 @@ struct VS_OUTPUT
 {
 	float4 pos : SV_POSITION;
 	float2 tex : TEXCOORD0;
+	float alpha : COLOR0;
 };
 
+// layer opacity (textures are pre-multiplied so scale all channels)
 float4 main(VS_OUTPUT input) : SV_Target
 {
-	return tex0.Sample(samp0, input.tex);
+	return tex0.Sample(samp0, input.tex) * input.alpha;
 })--";
 
 		return create_effect(
@@ -767,6 +1103,36 @@ float4 main(VS_OUTPUT input) : SV_Target
 				"ps_4_0");
 	}
 
+	//
+	// blend=true is the same pre-multiplied alpha blending as the swapchain,
+	// blend=false simply writes the source (for opaque layers)
+	//
+	shared_ptr<BlendState> Device::create_blend_state(bool blend)
+	{
+		D3D11_BLEND_DESC desc;
+		desc.AlphaToCoverageEnable = FALSE;
+		desc.IndependentBlendEnable = FALSE;
+		auto const count = sizeof(desc.RenderTarget) / sizeof(desc.RenderTarget[0]);
+		for (size_t n = 0; n < count; ++n)
+		{
+			desc.RenderTarget[n].BlendEnable = blend ? TRUE : FALSE;
+			desc.RenderTarget[n].SrcBlend = D3D11_BLEND_ONE;
+			desc.RenderTarget[n].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+			desc.RenderTarget[n].SrcBlendAlpha = D3D11_BLEND_ONE;
+			desc.RenderTarget[n].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+			desc.RenderTarget[n].BlendOp = D3D11_BLEND_OP_ADD;
+			desc.RenderTarget[n].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+			desc.RenderTarget[n].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+		}
+
+		ID3D11BlendState* state = nullptr;
+		auto const hr = device_->CreateBlendState(&desc, &state);
+		if (FAILED(hr)) {
+			return nullptr;
+		}
+		return make_shared<BlendState>(state);
+	}
+
 	shared_ptr<Effect> Device::create_effect(
 		string const& vertex_code,
 		string const& vertex_entry,
@@ -792,6 +1158,7 @@ float4 main(VS_OUTPUT input) : SV_Target
 			{
 				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "COLOR", 0, DXGI_FORMAT_R32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 			};
 
 			UINT elements = ARRAYSIZE(layout_desc);
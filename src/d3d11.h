@@ -1,8 +1,13 @@
 #pragma once
 
+#include "region.h"
+
 #include <d3d11_1.h>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace d3d11 {
 
@@ -10,7 +15,10 @@ namespace d3d11 {
 	class Geometry;
 	class Effect;
 	class Texture2D;
+	class BlendState;
 	class Context;
+	class TexturePool;
+	class Readback;
 
 	template<class T>
 	class ScopedBinder
@@ -65,6 +73,10 @@ namespace d3d11 {
 		std::shared_ptr<Geometry> create_quad(
 					float x, float y, float width, float height, bool flip=false);
 
+		// a CPU-writable triangle list for up to max_vertices
+		std::shared_ptr<Geometry> create_dynamic_geometry(
+					uint32_t max_vertices, uint32_t stride);
+
 		std::shared_ptr<Texture2D> create_texture(
 					int width, 
 					int height, 
@@ -74,8 +86,16 @@ namespace d3d11 {
 
 		std::shared_ptr<Texture2D> open_shared_texture(void*);
 
+		// textures for CPU uploads are recycled through this pool
+		std::shared_ptr<TexturePool> texture_pool();
+
 		std::shared_ptr<Effect> create_default_effect();
 
+		std::shared_ptr<BlendState> create_blend_state(bool blend);
+
+		// for reading rendered frames back to the CPU
+		std::shared_ptr<Readback> create_readback();
+
 		std::shared_ptr<Effect> create_effect(
 						std::string const& vertex_code,
 						std::string const& vertex_entry,
@@ -95,6 +115,60 @@ namespace d3d11 {
 
 		std::shared_ptr<ID3D11Device> const device_;
 		std::shared_ptr<Context> const ctx_;
+		std::shared_ptr<TexturePool> texture_pool_;
+	};
+
+	//
+	// recycles textures by width, height and format so resizing a view
+	// doesn't create (and destroy) a texture for every new size
+	//
+	// released textures are cached up to max_cached bytes, the least
+	// recently released are destroyed first
+	//
+	class TexturePool : public std::enable_shared_from_this<TexturePool>
+	{
+	public:
+		struct Stats
+		{
+			uint64_t creates;	// textures created on the device
+			uint64_t reuses;	// textures from the cache
+			uint64_t frees;		// textures destroyed
+			size_t in_use;		// bytes handed out
+			size_t cached;		// bytes kept for reuse
+			size_t high_water;	// peak of in_use + cached
+		};
+
+		// the device owns the pool
+		TexturePool(Device* device, size_t max_cached);
+
+		// returned to the pool when released
+		std::shared_ptr<Texture2D> acquire(int width, int height, DXGI_FORMAT format);
+
+		// destroy cached textures until no more than keep bytes are cached
+		void trim(size_t keep = 0);
+
+		Stats stats() const;
+
+	private:
+
+		struct Entry
+		{
+			std::shared_ptr<Texture2D> texture;
+			int width;
+			int height;
+			DXGI_FORMAT format;
+			size_t bytes;
+		};
+
+		void release(Entry const& entry);
+		void evict(size_t keep);
+
+		Device* const device_;
+		size_t const max_cached_;
+
+		mutable std::mutex lock_;
+		std::vector<Entry> cache_;
+		Stats stats_;
 	};
 
 	//
@@ -126,6 +200,38 @@ namespace d3d11 {
 		std::shared_ptr<Context> ctx_;
 	};
 
+	//
+	// copies of the bound render target read by the CPU a few frames
+	// later so the GPU is never waited on
+	//
+	// copy() uses the next free staging texture (there are slots of them)
+	// and read() maps the oldest copy only once the GPU is done with it
+	//
+	class Readback
+	{
+	public:
+		static uint32_t const slots = 3;
+
+		typedef std::function<void(
+			const uint8_t* pixels, uint32_t stride, uint32_t width, uint32_t height)> Reader;
+
+		Readback(ID3D11Device*);
+
+		// false if every staging texture is still waiting to be read
+		bool copy(std::shared_ptr<Context> const& ctx);
+
+		// false if there was no copy or the GPU isn't done with it yet
+		bool read(std::shared_ptr<Context> const& ctx, Reader const& reader);
+
+	private:
+
+		std::shared_ptr<ID3D11Device> const device_;
+		std::shared_ptr<ID3D11Texture2D> staging_[slots];
+		bool pending_[slots];
+		uint32_t next_copy_;
+		uint32_t next_read_;
+	};
+
 	class Texture2D
 	{
 	public:
@@ -151,6 +257,9 @@ namespace d3d11 {
 		
 		void copy_from(const void* buffer, uint32_t stride, uint32_t rows);
 
+		// upload only the rects of region (in pixels) from buffer
+		void copy_from(const void* buffer, uint32_t stride, Region const& region);
+
 	private:
 
 		HANDLE share_handle_;
@@ -161,6 +270,27 @@ namespace d3d11 {
 		std::shared_ptr<Context> ctx_;
 	};
 
+	//
+	// a blend state that is set on bind() and restores the
+	// previous state on unbind()
+	//
+	class BlendState
+	{
+	public:
+		BlendState(ID3D11BlendState*);
+
+		void bind(std::shared_ptr<Context> const& ctx);
+		void unbind();
+
+	private:
+
+		std::shared_ptr<ID3D11BlendState> const state_;
+		std::shared_ptr<ID3D11BlendState> previous_;
+		float previous_factor_[4];
+		UINT previous_mask_;
+		std::shared_ptr<Context> ctx_;
+	};
+
 	class Effect
 	{
 	public:
@@ -193,7 +323,13 @@ namespace d3d11 {
 		void bind(std::shared_ptr<Context> const& ctx);
 		void unbind();
 
+		uint32_t capacity() const { return vertices_; }
+
+		// replace the contents of a dynamic buffer (must be bound)
+		bool update(const void* vertices, uint32_t count);
+
 		void draw();
+		void draw(uint32_t first, uint32_t count);
 
 	private:
 
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <string>
+
+//
+// how frames from a source (e.g. a browser) are handed to the composition
+//
+//   Latest - only the newest frame is kept, older ones are dropped
+//            (lowest latency ... tickers, UI)
+//   Queue  - up to depth frames are queued and drawn in order, one per
+//            output frame (smooth video) ... paints beyond that are dropped
+//   Hold   - a single frame is held until drawn and the source is not
+//            asked for another one (BeginFrame) until then
+//
+enum class Delivery
+{
+	Latest,
+	Queue,
+	Hold
+};
+
+//
+// shared textures with a keyed mutex are only read once the producer
+// hands them over ... the render thread waits at most sync_timeout_ms
+// for that before drawing the last frame it has
+//
+// the source is asked for at most frame_rate frames per second (0 is
+// every composition tick) and not again until it painted the last one
+// or begin_frame_timeout_ms passed
+//
+struct DeliveryPolicy
+{
+	Delivery mode;
+	uint32_t depth;				// queued frames (Queue only)
+	uint32_t sync_timeout_ms;
+	double frame_rate;
+	uint32_t begin_frame_timeout_ms;
+};
+
+uint32_t const default_sync_timeout_ms = 2;
+uint32_t const default_begin_frame_timeout_ms = 50;
+
+inline DeliveryPolicy latest_delivery() {
+	return DeliveryPolicy{ Delivery::Latest, 1, 
+		default_sync_timeout_ms, 0.0, default_begin_frame_timeout_ms };
+}
+
+inline DeliveryPolicy queue_delivery(uint32_t depth) {
+	return DeliveryPolicy{ Delivery::Queue, depth ? depth : 1, 
+		default_sync_timeout_ms, 0.0, default_begin_frame_timeout_ms };
+}
+
+inline DeliveryPolicy hold_delivery() {
+	return DeliveryPolicy{ Delivery::Hold, 1, 
+		default_sync_timeout_ms, 0.0, default_begin_frame_timeout_ms };
+}
+
+inline char const* to_string(Delivery mode)
+{
+	switch (mode)
+	{
+		case Delivery::Queue: return "queue";
+		case Delivery::Hold: return "hold";
+		default: return "latest";
+	}
+}
+
+// "latest", "queue" or "hold" ... returns false for anything else
+inline bool to_delivery(std::string const& name, uint32_t depth, DeliveryPolicy& policy)
+{
+	if (name == "latest") {
+		policy = latest_delivery();
+	}
+	else if (name == "queue") {
+		policy = queue_delivery(depth);
+	}
+	else if (name == "hold") {
+		policy = hold_delivery();
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//
+// frame delivery counters for a layer
+//
+//   delivered - frames taken for drawing
+//   dropped   - frames never drawn (replaced, or the queue was full)
+//   repeated  - draws without a new frame (the previous one was reused)
+//   timeouts  - a keyed mutex was not handed over in time
+//
+// shared_hits / shared_misses count shared texture handles that were
+// already open (cached) or had to be opened
+//
+// begin_frames are the frames asked for (BeginFrame), begin_timeouts
+// those that were never painted and begin_to_paint the time until they
+// were (microseconds)
+//
+// hidden is set while the source is throttled because its layer isn't
+// visible, hides counts how often that happened
+//
+// input_events counts mouse events sent to the source, input_coalesced
+// those merged into another before it was sent and input_delay how long
+// they waited for the frame they were sent with (microseconds)
+//
+struct DeliveryStats
+{
+	DeliveryPolicy policy;
+	uint64_t delivered;
+	uint64_t dropped;
+	uint64_t repeated;
+	uint64_t timeouts;
+	uint32_t queued;
+	uint64_t shared_hits;
+	uint64_t shared_misses;
+	uint64_t begin_frames;
+	uint64_t begin_timeouts;
+	Histogram::Summary begin_to_paint;
+	bool hidden;
+	uint64_t hides;
+	uint64_t input_events;
+	uint64_t input_coalesced;
+	Histogram::Summary input_delay;
+};
+
+// for sources without a delivery path (e.g. images)
+inline DeliveryStats no_delivery() {
+	return DeliveryStats{ latest_delivery(), 0, 0, 0, 0, 0, 0, 0, 0, 0, Histogram::Summary(), false, 0, 0, 0, Histogram::Summary() };
+}
@@ -0,0 +1,236 @@
+#if defined(_WIN32)
+#include "platform.h"
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif
+#include "frame_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+	// only buffers at least this big are worth a huge page
+	size_t const huge_page_size = 2 * 1024 * 1024;
+
+	int log2_floor(size_t value)
+	{
+		int n = 0;
+		while (value >>= 1) {
+			n++;
+		}
+		return n;
+	}
+
+	size_t round_up(size_t value, size_t multiple) {
+		return ((value + multiple - 1) / multiple) * multiple;
+	}
+}
+
+FramePool::FramePool(size_t max_cached, bool huge_pages)
+	: max_cached_(max_cached)
+	, huge_pages_(huge_pages)
+{
+	stats_.allocations = 0;
+	stats_.reuses = 0;
+	stats_.frees = 0;
+	stats_.in_use = 0;
+	stats_.cached = 0;
+	stats_.high_water = 0;
+}
+
+FramePool::~FramePool()
+{
+	// buffers still in use are freed by their own deleter
+	trim(0);
+}
+
+//
+// small sizes are rounded to the alignment, larger ones to a quarter
+// of their power of two (so at most 25% is wasted) and whole pages
+//
+size_t FramePool::bucket_size(size_t size)
+{
+	size = max<size_t>(size, alignment);
+	if (size < 64 * 1024) {
+		return round_up(size, alignment);
+	}
+	auto const step = size_t(1) << (log2_floor(size) - 2);
+	return round_up(round_up(size, step), 4096);
+}
+
+shared_ptr<uint8_t> FramePool::acquire(size_t size)
+{
+	auto const bucket = bucket_size(size);
+
+	Block block = { nullptr, 0, false };
+	{
+		lock_guard<mutex> guard(lock_);
+
+		// the most recently released buffer of this size is likely still warm
+		for (auto i = cache_.rbegin(); i != cache_.rend(); ++i)
+		{
+			if (i->size == bucket)
+			{
+				block = *i;
+				cache_.erase(next(i).base());
+				stats_.cached -= bucket;
+				stats_.reuses++;
+				break;
+			}
+		}
+	}
+
+	auto const allocated = !block.data;
+	if (allocated)
+	{
+		block = allocate(bucket, huge_pages_);
+		if (!block.data) {
+			return nullptr;
+		}
+	}
+
+	{
+		lock_guard<mutex> guard(lock_);
+		if (allocated) {
+			stats_.allocations++;
+		}
+		stats_.in_use += bucket;
+		stats_.high_water = max(stats_.high_water, stats_.in_use + stats_.cached);
+	}
+
+	weak_ptr<FramePool> const pool = shared_from_this();
+	return shared_ptr<uint8_t>(block.data, [pool, block](uint8_t*)
+	{
+		auto const p = pool.lock();
+		if (p) {
+			p->release(block);
+		}
+		else {
+			free_block(block);
+		}
+	});
+}
+
+void FramePool::release(Block const& block)
+{
+	lock_guard<mutex> guard(lock_);
+	stats_.in_use -= block.size;
+	cache_.push_back(block);
+	stats_.cached += block.size;
+
+	evict(max_cached_);
+}
+
+void FramePool::trim(size_t keep)
+{
+	lock_guard<mutex> guard(lock_);
+	evict(keep);
+}
+
+//
+// free the least recently released buffers until no more than keep
+// bytes are cached ... the lock should be held by the caller
+//
+void FramePool::evict(size_t keep)
+{
+	while (stats_.cached > keep && !cache_.empty())
+	{
+		auto const oldest = cache_.front();
+		cache_.erase(cache_.begin());
+		stats_.cached -= oldest.size;
+		stats_.frees++;
+		free_block(oldest);
+	}
+}
+
+FramePool::Stats FramePool::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	return stats_;
+}
+
+FramePool::Block FramePool::allocate(size_t size, bool huge_pages)
+{
+	Block block = { nullptr, size, false };
+
+#if defined(_WIN32)
+
+	// large pages need SeLockMemoryPrivilege ... just try and fall back
+	if (huge_pages && size >= huge_page_size)
+	{
+		auto const large = GetLargePageMinimum();
+		if (large && (size % large) == 0)
+		{
+			block.data = static_cast<uint8_t*>(VirtualAlloc(nullptr, size,
+						MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+			if (block.data)
+			{
+				block.huge = true;
+				return block;
+			}
+		}
+	}
+	block.data = static_cast<uint8_t*>(_aligned_malloc(size, alignment));
+
+#else
+
+	// a hint only: transparent huge pages if the kernel allows them
+	if (huge_pages && size >= huge_page_size)
+	{
+		auto const p = mmap(nullptr, round_up(size, huge_page_size),
+					PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+		{
+#if defined(MADV_HUGEPAGE)
+			madvise(p, round_up(size, huge_page_size), MADV_HUGEPAGE);
+#endif
+			block.data = static_cast<uint8_t*>(p);
+			block.huge = true;
+			return block;
+		}
+	}
+
+	void* p = nullptr;
+	if (posix_memalign(&p, alignment, size) == 0) {
+		block.data = static_cast<uint8_t*>(p);
+	}
+
+#endif
+
+	return block;
+}
+
+void FramePool::free_block(Block const& block)
+{
+#if defined(_WIN32)
+	if (block.huge) {
+		VirtualFree(block.data, 0, MEM_RELEASE);
+	}
+	else {
+		_aligned_free(block.data);
+	}
+#else
+	if (block.huge) {
+		munmap(block.data, round_up(block.size, huge_page_size));
+	}
+	else {
+		free(block.data);
+	}
+#endif
+}
+
+shared_ptr<FramePool> create_frame_pool(size_t max_cached, bool huge_pages)
+{
+	return make_shared<FramePool>(max_cached, huge_pages);
+}
+
+shared_ptr<FramePool> const& frame_pool()
+{
+	// enough to keep a few 4K frames around during a resize
+	static auto const pool = create_frame_pool(256 * 1024 * 1024, true);
+	return pool;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// recycles large CPU frame buffers (browser paints, uploads)
+//
+// sizes are rounded up to a bucket (a quarter of a power of two at most)
+// so buffers can be reused while a window is resized instead of going
+// back to the heap for every new size.  Released buffers are cached up
+// to max_cached bytes, least recently released are freed first.
+//
+// every buffer is 64-byte aligned ... large ones can optionally be backed
+// by huge pages (this falls back to normal pages when not available)
+//
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+	static size_t const alignment = 64;
+
+	struct Stats
+	{
+		uint64_t allocations;	// buffers from the system
+		uint64_t reuses;		// buffers from the cache
+		uint64_t frees;			// buffers returned to the system
+		size_t in_use;			// bytes handed out
+		size_t cached;			// bytes kept for reuse
+		size_t high_water;		// peak of in_use + cached
+	};
+
+	FramePool(size_t max_cached, bool huge_pages);
+	~FramePool();
+
+	// a buffer of at least size bytes ... returned to the pool when released
+	std::shared_ptr<uint8_t> acquire(size_t size);
+
+	// free cached buffers until no more than keep bytes are cached
+	void trim(size_t keep = 0);
+
+	Stats stats() const;
+
+	// the size actually allocated for a request
+	static size_t bucket_size(size_t size);
+
+private:
+
+	struct Block
+	{
+		uint8_t* data;
+		size_t size;
+		bool huge;
+	};
+
+	FramePool(FramePool const&);
+	FramePool& operator=(FramePool const&);
+
+	void release(Block const& block);
+	void evict(size_t keep);
+
+	static Block allocate(size_t size, bool huge_pages);
+	static void free_block(Block const& block);
+
+	size_t const max_cached_;
+	bool const huge_pages_;
+
+	mutable std::mutex lock_;
+	std::vector<Block> cache_;
+	Stats stats_;
+};
+
+std::shared_ptr<FramePool> create_frame_pool(size_t max_cached, bool huge_pages);
+
+// the pool shared by all browser views
+std::shared_ptr<FramePool> const& frame_pool();
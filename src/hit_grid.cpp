@@ -0,0 +1,147 @@
+#include "hit_grid.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+	// keep the grid at no more than this many cells on a side
+	int32_t const max_cells = 32;
+	int32_t const min_cell_size = 32;
+}
+
+HitGrid::HitGrid()
+	: width_(0)
+	, height_(0)
+	, cell_size_(min_cell_size)
+	, columns_(0)
+	, rows_(0)
+{
+}
+
+void HitGrid::reset(int32_t width, int32_t height)
+{
+	entries_.clear();
+	cells_.clear();
+
+	width_ = max(0, width);
+	height_ = max(0, height);
+
+	cell_size_ = max(min_cell_size, (max(width_, height_) + max_cells - 1) / max_cells);
+	columns_ = (width_ + cell_size_ - 1) / cell_size_;
+	rows_ = (height_ + cell_size_ - 1) / cell_size_;
+	cells_.resize(columns_ * rows_);
+}
+
+bool HitGrid::cells(IntRect const& rect,
+		int32_t& c0, int32_t& r0, int32_t& c1, int32_t& r1) const
+{
+	auto const r = rect.intersect(IntRect{ 0, 0, width_, height_ });
+	if (r.empty()) {
+		return false;
+	}
+	c0 = r.x / cell_size_;
+	r0 = r.y / cell_size_;
+	c1 = (r.x + r.width - 1) / cell_size_;
+	r1 = (r.y + r.height - 1) / cell_size_;
+	return true;
+}
+
+void HitGrid::link(Entry* entry)
+{
+	int32_t c0, r0, c1, r1;
+	if (cells(entry->rect, c0, r0, c1, r1))
+	{
+		for (auto r = r0; r <= r1; ++r) {
+			for (auto c = c0; c <= c1; ++c) {
+				cells_[(r * columns_) + c].push_back(entry);
+			}
+		}
+	}
+}
+
+void HitGrid::unlink(Entry* entry)
+{
+	int32_t c0, r0, c1, r1;
+	if (cells(entry->rect, c0, r0, c1, r1))
+	{
+		for (auto r = r0; r <= r1; ++r)
+		{
+			for (auto c = c0; c <= c1; ++c)
+			{
+				auto& cell = cells_[(r * columns_) + c];
+				cell.erase(std::remove(cell.begin(), cell.end(), entry), cell.end());
+			}
+		}
+	}
+}
+
+void HitGrid::insert(shared_ptr<Layer> const& layer, IntRect const& rect, uint64_t order)
+{
+	if (!layer) {
+		return;
+	}
+
+	remove(layer.get());
+
+	auto& entry = entries_[layer.get()];
+	entry.layer = layer;
+	entry.rect = rect;
+	entry.order = order;
+	link(&entry);
+}
+
+bool HitGrid::move(Layer const* layer, IntRect const& rect)
+{
+	auto const i = entries_.find(layer);
+	if (i == entries_.end()) {
+		return false;
+	}
+
+	auto& entry = i->second;
+	if (entry.rect.x != rect.x || entry.rect.y != rect.y ||
+		 entry.rect.width != rect.width || entry.rect.height != rect.height)
+	{
+		unlink(&entry);
+		entry.rect = rect;
+		link(&entry);
+	}
+	return true;
+}
+
+void HitGrid::remove(Layer const* layer)
+{
+	auto const i = entries_.find(layer);
+	if (i != entries_.end())
+	{
+		unlink(&i->second);
+		entries_.erase(i);
+	}
+}
+
+shared_ptr<Layer> HitGrid::find(int32_t x, int32_t y, IntRect& rect) const
+{
+	if (x < 0 || y < 0 || x >= width_ || y >= height_) {
+		return nullptr;
+	}
+
+	Entry const* best = nullptr;
+	for (auto const entry : cells_[((y / cell_size_) * columns_) + (x / cell_size_)])
+	{
+		auto const& r = entry->rect;
+		if (x >= r.x && x < (r.x + r.width) && y >= r.y && y < (r.y + r.height))
+		{
+			if (!best || entry->order > best->order) {
+				best = entry;
+			}
+		}
+	}
+
+	if (best)
+	{
+		rect = best->rect;
+		return best->layer;
+	}
+	return nullptr;
+}
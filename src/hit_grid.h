@@ -0,0 +1,62 @@
+#pragma once
+
+#include "region.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class Layer;
+
+//
+// a uniform grid over screen-space layer rects so hit-testing only
+// looks at the few layers overlapping the cell under a point
+//
+// entries carry an order (higher is in front) so the front-most
+// layer wins, the same as walking the layers back to front
+//
+// note: not thread-safe, the composition serializes access
+//
+class HitGrid
+{
+public:
+	HitGrid();
+
+	// remove everything and set the screen size
+	void reset(int32_t width, int32_t height);
+
+	void insert(std::shared_ptr<Layer> const& layer, IntRect const& rect, uint64_t order);
+
+	// returns false if the layer is not in the grid
+	bool move(Layer const* layer, IntRect const& rect);
+
+	void remove(Layer const* layer);
+
+	// front-most layer containing the point (and its rect)
+	std::shared_ptr<Layer> find(int32_t x, int32_t y, IntRect& rect) const;
+
+	size_t size() const { return entries_.size(); }
+
+private:
+
+	struct Entry
+	{
+		std::shared_ptr<Layer> layer;
+		IntRect rect;
+		uint64_t order;
+	};
+
+	// cell range covered by a rect (false if off-screen)
+	bool cells(IntRect const& rect, int32_t& c0, int32_t& r0, int32_t& c1, int32_t& r1) const;
+
+	void link(Entry* entry);
+	void unlink(Entry* entry);
+
+	int32_t width_;
+	int32_t height_;
+	int32_t cell_size_;
+	int32_t columns_;
+	int32_t rows_;
+	std::vector<std::vector<Entry*>> cells_;
+	std::unordered_map<Layer const*, Entry> entries_;
+};
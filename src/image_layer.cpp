@@ -10,9 +10,11 @@ class ImageLayer : public Layer
 public:
 	ImageLayer(
 			std::shared_ptr<d3d11::Device> const& device,
-			std::shared_ptr<d3d11::Texture2D> const& texture)
+			std::shared_ptr<d3d11::Texture2D> const& texture,
+			std::shared_ptr<soft::Surface> const& surface)
 		: Layer(device, false, false)
 		, texture_(texture)
+		, surface_(surface)
 	{
 	}
 
@@ -22,9 +24,16 @@ public:
 		render_texture(ctx, texture_);
 	}
 
+	void render(shared_ptr<soft::Context> const& ctx) override
+	{
+		// software backend draws from the decoded pixels
+		render_surface(ctx, surface_);
+	}
+
 private:
 
 	shared_ptr<d3d11::Texture2D> const texture_;
+	shared_ptr<soft::Surface> const surface_;
 };
 
 //
@@ -107,8 +116,27 @@ shared_ptr<Layer> create_image_layer(
 			buffer.get(), 
 			stride);
 
-	if (texture) {
-		return make_shared<ImageLayer>(device, texture);
+	// keep a CPU copy of the (pre-multiplied) pixels for the software backend
+	auto const surface = soft::create_surface(width, height, buffer.get(), stride);
+
+	if (texture) 
+	{
+		auto const layer = make_shared<ImageLayer>(device, texture, surface);
+
+		// an image without any transparency can be drawn as an opaque layer
+		auto const pixels = buffer.get();
+		bool opaque = true;
+		for (uint32_t n = 3; n < cb; n += 4) 
+		{
+			if (pixels[n] != 0xff) 
+			{
+				opaque = false;
+				break;
+			}
+		}
+		layer->set_opaque(opaque);
+
+		return layer;
 	}
 
 	return nullptr;
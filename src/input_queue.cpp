@@ -0,0 +1,104 @@
+#include "input_queue.h"
+#include "composition.h"
+
+using namespace std;
+
+InputQueue::InputQueue()
+	: queued_(0)
+	, coalesced_(0)
+	, dispatched_(0)
+{
+}
+
+void InputQueue::move(int32_t x, int32_t y, int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	queued_++;
+
+	// the last move wins
+	if (!events_.empty() && events_.back().type == Type::Move)
+	{
+		events_.back().x = x;
+		events_.back().y = y;
+		coalesced_++;
+		return;
+	}
+
+	Event const e = { Type::Move, MouseButton::Left, false, x, y, now };
+	events_.push_back(e);
+}
+
+void InputQueue::leave(int32_t x, int32_t y, int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	queued_++;
+
+	// moves since the last click (and any leave between them) don't
+	// matter when we leave anyway
+	auto time = now;
+	while (!events_.empty() && events_.back().type != Type::Click)
+	{
+		time = events_.back().time;
+		events_.pop_back();
+		coalesced_++;
+	}
+
+	Event const e = { Type::Leave, MouseButton::Left, false, x, y, time };
+	events_.push_back(e);
+}
+
+void InputQueue::click(MouseButton button, bool up, int32_t x, int32_t y, int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	queued_++;
+
+	Event const e = { Type::Click, button, up, x, y, now };
+	events_.push_back(e);
+}
+
+int64_t InputQueue::age(int64_t now) const
+{
+	lock_guard<mutex> guard(lock_);
+	if (events_.empty()) {
+		return 0;
+	}
+	return now - events_.front().time;
+}
+
+bool InputQueue::take(vector<Event>& events, int64_t now)
+{
+	events.clear();
+
+	lock_guard<mutex> guard(lock_);
+	if (events_.empty()) {
+		return false;
+	}
+
+	for (auto const& e : events_) {
+		delay_.record(now - e.time);
+	}
+	dispatched_ += events_.size();
+	events.swap(events_);
+	return true;
+}
+
+void InputQueue::reset()
+{
+	lock_guard<mutex> guard(lock_);
+	events_.clear();
+	queued_ = 0;
+	coalesced_ = 0;
+	dispatched_ = 0;
+	delay_.reset();
+}
+
+InputQueue::Stats InputQueue::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	Stats stats;
+	stats.events = queued_;
+	stats.coalesced = coalesced_;
+	stats.dispatched = dispatched_;
+	stats.delay = delay_.summary();
+	return stats;
+}
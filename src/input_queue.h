@@ -0,0 +1,82 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+enum class MouseButton;
+
+//
+// mouse input for a layer waiting for the next frame
+//
+// a digitizer can report far more moves than a browser can paint, so
+// moves are coalesced until the owner takes the events (just before it
+// asks for a frame):
+//
+//   - the last move wins (a run of moves is one event)
+//   - clicks are never coalesced and keep their order (with a move
+//     before a click delivered before it)
+//   - a leave replaces the moves (and leaves) since the last click ...
+//     the next move after it is the enter
+//
+// times are in microseconds ... a coalesced move keeps the time of the
+// first move of its run so the delay is measured from the oldest input
+//
+class InputQueue
+{
+public:
+	enum class Type
+	{
+		Move,
+		Leave,
+		Click
+	};
+
+	struct Event
+	{
+		Type type;
+		MouseButton button;
+		bool up;
+		int32_t x;
+		int32_t y;
+		int64_t time;
+	};
+
+	struct Stats
+	{
+		uint64_t events;			// events queued
+		uint64_t coalesced;			// ... that were merged into another
+		uint64_t dispatched;		// events taken
+		Histogram::Summary delay;	// queued to taken
+	};
+
+	InputQueue();
+
+	void move(int32_t x, int32_t y, int64_t now);
+	void leave(int32_t x, int32_t y, int64_t now);
+	void click(MouseButton button, bool up, int32_t x, int32_t y, int64_t now);
+
+	// how long the oldest event has been waiting (0 if none)
+	int64_t age(int64_t now) const;
+
+	// all waiting events (in order) ... false if there were none
+	bool take(std::vector<Event>& events, int64_t now);
+
+	Stats stats() const;
+
+	// drop what is waiting and start the counters over
+	void reset();
+
+private:
+	InputQueue(InputQueue const&);
+	InputQueue& operator=(InputQueue const&);
+
+	mutable std::mutex lock_;
+	std::vector<Event> events_;
+	uint64_t queued_;
+	uint64_t coalesced_;
+	uint64_t dispatched_;
+	Histogram delay_;
+};
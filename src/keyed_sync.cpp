@@ -0,0 +1,115 @@
+#include "keyed_sync.h"
+
+#include <chrono>
+
+using namespace std;
+
+FrameSync::FrameSync(uint32_t timeout_ms)
+	: timeout_ms_(timeout_ms)
+	, pending_(false)
+{
+	stats_.taken = 0;
+	stats_.timeouts = 0;
+	stats_.repeated = 0;
+	stats_.missed = 0;
+}
+
+bool FrameSync::take(KeyedMutex* mutex, bool fresh, function<void()> const& draw)
+{
+	if (fresh) {
+		pending_ = true;
+	}
+
+	if (!pending_) {
+		return false;
+	}
+
+	if (mutex && !mutex->acquire(consumer_key, timeout_ms_))
+	{
+		stats_.timeouts++;
+		return false;
+	}
+
+	draw();
+
+	if (mutex) {
+		mutex->release(producer_key);
+	}
+
+	pending_ = false;
+	stats_.taken++;
+	return true;
+}
+
+bool FrameSync::repeat(KeyedMutex* mutex, uint32_t timeout_ms, function<void()> const& draw)
+{
+	stats_.repeated++;
+	if (!mutex)
+	{
+		draw();
+		return true;
+	}
+
+	// handed back and the producer hasn't started on it ... or released
+	// again (a frame we will take() once it is announced)
+	uint64_t key = producer_key;
+	if (!mutex->acquire(key, 0))
+	{
+		key = consumer_key;
+		if (!mutex->acquire(key, timeout_ms))
+		{
+			stats_.missed++;
+			return false;
+		}
+	}
+
+	draw();
+	mutex->release(key);
+	return true;
+}
+
+MockKeyedMutex::MockKeyedMutex(bool record)
+	: record_(record)
+	, owned_(false)
+	, key_(0)
+{
+}
+
+bool MockKeyedMutex::acquire(uint64_t key, uint32_t timeout_ms)
+{
+	unique_lock<mutex> guard(lock_);
+	auto const ready = released_.wait_for(guard, chrono::milliseconds(timeout_ms), 
+		[&]() { return !owned_ && (key_ == key); });
+
+	if (ready) {
+		owned_ = true;
+	}
+
+	if (record_)
+	{
+		Event e = { ready ? Op::Acquire : Op::Timeout, key };
+		history_.push_back(e);
+	}
+	return ready;
+}
+
+void MockKeyedMutex::release(uint64_t key)
+{
+	{
+		lock_guard<mutex> guard(lock_);
+		owned_ = false;
+		key_ = key;
+		if (record_)
+		{
+			Event e = { Op::Release, key };
+			history_.push_back(e);
+		}
+	}
+	released_.notify_all();
+}
+
+vector<MockKeyedMutex::Event> MockKeyedMutex::history() const
+{
+	lock_guard<mutex> guard(lock_);
+	return history_;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// what the key protocol needs from a keyed mutex
+// (IDXGIKeyedMutex on a shared texture ... or a mock)
+//
+// a keyed mutex is released with a key and can only be acquired
+// with that same key
+//
+class KeyedMutex
+{
+public:
+	virtual ~KeyedMutex() {}
+
+	// false if the mutex was not released with key within timeout_ms
+	virtual bool acquire(uint64_t key, uint32_t timeout_ms) = 0;
+	virtual void release(uint64_t key) = 0;
+};
+
+//
+// consumer side of the producer/consumer key protocol for a shared
+// texture that is drawn directly (never copied):
+//
+//   producer: acquire(producer_key) -> draw -> release(consumer_key)
+//   consumer: acquire(consumer_key) -> draw -> release(producer_key)
+//
+// the consumer holds the key across its own draw only, so the producer
+// waits at most one draw.  When the producer still holds the key after
+// timeout_ms, the frame stays pending (it is taken on a later call).
+//
+// drawing a frame again (nothing new yet) borrows whichever key the
+// texture was left with and releases it unchanged ... a frame that was
+// handed back to the producer isn't taken from it, and one the producer
+// released but hasn't announced yet stays waiting for take().
+//
+class FrameSync
+{
+public:
+	static uint64_t const producer_key = 0;
+	static uint64_t const consumer_key = 1;
+
+	struct Stats
+	{
+		uint64_t taken;
+		uint64_t timeouts;
+		uint64_t repeated;		// draws of a frame taken before
+		uint64_t missed;		// ... that couldn't get either key
+	};
+
+	FrameSync(uint32_t timeout_ms);
+
+	uint32_t timeout() const { return timeout_ms_; }
+	void set_timeout(uint32_t timeout_ms) { timeout_ms_ = timeout_ms; }
+
+	// a frame was announced but not taken yet
+	bool pending() const { return pending_; }
+
+	//
+	// call on every draw with fresh=true if a new frame was announced ...
+	// returns true if a frame was taken (draw was called while holding
+	// the key), false if there was nothing new or the acquire timed out
+	//
+	// without a mutex the frame is taken immediately
+	//
+	bool take(KeyedMutex* mutex, bool fresh, std::function<void()> const& draw);
+
+	//
+	// draw the frame taken last (mutex is its texture's) when take()
+	// returned false ... waits up to timeout_ms for a producer that is
+	// drawing into it.  False if it wasn't drawn.
+	//
+	bool repeat(KeyedMutex* mutex, uint32_t timeout_ms, std::function<void()> const& draw);
+
+	Stats stats() const { return stats_; }
+
+private:
+
+	uint32_t timeout_ms_;
+	bool pending_;
+	Stats stats_;
+};
+
+//
+// an in-process keyed mutex with the same semantics as IDXGIKeyedMutex
+// (initially released with key 0) ... for exercising the protocol
+// without a GPU
+//
+// with record=true every call is kept so the order of a run can be checked
+//
+class MockKeyedMutex : public KeyedMutex
+{
+public:
+	enum class Op
+	{
+		Acquire,
+		Timeout,
+		Release
+	};
+
+	struct Event
+	{
+		Op op;
+		uint64_t key;
+	};
+
+	MockKeyedMutex(bool record);
+
+	bool acquire(uint64_t key, uint32_t timeout_ms) override;
+	void release(uint64_t key) override;
+
+	std::vector<Event> history() const;
+
+private:
+
+	mutable std::mutex lock_;
+	std::condition_variable released_;
+	bool const record_;
+	bool owned_;
+	uint64_t key_;
+	std::vector<Event> history_;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+//
+// a small cache of values by key that evicts the least recently used
+// entry once it holds capacity entries
+//
+// lookups are a hash lookup plus a splice to the front of the recency
+// list ... nothing is allocated for a hit.  clear() drops everything
+// (e.g. when the values can no longer be used).
+//
+// note: not thread-safe
+//
+template <class Key, class Value>
+class LruCache
+{
+public:
+	struct Stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+	};
+
+	LruCache(size_t capacity)
+		: capacity_(capacity ? capacity : 1)
+	{
+		stats_.hits = 0;
+		stats_.misses = 0;
+		stats_.evictions = 0;
+	}
+
+	//
+	// the value for key (and mark it the most recently used) ...
+	// nullptr (and a miss) if it is not cached
+	//
+	Value* find(Key const& key)
+	{
+		auto const i = index_.find(key);
+		if (i == index_.end())
+		{
+			stats_.misses++;
+			return nullptr;
+		}
+
+		stats_.hits++;
+		entries_.splice(entries_.begin(), entries_, i->second);
+		return &i->second->second;
+	}
+
+	//
+	// add (or replace) the value for key as the most recently used ...
+	// the least recently used entry is evicted if the cache is full
+	//
+	Value& insert(Key const& key, Value const& value)
+	{
+		auto const i = index_.find(key);
+		if (i != index_.end())
+		{
+			i->second->second = value;
+			entries_.splice(entries_.begin(), entries_, i->second);
+			return i->second->second;
+		}
+
+		if (entries_.size() >= capacity_)
+		{
+			index_.erase(entries_.back().first);
+			entries_.pop_back();
+			stats_.evictions++;
+		}
+
+		entries_.emplace_front(key, value);
+		index_[key] = entries_.begin();
+		return entries_.front().second;
+	}
+
+	void erase(Key const& key)
+	{
+		auto const i = index_.find(key);
+		if (i != index_.end())
+		{
+			entries_.erase(i->second);
+			index_.erase(i);
+		}
+	}
+
+	void clear()
+	{
+		entries_.clear();
+		index_.clear();
+	}
+
+	size_t size() const { return entries_.size(); }
+	size_t capacity() const { return capacity_; }
+
+	Stats stats() const { return stats_; }
+
+private:
+
+	typedef std::list<std::pair<Key, Value>> Entries;
+
+	size_t const capacity_;
+	Entries entries_;
+	std::unordered_map<Key, typename Entries::iterator> index_;
+	Stats stats_;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+//
+// a lock-free triple buffer for handing frames from one producer
+// thread to one consumer thread
+//
+// the producer always owns a slot to fill (back) and the consumer always
+// owns the slot it is reading (front) ... the third slot sits in the
+// middle and is swapped with a single atomic exchange by either side.
+// Neither side ever waits: a frame published before the consumer took the
+// previous one simply replaces it (and is counted as superseded).
+//
+template <class T>
+class Mailbox
+{
+public:
+	Mailbox()
+		: middle_(1)
+		, back_(0)
+		, front_(2)
+		, published_(0)
+		, consumed_(0)
+		, superseded_(0)
+	{
+	}
+
+	//
+	// producer: the slot to fill ... owned until publish()
+	//
+	T& back() { return slots_[back_]; }
+	uint32_t back_index() const { return back_; }
+
+	//
+	// producer: make the back slot the newest frame ... returns false
+	// if it replaced a frame the consumer never took
+	//
+	bool publish()
+	{
+		auto const prev = middle_.exchange(back_ | fresh_bit, std::memory_order_acq_rel);
+		back_ = prev & index_mask;
+		published_.fetch_add(1, std::memory_order_relaxed);
+		if (prev & fresh_bit)
+		{
+			superseded_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	//
+	// consumer: take the newest published frame ... returns false
+	// (and keeps the current front) if nothing new was published
+	//
+	bool acquire()
+	{
+		if (!(middle_.load(std::memory_order_acquire) & fresh_bit)) {
+			return false;
+		}
+		auto const prev = middle_.exchange(front_, std::memory_order_acq_rel);
+		front_ = prev & index_mask;
+		consumed_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	//
+	// consumer: the slot being read ... owned until the next acquire()
+	//
+	T& front() { return slots_[front_]; }
+
+	uint64_t published() const { return published_.load(std::memory_order_relaxed); }
+	uint64_t consumed() const { return consumed_.load(std::memory_order_relaxed); }
+	uint64_t superseded() const { return superseded_.load(std::memory_order_relaxed); }
+
+private:
+
+	Mailbox(Mailbox const&);
+	Mailbox& operator=(Mailbox const&);
+
+	static uint32_t const index_mask = 3;
+	static uint32_t const fresh_bit = 4;
+
+	T slots_[3];
+
+	// index of the middle slot (and whether it holds an unread frame)
+	std::atomic<uint32_t> middle_;
+
+	uint32_t back_;
+	uint32_t front_;
+
+	std::atomic<uint64_t> published_;
+	std::atomic<uint64_t> consumed_;
+	std::atomic<uint64_t> superseded_;
+};
+
+//
+// a lock-free queue of frames from one producer thread to one consumer
+// thread ... unlike Mailbox every published frame is delivered, in order
+//
+// depth frames can be queued, the producer additionally owns the slot it
+// fills (back) and the consumer the slot it is reading (front).  With the
+// queue full publish() fails and the back slot is simply filled again
+// (the frame is counted as dropped).
+//
+template <class T>
+class FrameQueue
+{
+public:
+	FrameQueue(uint32_t depth)
+		: slots_(depth + 2)
+		, depth_(depth)
+		, back_(0)
+		, front_(depth + 1)
+		, head_(0)
+		, tail_(0)
+		, published_(0)
+		, consumed_(0)
+		, dropped_(0)
+	{
+	}
+
+	uint32_t slot_count() const { return static_cast<uint32_t>(slots_.size()); }
+
+	// frames published but not yet taken
+	uint32_t queued() const
+	{
+		return static_cast<uint32_t>(head_.load(std::memory_order_acquire) -
+				tail_.load(std::memory_order_acquire));
+	}
+
+	bool full() const { return queued() >= depth_; }
+
+	//
+	// producer: the slot to fill ... owned until publish() succeeds
+	//
+	T& back() { return slots_[back_]; }
+	uint32_t back_index() const { return back_; }
+
+	//
+	// producer: queue the back slot ... returns false (and keeps the
+	// slot) if the queue is full
+	//
+	bool publish()
+	{
+		auto const head = head_.load(std::memory_order_relaxed);
+		if ((head - tail_.load(std::memory_order_acquire)) >= depth_)
+		{
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		head_.store(head + 1, std::memory_order_release);
+		back_ = static_cast<uint32_t>((head + 1) % slots_.size());
+		published_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	//
+	// consumer: take the oldest queued frame ... returns false
+	// (and keeps the current front) if the queue is empty
+	//
+	bool acquire()
+	{
+		auto const tail = tail_.load(std::memory_order_relaxed);
+		if (tail == head_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		front_ = static_cast<uint32_t>(tail % slots_.size());
+		tail_.store(tail + 1, std::memory_order_release);
+		consumed_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	//
+	// consumer: the frame the next acquire() will take (nullptr if none)
+	//
+	T* peek()
+	{
+		auto const tail = tail_.load(std::memory_order_relaxed);
+		if (tail == head_.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &slots_[tail % slots_.size()];
+	}
+
+	//
+	// consumer: the slot being read ... owned until the next acquire()
+	//
+	T& front() { return slots_[front_]; }
+
+	uint64_t published() const { return published_.load(std::memory_order_relaxed); }
+	uint64_t consumed() const { return consumed_.load(std::memory_order_relaxed); }
+	uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+
+	FrameQueue(FrameQueue const&);
+	FrameQueue& operator=(FrameQueue const&);
+
+	std::vector<T> slots_;
+	uint32_t const depth_;
+
+	uint32_t back_;
+	uint32_t front_;
+
+	// frames [tail, head) are queued
+	std::atomic<uint64_t> head_;
+	std::atomic<uint64_t> tail_;
+
+	std::atomic<uint64_t> published_;
+	std::atomic<uint64_t> consumed_;
+	std::atomic<uint64_t> dropped_;
+};
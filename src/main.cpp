@@ -3,6 +3,8 @@
 
 #include "d3d11.h"
 #include "composition.h"
+#include "frame_pool.h"
+#include "scheduler.h"
 
 #include "resource.h"
 
@@ -24,6 +26,8 @@ class Window;
 // globals .. yuck
 bool show_devtools_ = false;
 std::vector<Window*> windows_;
+std::shared_ptr<FrameScheduler> scheduler_;
+double target_fps_ = 60.0;
 
 
 class Window
@@ -37,6 +41,7 @@ private:
 	int sync_interval_;
 	bool resize_;
 	std::string const json_;
+	uint32_t frame_id_;
 	
 public:
 
@@ -51,6 +56,7 @@ public:
 		, sync_interval_(1)
 		, resize_(false)
 		, json_(json)
+		, frame_id_(0)
 	{
 	}
 
@@ -58,6 +64,11 @@ public:
 		return hwnd_;
 	}
 
+	// our id with the frame scheduler
+	uint32_t frame_id() const {
+		return frame_id_;
+	}
+
 	static Window* open(
 		HINSTANCE instance, std::string const& json, int32_t width, int32_t height)
 	{
@@ -126,6 +137,7 @@ public:
 				SWP_NOMOVE | SWP_NOZORDER);
 
 			windows_.push_back(self);
+			self->frame_id_ = scheduler_->add(target_fps_);
 
 			// make the window visible now that we have D3D11 components ready
 			self->show();
@@ -179,6 +191,7 @@ public:
 
 		// present to window
 		swapchain_->present(sync_interval_);
+		composition_->presented();
 	}
 
 private:
@@ -272,6 +285,10 @@ private:
 				resize_ = true;
 				break;
 
+			case WM_EXITSIZEMOVE:
+				on_exit_size_move();
+				break;
+
 			case WM_DESTROY:
 				PostQuitMessage(0);
 				break;
@@ -288,6 +305,20 @@ private:
 		swapchain_ = device_->create_swapchain(hwnd());
 	}
 
+	//
+	// a drag-resize is done ... buffers left over from the sizes
+	// in between are not likely to be needed again
+	//
+	void on_exit_size_move()
+	{
+		frame_pool()->trim();
+
+		auto const textures = device_->texture_pool();
+		if (textures) {
+			textures->trim();
+		}
+	}
+
 	void on_new_window()
 	{
 		RECT rc;
@@ -399,6 +430,9 @@ int APIENTRY wWinMain(HINSTANCE instance, HINSTANCE, LPWSTR, int)
 				else if (key == "view-source") {
 					view_source = true;
 				}
+				else if (key == "fps") {
+					target_fps_ = to_int(value, 60);
+				}
 			}
 		}
 	}
@@ -497,6 +531,10 @@ int APIENTRY wWinMain(HINSTANCE instance, HINSTANCE, LPWSTR, int)
 		json = builder.str();
 	}
 
+	// each window renders at target_fps_ ... missed frames are skipped
+	scheduler_ = std::make_shared<FrameScheduler>(
+				create_system_clock(), LatePolicy::Drop);
+
 	// create the first top-level window 
 	// (additional can be opened with Ctrl+W)
 	auto const window = Window::open(instance, json, width, height);
@@ -527,11 +565,21 @@ int APIENTRY wWinMain(HINSTANCE instance, HINSTANCE, LPWSTR, int)
 		}
 		else
 		{
+			// sleep until a window is due a frame ... unless
+			// there are messages to handle first
+			if (!scheduler_->wait()) {
+				continue;
+			}
+
 			auto const t = (time_now() - start_time) / 1000000.0;
 			for (auto const& w : windows_) 
 			{
-				w->tick(t);
-				w->render();
+				if (scheduler_->due(w->frame_id()))
+				{
+					w->tick(t);
+					w->render();
+					scheduler_->complete(w->frame_id());
+				}
 			}
 		}
 	}
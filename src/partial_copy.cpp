@@ -0,0 +1,63 @@
+#include "partial_copy.h"
+
+#include <string.h>
+
+using namespace std;
+
+size_t copy_region(
+			uint8_t* dst,
+			uint32_t dst_stride,
+			const uint8_t* src,
+			uint32_t src_stride,
+			int32_t width,
+			int32_t height,
+			Region const& region)
+{
+	if (!dst || !src) {
+		return 0;
+	}
+
+	IntRect const image{ 0, 0, width, height };
+	auto const row_bytes = static_cast<uint32_t>(width) * 4;
+
+	size_t copied = 0;
+	for (auto const& rect : region.rects())
+	{
+		auto const r = rect.intersect(image);
+		if (r.empty()) {
+			continue;
+		}
+
+		auto const cb = static_cast<size_t>(r.width) * 4;
+		auto d = dst + (static_cast<size_t>(r.y) * dst_stride) + (r.x * 4);
+		auto s = src + (static_cast<size_t>(r.y) * src_stride) + (r.x * 4);
+
+		// whole rows with no padding are one block of memory
+		if (r.width == width && dst_stride == row_bytes && src_stride == row_bytes)
+		{
+			memcpy(d, s, cb * r.height);
+		}
+		else
+		{
+			for (int32_t y = 0; y < r.height; ++y)
+			{
+				memcpy(d, s, cb);
+				d += dst_stride;
+				s += src_stride;
+			}
+		}
+		copied += cb * r.height;
+	}
+	return copied;
+}
+
+size_t region_bytes(int32_t width, int32_t height, Region const& region)
+{
+	IntRect const image{ 0, 0, width, height };
+
+	size_t bytes = 0;
+	for (auto const& rect : region.rects()) {
+		bytes += static_cast<size_t>(rect.intersect(image).area()) * 4;
+	}
+	return bytes;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "region.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// copy just the rects of a region between two 32-bit images of
+// the same size (width x height pixels)
+//
+// rects are clipped to the image and rows that are contiguous in
+// both images (full-width rects with matching strides) are coalesced
+// into a single copy.  Returns the number of bytes copied.
+//
+size_t copy_region(
+			uint8_t* dst,
+			uint32_t dst_stride,
+			const uint8_t* src,
+			uint32_t src_stride,
+			int32_t width,
+			int32_t height,
+			Region const& region);
+
+// bytes copy_region() would move (without copying)
+size_t region_bytes(int32_t width, int32_t height, Region const& region);
@@ -0,0 +1,583 @@
+#include "pixels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PIXELS_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define PIXELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+//
+// MSVC allows AVX2 intrinsics in any function ... GCC and clang
+// need the functions using them marked for the target
+//
+#if defined(PIXELS_X86)
+#if defined(_MSC_VER)
+#define PIXELS_AVX2_TARGET
+#else
+#define PIXELS_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+namespace pixels {
+
+	namespace {
+
+		// exact (x / 255) rounded for x in 0..65025
+		inline uint32_t div255(uint32_t x)
+		{
+			x += 128;
+			return (x + (x >> 8)) >> 8;
+		}
+
+		//
+		// unpremultiply factors in both 16-bit halves so SIMD variants
+		// can load one 32-bit value per pixel and unpack it
+		//
+		struct Factors
+		{
+			Factors()
+			{
+				value[0] = 0;
+				for (uint32_t a = 1; a < 256; ++a)
+				{
+					auto const f = ((255 * 256) + (a / 2)) / a;
+					value[a] = f | (f << 16);
+				}
+			}
+			uint32_t value[256];
+		};
+
+		uint32_t const* factors()
+		{
+			static Factors const table;
+			return table.value;
+		}
+
+		//
+		// scalar reference ... the SIMD variants must match these exactly
+		//
+
+		void swizzle_scalar(uint32_t* dst, const uint32_t* src, int count)
+		{
+			for (int n = 0; n < count; ++n)
+			{
+				auto const p = src[n];
+				dst[n] = (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+			}
+		}
+
+		void premultiply_scalar(uint32_t* dst, const uint32_t* src, int count)
+		{
+			for (int n = 0; n < count; ++n)
+			{
+				auto const p = src[n];
+				auto const a = p >> 24;
+				uint32_t out = p & 0xff000000;
+				for (int c = 0; c < 24; c += 8) {
+					out |= div255(((p >> c) & 0xff) * a) << c;
+				}
+				dst[n] = out;
+			}
+		}
+
+		void unpremultiply_scalar(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const table = factors();
+			for (int n = 0; n < count; ++n)
+			{
+				auto const p = src[n];
+				auto const f = table[p >> 24] & 0xffff;
+				uint32_t out = p & 0xff000000;
+				for (int c = 0; c < 24; c += 8)
+				{
+					auto const v = (((p >> c) & 0xff) * f) >> 8;
+					out |= (v > 255 ? 255 : v) << c;
+				}
+				dst[n] = out;
+			}
+		}
+
+		void over_scalar(uint32_t* dst, const uint32_t* src, int count)
+		{
+			for (int n = 0; n < count; ++n)
+			{
+				auto const s = src[n];
+				auto const ia = 255 - (s >> 24);
+				if (ia == 0) {
+					dst[n] = s;
+				}
+				else if (s)
+				{
+					auto const d = dst[n];
+					uint32_t out = 0;
+					for (int c = 0; c < 32; c += 8)
+					{
+						auto const v = ((s >> c) & 0xff) + div255(((d >> c) & 0xff) * ia);
+						out |= (v > 255 ? 255 : v) << c;
+					}
+					dst[n] = out;
+				}
+			}
+		}
+
+		Kernels const scalar_kernels = {
+			Isa::Scalar,
+			swizzle_scalar,
+			premultiply_scalar,
+			unpremultiply_scalar,
+			over_scalar
+		};
+
+#if defined(PIXELS_X86)
+
+		//
+		// SSE2 ... 4 pixels at a time, channels widened to 16 bits
+		//
+
+		// x / 255 rounded for 16-bit lanes holding 0..65025
+		inline __m128i div255_sse2(__m128i x)
+		{
+			x = _mm_add_epi16(x, _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+		}
+
+		void swizzle_sse2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const ga = _mm_set1_epi32(static_cast<int>(0xff00ff00));
+			auto const low = _mm_set1_epi32(0xff);
+			int n = 0;
+			for (; n + 4 <= count; n += 4)
+			{
+				auto const p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+				auto const out = _mm_or_si128(_mm_and_si128(p, ga), _mm_or_si128(
+						_mm_and_si128(_mm_srli_epi32(p, 16), low),
+						_mm_slli_epi32(_mm_and_si128(p, low), 16)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), out);
+			}
+			swizzle_scalar(dst + n, src + n, count - n);
+		}
+
+		void premultiply_sse2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const zero = _mm_setzero_si128();
+			auto const alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+			int n = 0;
+			for (; n + 4 <= count; n += 4)
+			{
+				auto const p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+
+				// alpha replicated into each 16-bit channel lane
+				auto a = _mm_srli_epi32(p, 24);
+				a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+
+				auto const lo = div255_sse2(_mm_mullo_epi16(
+						_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi32(a, a)));
+				auto const hi = div255_sse2(_mm_mullo_epi16(
+						_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi32(a, a)));
+
+				auto const out = _mm_or_si128(
+						_mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi)),
+						_mm_and_si128(p, alpha));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), out);
+			}
+			premultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		void unpremultiply_sse2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const table = factors();
+			auto const zero = _mm_setzero_si128();
+			auto const alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+			auto const k255 = _mm_set1_epi16(255);
+			int n = 0;
+			for (; n + 4 <= count; n += 4)
+			{
+				auto const p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+				auto const f = _mm_set_epi32(
+						static_cast<int>(table[src[n + 3] >> 24]),
+						static_cast<int>(table[src[n + 2] >> 24]),
+						static_cast<int>(table[src[n + 1] >> 24]),
+						static_cast<int>(table[src[n] >> 24]));
+
+				// (c << 8) * f >> 16 == (c * f) >> 8 ... then clamp (unsigned) to 255
+				auto lo = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpacklo_epi8(p, zero), 8),
+						_mm_unpacklo_epi32(f, f));
+				auto hi = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpackhi_epi8(p, zero), 8),
+						_mm_unpackhi_epi32(f, f));
+				lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, k255));
+				hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, k255));
+
+				auto const out = _mm_or_si128(
+						_mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi)),
+						_mm_and_si128(p, alpha));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), out);
+			}
+			unpremultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		void over_sse2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const zero = _mm_setzero_si128();
+			auto const k255 = _mm_set1_epi32(255);
+			int n = 0;
+			for (; n + 4 <= count; n += 4)
+			{
+				auto const s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+
+				// inverse source alpha replicated into each 16-bit channel lane
+				auto ia = _mm_sub_epi32(k255, _mm_srli_epi32(s, 24));
+				ia = _mm_or_si128(ia, _mm_slli_epi32(ia, 16));
+
+				auto const d = _mm_loadu_si128(reinterpret_cast<__m128i*>(dst + n));
+				auto const lo = div255_sse2(
+						_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(ia, ia)));
+				auto const hi = div255_sse2(
+						_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(ia, ia)));
+
+				auto const out = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), out);
+			}
+			over_scalar(dst + n, src + n, count - n);
+		}
+
+		Kernels const sse2_kernels = {
+			Isa::SSE2,
+			swizzle_sse2,
+			premultiply_sse2,
+			unpremultiply_sse2,
+			over_sse2
+		};
+
+		//
+		// AVX2 ... the SSE2 kernels on 8 pixels (unpack and pack both
+		// work within 128-bit lanes so the pixel order is kept)
+		//
+
+		PIXELS_AVX2_TARGET
+		inline __m256i div255_avx2(__m256i x)
+		{
+			x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+			return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+		}
+
+		PIXELS_AVX2_TARGET
+		void swizzle_avx2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const order = _mm256_setr_epi8(
+					2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+					2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto const p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n),
+						_mm256_shuffle_epi8(p, order));
+			}
+			swizzle_scalar(dst + n, src + n, count - n);
+		}
+
+		PIXELS_AVX2_TARGET
+		void premultiply_avx2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const zero = _mm256_setzero_si256();
+			auto const alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto const p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+
+				auto a = _mm256_srli_epi32(p, 24);
+				a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+
+				auto const lo = div255_avx2(_mm256_mullo_epi16(
+						_mm256_unpacklo_epi8(p, zero), _mm256_unpacklo_epi32(a, a)));
+				auto const hi = div255_avx2(_mm256_mullo_epi16(
+						_mm256_unpackhi_epi8(p, zero), _mm256_unpackhi_epi32(a, a)));
+
+				auto const out = _mm256_or_si256(
+						_mm256_andnot_si256(alpha, _mm256_packus_epi16(lo, hi)),
+						_mm256_and_si256(p, alpha));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), out);
+			}
+			premultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		PIXELS_AVX2_TARGET
+		void unpremultiply_avx2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const table = reinterpret_cast<const int*>(factors());
+			auto const zero = _mm256_setzero_si256();
+			auto const alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+			auto const k255 = _mm256_set1_epi16(255);
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto const p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+				auto const f = _mm256_i32gather_epi32(table, _mm256_srli_epi32(p, 24), 4);
+
+				auto lo = _mm256_mulhi_epu16(
+						_mm256_slli_epi16(_mm256_unpacklo_epi8(p, zero), 8),
+						_mm256_unpacklo_epi32(f, f));
+				auto hi = _mm256_mulhi_epu16(
+						_mm256_slli_epi16(_mm256_unpackhi_epi8(p, zero), 8),
+						_mm256_unpackhi_epi32(f, f));
+				lo = _mm256_min_epu16(lo, k255);
+				hi = _mm256_min_epu16(hi, k255);
+
+				auto const out = _mm256_or_si256(
+						_mm256_andnot_si256(alpha, _mm256_packus_epi16(lo, hi)),
+						_mm256_and_si256(p, alpha));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), out);
+			}
+			unpremultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		PIXELS_AVX2_TARGET
+		void over_avx2(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const zero = _mm256_setzero_si256();
+			auto const k255 = _mm256_set1_epi32(255);
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto const s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+
+				auto ia = _mm256_sub_epi32(k255, _mm256_srli_epi32(s, 24));
+				ia = _mm256_or_si256(ia, _mm256_slli_epi32(ia, 16));
+
+				auto const d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(dst + n));
+				auto const lo = div255_avx2(_mm256_mullo_epi16(
+						_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(ia, ia)));
+				auto const hi = div255_avx2(_mm256_mullo_epi16(
+						_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(ia, ia)));
+
+				auto const out = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), out);
+			}
+			over_scalar(dst + n, src + n, count - n);
+		}
+
+		Kernels const avx2_kernels = {
+			Isa::AVX2,
+			swizzle_avx2,
+			premultiply_avx2,
+			unpremultiply_avx2,
+			over_avx2
+		};
+
+		bool cpu_has_avx2()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) {
+				return false;
+			}
+
+			// the OS has to save the YMM registers too
+			__cpuid(info, 1);
+			auto const osxsave = (info[2] & (1 << 27)) != 0;
+			auto const avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || ((_xgetbv(0) & 6) != 6)) {
+				return false;
+			}
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		}
+
+#endif
+
+#if defined(PIXELS_NEON)
+
+		//
+		// NEON ... 8 pixels at a time de-interleaved into channel planes
+		//
+
+		// x / 255 rounded, the same steps as div255()
+		inline uint8x8_t div255_neon(uint16x8_t x) {
+			return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+		}
+
+		void swizzle_neon(uint32_t* dst, const uint32_t* src, int count)
+		{
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto p = vld4_u8(reinterpret_cast<const uint8_t*>(src + n));
+				auto const t = p.val[0];
+				p.val[0] = p.val[2];
+				p.val[2] = t;
+				vst4_u8(reinterpret_cast<uint8_t*>(dst + n), p);
+			}
+			swizzle_scalar(dst + n, src + n, count - n);
+		}
+
+		void premultiply_neon(uint32_t* dst, const uint32_t* src, int count)
+		{
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto p = vld4_u8(reinterpret_cast<const uint8_t*>(src + n));
+				for (int c = 0; c < 3; ++c) {
+					p.val[c] = div255_neon(vmull_u8(p.val[c], p.val[3]));
+				}
+				vst4_u8(reinterpret_cast<uint8_t*>(dst + n), p);
+			}
+			premultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		void unpremultiply_neon(uint32_t* dst, const uint32_t* src, int count)
+		{
+			auto const table = factors();
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				uint16_t f[8];
+				for (int i = 0; i < 8; ++i) {
+					f[i] = static_cast<uint16_t>(table[src[n + i] >> 24]);
+				}
+				auto const factor = vld1q_u16(f);
+
+				auto p = vld4_u8(reinterpret_cast<const uint8_t*>(src + n));
+				for (int c = 0; c < 3; ++c)
+				{
+					auto const v = vmovl_u8(p.val[c]);
+					auto const lo = vqshrn_n_u32(
+							vmull_u16(vget_low_u16(v), vget_low_u16(factor)), 8);
+					auto const hi = vqshrn_n_u32(
+							vmull_u16(vget_high_u16(v), vget_high_u16(factor)), 8);
+					p.val[c] = vqmovn_u16(vcombine_u16(lo, hi));
+				}
+				vst4_u8(reinterpret_cast<uint8_t*>(dst + n), p);
+			}
+			unpremultiply_scalar(dst + n, src + n, count - n);
+		}
+
+		void over_neon(uint32_t* dst, const uint32_t* src, int count)
+		{
+			int n = 0;
+			for (; n + 8 <= count; n += 8)
+			{
+				auto const s = vld4_u8(reinterpret_cast<const uint8_t*>(src + n));
+				auto d = vld4_u8(reinterpret_cast<const uint8_t*>(dst + n));
+				auto const ia = vmvn_u8(s.val[3]);
+				for (int c = 0; c < 4; ++c) {
+					d.val[c] = vqadd_u8(s.val[c], div255_neon(vmull_u8(d.val[c], ia)));
+				}
+				vst4_u8(reinterpret_cast<uint8_t*>(dst + n), d);
+			}
+			over_scalar(dst + n, src + n, count - n);
+		}
+
+		Kernels const neon_kernels = {
+			Isa::NEON,
+			swizzle_neon,
+			premultiply_neon,
+			unpremultiply_neon,
+			over_neon
+		};
+
+#endif
+
+		Kernels const& best_kernels()
+		{
+			static Kernels const* const best = kernels(best_isa());
+			return *best;
+		}
+	}
+
+	char const* to_string(Isa isa)
+	{
+		switch (isa)
+		{
+			case Isa::Scalar: return "scalar";
+			case Isa::SSE2: return "sse2";
+			case Isa::AVX2: return "avx2";
+			case Isa::NEON: return "neon";
+		}
+		return "unknown";
+	}
+
+	bool supported(Isa isa)
+	{
+		return kernels(isa) != nullptr;
+	}
+
+	Isa best_isa()
+	{
+		if (supported(Isa::AVX2)) {
+			return Isa::AVX2;
+		}
+		if (supported(Isa::NEON)) {
+			return Isa::NEON;
+		}
+		if (supported(Isa::SSE2)) {
+			return Isa::SSE2;
+		}
+		return Isa::Scalar;
+	}
+
+	Kernels const* kernels(Isa isa)
+	{
+		switch (isa)
+		{
+			case Isa::Scalar:
+				return &scalar_kernels;
+
+#if defined(PIXELS_X86)
+			// every x64 CPU has SSE2 (and so does anything running Windows 8+)
+			case Isa::SSE2:
+				return &sse2_kernels;
+
+			case Isa::AVX2:
+			{
+				static bool const avx2 = cpu_has_avx2();
+				return avx2 ? &avx2_kernels : nullptr;
+			}
+#endif
+
+#if defined(PIXELS_NEON)
+			case Isa::NEON:
+				return &neon_kernels;
+#endif
+
+			default:
+				return nullptr;
+		}
+	}
+
+	uint16_t unpremultiply_factor(uint8_t a) {
+		return static_cast<uint16_t>(factors()[a]);
+	}
+
+	void swizzle(uint32_t* dst, const uint32_t* src, int count) {
+		best_kernels().swizzle(dst, src, count);
+	}
+
+	void premultiply(uint32_t* dst, const uint32_t* src, int count) {
+		best_kernels().premultiply(dst, src, count);
+	}
+
+	void unpremultiply(uint32_t* dst, const uint32_t* src, int count) {
+		best_kernels().unpremultiply(dst, src, count);
+	}
+
+	void over(uint32_t* dst, const uint32_t* src, int count) {
+		best_kernels().over(dst, src, count);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// row kernels for 32-bit pixels with alpha in the last byte
+// (BGRA from CEF, RGBA from WIC)
+//
+// every kernel has a scalar reference implementation and SIMD variants
+// (SSE2, AVX2, NEON) that produce exactly the same bytes ... the best
+// variant the CPU supports is selected at runtime.  dst may equal src.
+//
+namespace pixels {
+
+	enum class Isa
+	{
+		Scalar,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	struct Kernels
+	{
+		Isa isa;
+
+		// BGRA <-> RGBA (swap the 1st and 3rd byte)
+		void (*swizzle)(uint32_t* dst, const uint32_t* src, int count);
+
+		// c = c * a / 255 (rounded)
+		void (*premultiply)(uint32_t* dst, const uint32_t* src, int count);
+
+		// c = min(255, (c * unpremultiply_factor(a)) >> 8) ... 0 when a is 0
+		void (*unpremultiply)(uint32_t* dst, const uint32_t* src, int count);
+
+		// premultiplied alpha-over: dst = src + dst * (1 - src.a)
+		void (*over)(uint32_t* dst, const uint32_t* src, int count);
+	};
+
+	char const* to_string(Isa isa);
+
+	// is the variant compiled in and supported by this CPU?
+	bool supported(Isa isa);
+
+	// the fastest supported variant
+	Isa best_isa();
+
+	// kernels for a variant (nullptr if not supported)
+	Kernels const* kernels(Isa isa);
+
+	// 255 * 256 / a (rounded) ... the 8.8 fixed-point inverse of alpha
+	uint16_t unpremultiply_factor(uint8_t a);
+
+	//
+	// run the kernels of best_isa()
+	//
+	void swizzle(uint32_t* dst, const uint32_t* src, int count);
+	void premultiply(uint32_t* dst, const uint32_t* src, int count);
+	void unpremultiply(uint32_t* dst, const uint32_t* src, int count);
+	void over(uint32_t* dst, const uint32_t* src, int count);
+}
@@ -0,0 +1,197 @@
+#include "region.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+bool IntRect::contains(IntRect const& r) const
+{
+	return !empty() && !r.empty() &&
+		(r.x >= x) && (r.y >= y) &&
+		(r.x + r.width <= x + width) &&
+		(r.y + r.height <= y + height);
+}
+
+bool IntRect::intersects(IntRect const& r) const
+{
+	return !intersect(r).empty();
+}
+
+IntRect IntRect::intersect(IntRect const& r) const
+{
+	auto const x0 = max(x, r.x);
+	auto const y0 = max(y, r.y);
+	auto const x1 = min(x + width, r.x + r.width);
+	auto const y1 = min(y + height, r.y + r.height);
+	if (x1 <= x0 || y1 <= y0) {
+		return IntRect{ 0, 0, 0, 0 };
+	}
+	return IntRect{ x0, y0, x1 - x0, y1 - y0 };
+}
+
+IntRect IntRect::unite(IntRect const& r) const
+{
+	if (empty()) {
+		return r;
+	}
+	if (r.empty()) {
+		return *this;
+	}
+	auto const x0 = min(x, r.x);
+	auto const y0 = min(y, r.y);
+	auto const x1 = max(x + width, r.x + r.width);
+	auto const y1 = max(y + height, r.y + r.height);
+	return IntRect{ x0, y0, x1 - x0, y1 - y0 };
+}
+
+void subtract(IntRect const& rect, IntRect const& hole, vector<IntRect>& pieces)
+{
+	auto const overlap = rect.intersect(hole);
+	if (overlap.empty()) 
+	{
+		if (!rect.empty()) {
+			pieces.push_back(rect);
+		}
+		return;
+	}
+
+	auto const x1 = rect.x + rect.width;
+	auto const y1 = rect.y + rect.height;
+	auto const ox1 = overlap.x + overlap.width;
+	auto const oy1 = overlap.y + overlap.height;
+
+	// full-width bands above and below ... then the sides of the overlap
+	if (overlap.y > rect.y) {
+		pieces.push_back(IntRect{ rect.x, rect.y, rect.width, overlap.y - rect.y });
+	}
+	if (oy1 < y1) {
+		pieces.push_back(IntRect{ rect.x, oy1, rect.width, y1 - oy1 });
+	}
+	if (overlap.x > rect.x) {
+		pieces.push_back(IntRect{ rect.x, overlap.y, overlap.x - rect.x, overlap.height });
+	}
+	if (ox1 < x1) {
+		pieces.push_back(IntRect{ ox1, overlap.y, x1 - ox1, overlap.height });
+	}
+}
+
+Region::Region(size_t max_rects)
+	: max_rects_(max_rects ? max_rects : 1)
+{
+}
+
+void Region::add(IntRect const& rect)
+{
+	if (rect.empty()) {
+		return;
+	}
+
+	auto merged = rect;
+	for (auto i = rects_.begin(); i != rects_.end(); )
+	{
+		if (i->contains(merged)) {
+			return;
+		}
+
+		// overlapping rects are folded into the new one ...
+		// and we start over since the bounds grew
+		if (merged.contains(*i) || merged.intersects(*i))
+		{
+			merged = merged.unite(*i);
+			rects_.erase(i);
+			i = rects_.begin();
+		}
+		else {
+			++i;
+		}
+	}
+
+	rects_.push_back(merged);
+
+	while (rects_.size() > max_rects_) {
+		merge_closest();
+	}
+}
+
+void Region::add(Region const& other)
+{
+	for (auto const& r : other.rects_) {
+		add(r);
+	}
+}
+
+void Region::clear()
+{
+	rects_.clear();
+}
+
+void Region::clip(int32_t width, int32_t height)
+{
+	IntRect const frame{ 0, 0, width, height };
+	for (auto i = rects_.begin(); i != rects_.end(); )
+	{
+		*i = i->intersect(frame);
+		if (i->empty()) {
+			i = rects_.erase(i);
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+IntRect Region::bounds() const
+{
+	IntRect r{ 0, 0, 0, 0 };
+	for (auto const& i : rects_) {
+		r = r.unite(i);
+	}
+	return r;
+}
+
+int64_t Region::area() const
+{
+	// rects never overlap after add() so the sum is exact
+	int64_t a = 0;
+	for (auto const& r : rects_) {
+		a += r.area();
+	}
+	return a;
+}
+
+//
+// merge the pair of rects whose bounding box adds the least
+// extra (undamaged) area
+//
+void Region::merge_closest()
+{
+	if (rects_.size() < 2) {
+		return;
+	}
+
+	size_t best_a = 0;
+	size_t best_b = 1;
+	auto best_waste = numeric_limits<int64_t>::max();
+	for (size_t a = 0; a < rects_.size(); ++a)
+	{
+		for (size_t b = a + 1; b < rects_.size(); ++b)
+		{
+			auto const waste = rects_[a].unite(rects_[b]).area() -
+					rects_[a].area() - rects_[b].area();
+			if (waste < best_waste)
+			{
+				best_waste = waste;
+				best_a = a;
+				best_b = b;
+			}
+		}
+	}
+
+	auto const merged = rects_[best_a].unite(rects_[best_b]);
+	rects_.erase(rects_.begin() + best_b);
+	rects_.erase(rects_.begin() + best_a);
+
+	// the merged rect may now overlap others
+	add(merged);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// basic rect for integer (pixel) coordinates
+struct IntRect
+{
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+
+	bool empty() const { return (width <= 0) || (height <= 0); }
+	int64_t area() const { return empty() ? 0 : int64_t(width) * height; }
+
+	bool contains(IntRect const& r) const;
+	bool intersects(IntRect const& r) const;
+
+	IntRect intersect(IntRect const& r) const;
+	IntRect unite(IntRect const& r) const;
+};
+
+//
+// append the parts of rect not covered by hole (0 to 4 pieces)
+//
+void subtract(IntRect const& rect, IntRect const& hole, std::vector<IntRect>& pieces);
+
+//
+// a small set of pixel rects describing changed (damaged) areas
+//
+// rects that overlap are merged and the set is capped at max_rects
+// by merging the pair that wastes the least area ... so the region may
+// cover a little more than was actually added, but never less
+//
+class Region
+{
+public:
+	Region(size_t max_rects = 8);
+
+	void add(IntRect const& rect);
+	void add(Region const& other);
+
+	void clear();
+
+	// clip every rect to [0, 0, width, height]
+	void clip(int32_t width, int32_t height);
+
+	bool empty() const { return rects_.empty(); }
+
+	IntRect bounds() const;
+	int64_t area() const;
+
+	std::vector<IntRect> const& rects() const { return rects_; }
+
+private:
+
+	void merge_closest();
+
+	size_t max_rects_;
+	std::vector<IntRect> rects_;
+};
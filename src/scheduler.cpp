@@ -0,0 +1,382 @@
+#if defined(_WIN32)
+#include "platform.h"
+#include <mmsystem.h>
+#endif
+#include "scheduler.h"
+#include "util.h"
+
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+#if defined(_WIN32)
+
+	//
+	// raises the timer resolution to 1ms while alive so short
+	// sleeps are reasonably accurate ... waits also wake when
+	// there are window messages to handle
+	//
+	class SystemClock : public Clock
+	{
+	public:
+		SystemClock() {
+			timeBeginPeriod(1);
+		}
+
+		~SystemClock() {
+			timeEndPeriod(1);
+		}
+
+		int64_t now() override {
+			return static_cast<int64_t>(time_now());
+		}
+
+		bool sleep(int64_t microseconds) override
+		{
+			auto const ms = static_cast<DWORD>(microseconds / 1000);
+			if (!ms) {
+				return true;
+			}
+			auto const ret = MsgWaitForMultipleObjects(0, nullptr, FALSE, ms, QS_ALLINPUT);
+			return (ret == WAIT_TIMEOUT);
+		}
+
+		void relax() override {
+			YieldProcessor();
+		}
+	};
+
+#else
+
+	class SystemClock : public Clock
+	{
+	public:
+		int64_t now() override {
+			return static_cast<int64_t>(time_now());
+		}
+
+		bool sleep(int64_t microseconds) override
+		{
+			this_thread::sleep_for(chrono::microseconds(microseconds));
+			return true;
+		}
+
+		void relax() override {
+			this_thread::yield();
+		}
+	};
+
+#endif
+
+	int64_t to_interval(double fps)
+	{
+		if (fps <= 0.0) {
+			fps = 60.0;
+		}
+		return max<int64_t>(1, static_cast<int64_t>(1000000.0 / fps));
+	}
+
+	// CatchUp never renders more than this many frames behind
+	int64_t const max_catch_up = 4;
+}
+
+shared_ptr<Clock> create_system_clock()
+{
+	return make_shared<SystemClock>();
+}
+
+ManualClock::ManualClock(int64_t oversleep, int64_t spin_step)
+	: now_(0)
+	, oversleep_(oversleep)
+	, spin_step_(max<int64_t>(1, spin_step))
+	, slept_(0)
+	, spun_(0)
+{
+}
+
+int64_t ManualClock::now() {
+	return now_;
+}
+
+bool ManualClock::sleep(int64_t microseconds)
+{
+	if (microseconds > 0)
+	{
+		now_ += microseconds + oversleep_;
+		slept_ += microseconds + oversleep_;
+	}
+	return true;
+}
+
+void ManualClock::relax()
+{
+	now_ += spin_step_;
+	spun_ += spin_step_;
+}
+
+void ManualClock::advance(int64_t microseconds) {
+	now_ += microseconds;
+}
+
+FrameScheduler::FrameScheduler(shared_ptr<Clock> const& clock, LatePolicy policy)
+	: clock_(clock)
+	, policy_(policy)
+	, spin_(2000)
+	, next_id_(1)
+{
+}
+
+uint32_t FrameScheduler::add(double fps)
+{
+	Target target;
+	target.id = next_id_++;
+	target.interval = to_interval(fps);
+	target.deadline = clock_->now();
+	target.stats.frames = 0;
+	target.stats.late = 0;
+	target.stats.dropped = 0;
+	target.stats.max_lateness = 0;
+	targets_.push_back(target);
+	return target.id;
+}
+
+void FrameScheduler::remove(uint32_t id)
+{
+	targets_.erase(remove_if(targets_.begin(), targets_.end(),
+		[id](Target const& t) { return t.id == id; }), targets_.end());
+}
+
+FrameScheduler::Target* FrameScheduler::find(uint32_t id)
+{
+	for (auto& t : targets_)
+	{
+		if (t.id == id) {
+			return &t;
+		}
+	}
+	return nullptr;
+}
+
+FrameScheduler::Target const* FrameScheduler::find(uint32_t id) const
+{
+	for (auto const& t : targets_)
+	{
+		if (t.id == id) {
+			return &t;
+		}
+	}
+	return nullptr;
+}
+
+void FrameScheduler::set_rate(uint32_t id, double fps)
+{
+	auto const target = find(id);
+	if (target)
+	{
+		// keep the current deadline but never wait longer than the new rate
+		target->interval = to_interval(fps);
+		target->deadline = min(target->deadline, clock_->now() + target->interval);
+	}
+}
+
+void FrameScheduler::set_spin(int64_t microseconds) {
+	spin_ = max<int64_t>(0, microseconds);
+}
+
+int64_t FrameScheduler::next_deadline() const
+{
+	int64_t deadline = INT64_MAX;
+	for (auto const& t : targets_) {
+		deadline = min(deadline, t.deadline);
+	}
+	return deadline;
+}
+
+bool FrameScheduler::wait()
+{
+	if (targets_.empty()) {
+		return clock_->sleep(spin_ > 0 ? spin_ : 1000);
+	}
+
+	auto const deadline = next_deadline();
+	for (;;)
+	{
+		auto const remaining = deadline - clock_->now();
+		if (remaining <= 0) {
+			return true;
+		}
+
+		//
+		// sleep for most of it ... spin for the rest.  OS sleeps come in
+		// whole milliseconds, so less than one more than the spin is spun
+		// too (a shorter sleep would return at once and leave us spinning
+		// without relax())
+		//
+		auto const sleep = ((remaining - spin_) / 1000) * 1000;
+		if (sleep > 0)
+		{
+			if (!clock_->sleep(sleep)) {
+				return false;
+			}
+		}
+		else {
+			clock_->relax();
+		}
+	}
+}
+
+bool FrameScheduler::due(uint32_t id) const
+{
+	auto const target = find(id);
+	return target && (clock_->now() >= target->deadline);
+}
+
+void FrameScheduler::complete(uint32_t id)
+{
+	auto const target = find(id);
+	if (!target) {
+		return;
+	}
+
+	auto const now = clock_->now();
+	auto& stats = target->stats;
+	stats.frames++;
+	stats.max_lateness = max(stats.max_lateness, now - target->deadline);
+
+	auto next = target->deadline + target->interval;
+	if (next <= now)
+	{
+		// missed (at least) the following deadline
+		stats.late++;
+
+		auto const missed = (now - target->deadline) / target->interval;
+		switch (policy_)
+		{
+			case LatePolicy::Drop:
+				stats.dropped += missed;
+				next = target->deadline + ((missed + 1) * target->interval);
+				break;
+
+			case LatePolicy::CatchUp:
+				if (missed > max_catch_up)
+				{
+					stats.dropped += missed - max_catch_up;
+					next = now - (max_catch_up * target->interval);
+				}
+				break;
+
+			case LatePolicy::Slip:
+				stats.dropped += missed;
+				next = now + target->interval;
+				break;
+		}
+	}
+	target->deadline = next;
+}
+
+FrameScheduler::Stats FrameScheduler::stats(uint32_t id) const
+{
+	auto const target = find(id);
+	if (target) {
+		return target->stats;
+	}
+	Stats const none = { 0, 0, 0, 0 };
+	return none;
+}
+
+BeginFramePacer::BeginFramePacer(double rate, int64_t timeout)
+	: cadence_(rate)
+	, timeout_(timeout)
+	, sent_at_(0)
+	, outstanding_(false)
+{
+	stats_.sent = 0;
+	stats_.painted = 0;
+	stats_.timeouts = 0;
+	stats_.throttled = 0;
+	stats_.blocked = 0;
+}
+
+double BeginFramePacer::rate() const
+{
+	lock_guard<mutex> guard(lock_);
+	return cadence_.rate();
+}
+
+void BeginFramePacer::set_rate(double rate)
+{
+	lock_guard<mutex> guard(lock_);
+	cadence_.set_rate(rate);
+}
+
+bool BeginFramePacer::begin(int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	if (outstanding_)
+	{
+		if ((now - sent_at_) < timeout_)
+		{
+			stats_.blocked++;
+			return false;
+		}
+		stats_.timeouts++;
+		outstanding_ = false;
+	}
+
+	if (!cadence_.due(now))
+	{
+		stats_.throttled++;
+		return false;
+	}
+
+	sent_at_ = now;
+	outstanding_ = true;
+	stats_.sent++;
+	return true;
+}
+
+void BeginFramePacer::painted(int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	if (outstanding_)
+	{
+		begin_to_paint_.record(now - sent_at_);
+		outstanding_ = false;
+		stats_.painted++;
+	}
+}
+
+void BeginFramePacer::restart()
+{
+	lock_guard<mutex> guard(lock_);
+	outstanding_ = false;
+	cadence_.restart();
+}
+
+void BeginFramePacer::reset(double rate, int64_t timeout)
+{
+	{
+		lock_guard<mutex> guard(lock_);
+		timeout_ = timeout;
+		outstanding_ = false;
+		stats_.sent = 0;
+		stats_.painted = 0;
+		stats_.timeouts = 0;
+		stats_.throttled = 0;
+		stats_.blocked = 0;
+		begin_to_paint_.reset();
+	}
+	set_rate(rate);
+}
+
+BeginFramePacer::Stats BeginFramePacer::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	auto stats = stats_;
+	stats.begin_to_paint = begin_to_paint_.summary();
+	return stats;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// time source (and way to wait) used by FrameScheduler ...
+// abstracted so scheduling can be tested and benchmarked headless
+//
+class Clock
+{
+public:
+	virtual ~Clock() {}
+
+	// current time in microseconds
+	virtual int64_t now() = 0;
+
+	// block for up to the given time ... returns false if woken
+	// early because there is other work (e.g. window messages)
+	virtual bool sleep(int64_t microseconds) = 0;
+
+	// called between checks while spinning out the end of a wait
+	virtual void relax() = 0;
+};
+
+// the real clock (high-resolution timer)
+std::shared_ptr<Clock> create_system_clock();
+
+//
+// a clock that only moves when advanced (or when a wait sleeps or spins)
+//
+// sleeps can be made to overshoot to model an imprecise OS timer.
+// Time spent sleeping and spinning is totalled so CPU use of a
+// scheduling strategy can be measured.
+//
+class ManualClock : public Clock
+{
+public:
+	ManualClock(int64_t oversleep, int64_t spin_step);
+
+	int64_t now() override;
+	bool sleep(int64_t microseconds) override;
+	void relax() override;
+
+	void advance(int64_t microseconds);
+
+	int64_t slept() const { return slept_; }
+	int64_t spun() const { return spun_; }
+
+private:
+	int64_t now_;
+	int64_t const oversleep_;
+	int64_t const spin_step_;
+	int64_t slept_;
+	int64_t spun_;
+};
+
+//
+// what to do when a frame finishes after the next deadline has passed
+//
+enum class LatePolicy
+{
+	// skip the missed deadlines and stay on the original cadence
+	Drop,
+
+	// render the missed frames back-to-back (up to a limit)
+	CatchUp,
+
+	// restart the cadence from when the late frame finished
+	Slip
+};
+
+//
+// schedules frames for 1-N targets (e.g. windows) with their own rates
+//
+// waits are a hybrid: sleep until shortly before the earliest deadline
+// (OS sleeps are imprecise) then spin out the remainder.
+//
+// usage:
+//
+//   while (scheduler.wait()) {
+//      for each target: if (scheduler.due(id)) { render(); scheduler.complete(id); }
+//   }
+//
+// note: not thread-safe
+//
+class FrameScheduler
+{
+public:
+
+	struct Stats
+	{
+		uint64_t frames;
+		uint64_t late;
+		uint64_t dropped;
+		int64_t max_lateness;
+	};
+
+	FrameScheduler(std::shared_ptr<Clock> const& clock, LatePolicy policy);
+
+	// add a target ... its first frame is due immediately
+	uint32_t add(double fps);
+	void remove(uint32_t id);
+
+	void set_rate(uint32_t id, double fps);
+
+	// how long before a deadline to stop sleeping and spin instead
+	void set_spin(int64_t microseconds);
+
+	// the earliest deadline (INT64_MAX if there are no targets)
+	int64_t next_deadline() const;
+
+	// wait for the earliest deadline ... false if the clock was woken early
+	bool wait();
+
+	bool due(uint32_t id) const;
+
+	// a frame was produced for the target ... schedule the next one
+	void complete(uint32_t id);
+
+	Stats stats(uint32_t id) const;
+
+	std::shared_ptr<Clock> const& clock() const { return clock_; }
+
+private:
+
+	struct Target
+	{
+		uint32_t id;
+		int64_t interval;
+		int64_t deadline;
+		Stats stats;
+	};
+
+	Target* find(uint32_t id);
+	Target const* find(uint32_t id) const;
+
+	std::shared_ptr<Clock> const clock_;
+	LatePolicy const policy_;
+	int64_t spin_;
+	uint32_t next_id_;
+	std::vector<Target> targets_;
+};
+
+//
+// decides when to ask a browser for a frame (SendExternalBeginFrame)
+//
+// at most rate frames per second (0 = whenever asked) and never while
+// one is outstanding: a BeginFrame is outstanding until the browser
+// paints or timeout (microseconds) passes ... a page with nothing new
+// to draw doesn't paint at all.
+//
+// begin() is called from the composition tick and painted() from the
+// browser's paint callbacks (another thread)
+//
+class BeginFramePacer
+{
+public:
+
+	struct Stats
+	{
+		uint64_t sent;			// BeginFrames sent
+		uint64_t painted;		// ... answered by a paint
+		uint64_t timeouts;		// ... that never were
+		uint64_t throttled;		// ticks skipped to keep to the rate
+		uint64_t blocked;		// ticks skipped while a frame was outstanding
+		Histogram::Summary begin_to_paint;
+	};
+
+	BeginFramePacer(double rate, int64_t timeout);
+
+	double rate() const;
+	void set_rate(double rate);
+
+	// should a BeginFrame be sent now? ... if so it is outstanding
+	bool begin(int64_t now);
+
+	// the browser painted
+	void painted(int64_t now);
+
+	// forget the outstanding frame and the cadence (e.g. after the browser was hidden)
+	void restart();
+
+	// start over with a new rate and timeout ... stats too (e.g. a recycled browser)
+	void reset(double rate, int64_t timeout);
+
+	Stats stats() const;
+
+private:
+
+	mutable std::mutex lock_;
+	Cadence cadence_;
+	int64_t timeout_;
+	int64_t sent_at_;
+	bool outstanding_;
+	Stats stats_;
+	Histogram begin_to_paint_;
+};
@@ -0,0 +1,386 @@
+#include "soft.h"
+#include "pixels.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SOFT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace soft {
+
+	namespace {
+
+		//
+		// pixel rows are 64-byte aligned so the SIMD kernels
+		// never straddle a cache line at the start of a row
+		//
+		shared_ptr<uint8_t> alloc_pixels(size_t cb)
+		{
+			if (!cb) {
+				return nullptr;
+			}
+#if defined(_MSC_VER)
+			return shared_ptr<uint8_t>(
+				reinterpret_cast<uint8_t*>(_aligned_malloc(cb, 64)), _aligned_free);
+#else
+			void* p = nullptr;
+			if (posix_memalign(&p, 64, cb) != 0) {
+				return nullptr;
+			}
+			return shared_ptr<uint8_t>(reinterpret_cast<uint8_t*>(p), free);
+#endif
+		}
+
+		inline uint8_t to_byte(float v)
+		{
+			if (v <= 0.0f) {
+				return 0;
+			}
+			if (v >= 1.0f) {
+				return 255;
+			}
+			return static_cast<uint8_t>(v * 255.0f + 0.5f);
+		}
+
+		inline uint32_t sample_pixel(
+				const uint32_t* top,
+				const uint32_t* bottom,
+				int x0,
+				int x1,
+				uint32_t fx,
+				uint32_t fy)
+		{
+			uint32_t out = 0;
+			for (int c = 0; c < 32; c += 8)
+			{
+				auto const v0 = (((top[x0] >> c) & 0xff) * (256 - fy) +
+						((bottom[x0] >> c) & 0xff) * fy) >> 8;
+				auto const v1 = (((top[x1] >> c) & 0xff) * (256 - fy) +
+						((bottom[x1] >> c) & 0xff) * fy) >> 8;
+				out |= (((v0 * (256 - fx)) + (v1 * fx)) >> 8) << c;
+			}
+			return out;
+		}
+
+		// resolve a 16.16 source coordinate to a texel pair + weight (clamped)
+		inline void resolve(int64_t pos, int size, int& i0, int& i1, uint32_t& f)
+		{
+			if (pos <= 0)
+			{
+				i0 = 0;
+				f = 0;
+			}
+			else
+			{
+				i0 = static_cast<int>(pos >> 16);
+				f = static_cast<uint32_t>((pos >> 8) & 0xff);
+				if (i0 >= size - 1)
+				{
+					i0 = size - 1;
+					f = 0;
+				}
+			}
+			i1 = (i0 + 1 < size) ? (i0 + 1) : i0;
+		}
+	}
+
+	Surface::Surface(int width, int height)
+		: width_(width > 0 ? width : 0)
+		, height_(height > 0 ? height : 0)
+		, stride_(static_cast<uint32_t>(width_ * 4))
+		, pixels_(alloc_pixels(static_cast<size_t>(stride_) * height_))
+	{
+	}
+
+	void Surface::clear(float red, float green, float blue, float alpha)
+	{
+		fill(0, 0, width_, height_, red, green, blue, alpha);
+	}
+
+	void Surface::fill(int x, int y, int width, int height,
+			float red, float green, float blue, float alpha)
+	{
+		auto const x0 = max(0, x);
+		auto const y0 = max(0, y);
+		auto const x1 = min(width_, x + width);
+		auto const y1 = min(height_, y + height);
+		if (!pixels_ || x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		uint32_t const color =
+				(to_byte(red)) |
+				(to_byte(green) << 8) |
+				(to_byte(blue) << 16) |
+				(static_cast<uint32_t>(to_byte(alpha)) << 24);
+
+		auto const first = row(y0) + x0;
+		for (int n = 0; n < (x1 - x0); ++n) {
+			first[n] = color;
+		}
+		for (int j = y0 + 1; j < y1; ++j) {
+			memcpy(row(j) + x0, first, (x1 - x0) * 4);
+		}
+	}
+
+	void Surface::copy_from(const void* buffer, uint32_t stride, uint32_t rows)
+	{
+		if (!buffer || !pixels_) {
+			return;
+		}
+
+		auto const src = reinterpret_cast<const uint8_t*>(buffer);
+		auto const cb = stride < stride_ ? stride : stride_;
+		auto const count = rows < uint32_t(height_) ? rows : uint32_t(height_);
+		if (stride == stride_) {
+			memcpy(pixels_.get(), src, stride_ * count);
+		}
+		else
+		{
+			for (uint32_t y = 0; y < count; ++y) {
+				memcpy(row(y), src + (y * stride), cb);
+			}
+		}
+	}
+
+
+	Context::Context(shared_ptr<Surface> const& target)
+		: target_(target)
+		, clipped_(false)
+		, clip_x0_(0)
+		, clip_y0_(0)
+		, clip_x1_(0)
+		, clip_y1_(0)
+	{
+	}
+
+	int Context::width() const
+	{
+		return target_ ? target_->width() : 0;
+	}
+
+	int Context::height() const
+	{
+		return target_ ? target_->height() : 0;
+	}
+
+	void Context::resize(int width, int height)
+	{
+		if (width <= 0 || height <= 0) {
+			return;
+		}
+		if (!target_ || target_->width() != width || target_->height() != height) {
+			target_ = make_shared<Surface>(width, height);
+		}
+	}
+
+	void Context::set_clip(int x, int y, int width, int height)
+	{
+		clipped_ = true;
+		clip_x0_ = x;
+		clip_y0_ = y;
+		clip_x1_ = x + width;
+		clip_y1_ = y + height;
+	}
+
+	void Context::reset_clip()
+	{
+		clipped_ = false;
+	}
+
+	void Context::clear(float red, float green, float blue, float alpha)
+	{
+		if (!target_) {
+			return;
+		}
+		if (clipped_) 
+		{
+			target_->fill(clip_x0_, clip_y0_, 
+				clip_x1_ - clip_x0_, clip_y1_ - clip_y0_, red, green, blue, alpha);
+		}
+		else {
+			target_->clear(red, green, blue, alpha);
+		}
+	}
+
+	void Context::draw(
+			shared_ptr<Surface> const& source,
+			float x, float y, float width, float height, bool flip, bool blend)
+	{
+		if (!target_ || !source || !source->data() || !target_->data()) {
+			return;
+		}
+
+		auto const tw = target_->width();
+		auto const th = target_->height();
+		auto const sw = source->width();
+		auto const sh = source->height();
+
+		// destination rect in pixels
+		double const dx = x * double(tw);
+		double const dy = y * double(th);
+		double const dw = width * double(tw);
+		double const dh = height * double(th);
+		if (dw <= 0.0 || dh <= 0.0) {
+			return;
+		}
+
+		// pixels whose centers fall within the rect (top-left fill rule)
+		auto x0 = max(0, static_cast<int>(ceil(dx - 0.5)));
+		auto x1 = min(tw, static_cast<int>(ceil(dx + dw - 0.5)));
+		auto y0 = max(0, static_cast<int>(ceil(dy - 0.5)));
+		auto y1 = min(th, static_cast<int>(ceil(dy + dh - 0.5)));
+		if (clipped_)
+		{
+			x0 = max(x0, clip_x0_);
+			x1 = min(x1, clip_x1_);
+			y0 = max(y0, clip_y0_);
+			y1 = min(y1, clip_y1_);
+		}
+		if (x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		auto const count = x1 - x0;
+
+		// a 1:1 mapping on whole pixels needs no filtering at all
+		if (sw == static_cast<int>(dw) && sh == static_cast<int>(dh) &&
+			 dw == floor(dw) && dh == floor(dh) &&
+			 dx == floor(dx) && dy == floor(dy))
+		{
+			auto const ox = static_cast<int>(dx);
+			auto const oy = static_cast<int>(dy);
+			for (int j = y0; j < y1; ++j)
+			{
+				auto const sy = flip ? (sh - 1 - (j - oy)) : (j - oy);
+				if (blend) {
+					blend_row(target_->row(j) + x0, source->row(sy) + (x0 - ox), count);
+				}
+				else {
+					memcpy(target_->row(j) + x0, source->row(sy) + (x0 - ox), count * 4);
+				}
+			}
+			return;
+		}
+
+		if (scratch_.size() < size_t(count)) {
+			scratch_.resize(count);
+		}
+
+		// texel position (16.16) of the first destination pixel and the step
+		double const scale_x = sw / dw;
+		double const scale_y = sh / dh;
+		auto const step = static_cast<int64_t>(scale_x * 65536.0);
+		auto const start = static_cast<int64_t>(
+				(((x0 + 0.5) - dx) * scale_x - 0.5) * 65536.0);
+
+		for (int j = y0; j < y1; ++j)
+		{
+			auto sy = ((j + 0.5) - dy) * scale_y - 0.5;
+			if (flip) {
+				sy = (sh - 1) - sy;
+			}
+
+			int r0, r1;
+			uint32_t fy;
+			resolve(static_cast<int64_t>(sy * 65536.0), sh, r0, r1, fy);
+
+			if (blend)
+			{
+				sample_row(scratch_.data(),
+					source->row(r0), source->row(r1), sw, start, step, fy, count);
+				blend_row(target_->row(j) + x0, scratch_.data(), count);
+			}
+			else
+			{
+				sample_row(target_->row(j) + x0,
+					source->row(r0), source->row(r1), sw, start, step, fy, count);
+			}
+		}
+	}
+
+	shared_ptr<Surface> create_surface(
+			int width,
+			int height,
+			const void* data,
+			size_t row_stride)
+	{
+		if (width <= 0 || height <= 0) {
+			return nullptr;
+		}
+
+		auto const surface = make_shared<Surface>(width, height);
+		if (!surface->data()) {
+			return nullptr;
+		}
+
+		if (data) {
+			surface->copy_from(data, static_cast<uint32_t>(row_stride), height);
+		}
+		else {
+			surface->clear(0.0f, 0.0f, 0.0f, 0.0f);
+		}
+		return surface;
+	}
+
+	void blend_row(uint32_t* dst, const uint32_t* src, int count)
+	{
+		pixels::over(dst, src, count);
+	}
+
+	void sample_row(
+			uint32_t* dst,
+			const uint32_t* top,
+			const uint32_t* bottom,
+			int src_width,
+			int64_t x,
+			int64_t dx,
+			uint32_t fy,
+			int count)
+	{
+#if defined(SOFT_SSE2)
+		auto const zero = _mm_setzero_si128();
+		auto const wy0 = _mm_set1_epi16(static_cast<short>(256 - fy));
+		auto const wy1 = _mm_set1_epi16(static_cast<short>(fy));
+		for (int n = 0; n < count; ++n, x += dx)
+		{
+			int i0, i1;
+			uint32_t fx;
+			resolve(x, src_width, i0, i1, fx);
+
+			// [p0 p1] for both rows as 16-bit channels
+			auto const t = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+					_mm_cvtsi32_si128(top[i0]), _mm_cvtsi32_si128(top[i1])), zero);
+			auto const b = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+					_mm_cvtsi32_si128(bottom[i0]), _mm_cvtsi32_si128(bottom[i1])), zero);
+
+			auto const v = _mm_srli_epi16(_mm_add_epi16(
+					_mm_mullo_epi16(t, wy0), _mm_mullo_epi16(b, wy1)), 8);
+
+			auto const wx = _mm_unpacklo_epi64(
+					_mm_set1_epi16(static_cast<short>(256 - fx)),
+					_mm_set1_epi16(static_cast<short>(fx)));
+			auto h = _mm_mullo_epi16(v, wx);
+			h = _mm_srli_epi16(_mm_add_epi16(h, _mm_srli_si128(h, 8)), 8);
+
+			dst[n] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(h, zero)));
+		}
+#else
+		for (int n = 0; n < count; ++n, x += dx)
+		{
+			int i0, i1;
+			uint32_t fx;
+			resolve(x, src_width, i0, i1, fx);
+			dst[n] = sample_pixel(top, bottom, i0, i1, fx, fy);
+		}
+#endif
+	}
+}
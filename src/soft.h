@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+//
+// a small software (CPU) rendering backend that mirrors the parts of
+// d3d11.h used by the composition ... so layers can be composed headless
+// (e.g. for profiling or on machines without a GPU)
+//
+namespace soft {
+
+	class Surface;
+	class Context;
+
+	//
+	// a 32-bit image in CPU memory with premultiplied alpha in the
+	// last byte of each pixel (e.g. RGBA or BGRA ... the blend does not
+	// care as long as all surfaces in a composition agree)
+	//
+	class Surface
+	{
+	public:
+		Surface(int width, int height);
+
+		int width() const { return width_; }
+		int height() const { return height_; }
+		uint32_t stride() const { return stride_; }
+
+		uint8_t* data() { return pixels_.get(); }
+		const uint8_t* data() const { return pixels_.get(); }
+
+		uint32_t* row(int y) {
+			return reinterpret_cast<uint32_t*>(pixels_.get() + (y * stride_));
+		}
+		const uint32_t* row(int y) const {
+			return reinterpret_cast<const uint32_t*>(pixels_.get() + (y * stride_));
+		}
+
+		void clear(float red, float green, float blue, float alpha);
+
+		void fill(int x, int y, int width, int height,
+				float red, float green, float blue, float alpha);
+
+		void copy_from(const void* buffer, uint32_t stride, uint32_t rows);
+
+	private:
+
+		int const width_;
+		int const height_;
+		uint32_t const stride_;
+		std::shared_ptr<uint8_t> const pixels_;
+	};
+
+	//
+	// a render target for the software backend
+	//
+	class Context
+	{
+	public:
+		Context(std::shared_ptr<Surface> const& target);
+
+		std::shared_ptr<Surface> target() const { return target_; }
+
+		int width() const;
+		int height() const;
+
+		void resize(int width, int height);
+
+		//
+		// limit clear() and draw() to a rectangle of target pixels
+		// (used by the composition to only redraw damaged areas)
+		//
+		void set_clip(int x, int y, int width, int height);
+		void reset_clip();
+
+		void clear(float red, float green, float blue, float alpha);
+
+		//
+		// draw a surface into the target using premultiplied-alpha blending
+		// (ONE, INV_SRC_ALPHA) with bilinear filtering ... the rectangle is in
+		// normalized 0..1 units like d3d11::Device::create_quad
+		//
+		// with blend=false the source simply replaces the target (opaque layers)
+		//
+		void draw(
+				std::shared_ptr<Surface> const& source,
+				float x, float y, float width, float height, 
+				bool flip=false, bool blend=true);
+
+	private:
+
+		std::shared_ptr<Surface> target_;
+		std::vector<uint32_t> scratch_;
+		bool clipped_;
+		int clip_x0_;
+		int clip_y0_;
+		int clip_x1_;
+		int clip_y1_;
+	};
+
+	std::shared_ptr<Surface> create_surface(
+				int width,
+				int height,
+				const void* data,
+				size_t row_stride);
+
+	//
+	// low-level row kernels used by Context::draw
+	// (exposed so they can be profiled on their own)
+	//
+
+	// dst = src + dst * (1 - src.a)
+	void blend_row(uint32_t* dst, const uint32_t* src, int count);
+
+	// sample count pixels from rows top/bottom at 16.16 fixed-point
+	// x coordinates [x, x + dx, ...] with vertical weight fy (0..255)
+	void sample_row(
+				uint32_t* dst,
+				const uint32_t* top,
+				const uint32_t* bottom,
+				int src_width,
+				int64_t x,
+				int64_t dx,
+				uint32_t fy,
+				int count);
+}
@@ -0,0 +1,380 @@
+#include "source_dump.h"
+#include "crc32.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+	//
+	// deflate bits go out least-significant first ... Huffman codes are
+	// given most-significant first so they are reversed on the way
+	//
+	class BitWriter
+	{
+	public:
+		BitWriter(vector<uint8_t>& out) : out_(out), bits_(0), count_(0) {}
+
+		void put(uint32_t value, int count)
+		{
+			bits_ |= static_cast<uint64_t>(value) << count_;
+			count_ += count;
+			while (count_ >= 8)
+			{
+				out_.push_back(static_cast<uint8_t>(bits_));
+				bits_ >>= 8;
+				count_ -= 8;
+			}
+		}
+
+		void put_code(uint32_t code, int count)
+		{
+			uint32_t reversed = 0;
+			for (int n = 0; n < count; ++n) {
+				reversed |= ((code >> n) & 1) << (count - 1 - n);
+			}
+			put(reversed, count);
+		}
+
+		void finish()
+		{
+			if (count_ > 0) {
+				out_.push_back(static_cast<uint8_t>(bits_));
+			}
+			bits_ = 0;
+			count_ = 0;
+		}
+
+	private:
+		vector<uint8_t>& out_;
+		uint64_t bits_;
+		int count_;
+	};
+
+	uint16_t const length_base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	uint8_t const length_extra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	uint16_t const distance_base[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	uint8_t const distance_extra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	// the fixed literal / length code (RFC 1951 3.2.6)
+	void put_symbol(BitWriter& out, uint32_t symbol)
+	{
+		if (symbol < 144) {
+			out.put_code(0x30 + symbol, 8);
+		}
+		else if (symbol < 256) {
+			out.put_code(0x190 + (symbol - 144), 9);
+		}
+		else if (symbol < 280) {
+			out.put_code(symbol - 256, 7);
+		}
+		else {
+			out.put_code(0xc0 + (symbol - 280), 8);
+		}
+	}
+
+	void put_match(BitWriter& out, uint32_t length, uint32_t distance)
+	{
+		uint32_t code = 28;
+		while (length < length_base[code]) {
+			--code;
+		}
+		put_symbol(out, 257 + code);
+		out.put(length - length_base[code], length_extra[code]);
+
+		code = 29;
+		while (distance < distance_base[code]) {
+			--code;
+		}
+		out.put_code(code, 5);
+		out.put(distance - distance_base[code], distance_extra[code]);
+	}
+
+	void put_u32_le(vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back(static_cast<uint8_t>(v));
+		out.push_back(static_cast<uint8_t>(v >> 8));
+		out.push_back(static_cast<uint8_t>(v >> 16));
+		out.push_back(static_cast<uint8_t>(v >> 24));
+	}
+}
+
+SourceDumpOptions default_source_dump_options()
+{
+	SourceDumpOptions options;
+	options.depth = 8;
+	options.max_bytes = 16 * 1024 * 1024;
+	options.compress = false;
+	return options;
+}
+
+//
+// greedy LZ77 over a 32K window (hash chains of 3-byte prefixes) with
+// the fixed Huffman code ... markup repeats itself enough that this
+// gets most of what a dynamic code would, for a fraction of the work
+//
+void encode_gzip(const uint8_t* data, size_t size, vector<uint8_t>& gz)
+{
+	int const window = 32768;
+	int const hash_bits = 15;
+	int const max_chain = 16;
+	uint32_t const min_match = 3;
+	uint32_t const max_match = 258;
+
+	gz.clear();
+	gz.reserve(size / 3 + 32);
+
+	// magic, deflate, no flags / time, unknown OS
+	gz.push_back(0x1f);
+	gz.push_back(0x8b);
+	gz.push_back(8);
+	for (int n = 0; n < 6; ++n) {
+		gz.push_back(0);
+	}
+	gz.push_back(0xff);
+
+	BitWriter out(gz);
+	out.put(1, 1);		// last block
+	out.put(1, 2);		// fixed Huffman
+
+	vector<int32_t> head(size_t(1) << hash_bits, -1);
+	vector<int32_t> prev(window, -1);
+
+	auto const hash = [&](size_t i) {
+		auto const v = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+		return (v * 2654435761u) >> (32 - hash_bits);
+	};
+	auto const insert = [&](size_t i) {
+		if (i + min_match <= size)
+		{
+			auto const h = hash(i);
+			prev[i & (window - 1)] = head[h];
+			head[h] = static_cast<int32_t>(i);
+		}
+	};
+
+	size_t i = 0;
+	while (i < size)
+	{
+		uint32_t best_length = 0;
+		uint32_t best_distance = 0;
+		if (i + min_match <= size)
+		{
+			auto const limit = static_cast<uint32_t>(min<size_t>(max_match, size - i));
+			auto candidate = head[hash(i)];
+			for (int chain = 0; chain < max_chain && candidate >= 0; ++chain)
+			{
+				auto const distance = i - static_cast<size_t>(candidate);
+				if (distance > size_t(window - 1)) {
+					break;
+				}
+
+				uint32_t length = 0;
+				auto const a = data + candidate;
+				auto const b = data + i;
+				while (length < limit && a[length] == b[length]) {
+					++length;
+				}
+				if (length > best_length)
+				{
+					best_length = length;
+					best_distance = static_cast<uint32_t>(distance);
+					if (length == limit) {
+						break;
+					}
+				}
+
+				// the ring only holds the window ... stop at a stale entry
+				auto const next = prev[candidate & (window - 1)];
+				if (next >= candidate) {
+					break;
+				}
+				candidate = next;
+			}
+		}
+
+		if (best_length >= min_match)
+		{
+			put_match(out, best_length, best_distance);
+			for (uint32_t n = 0; n < best_length; ++n) {
+				insert(i + n);
+			}
+			i += best_length;
+		}
+		else
+		{
+			put_symbol(out, data[i]);
+			insert(i);
+			++i;
+		}
+	}
+
+	put_symbol(out, 256);
+	out.finish();
+
+	put_u32_le(gz, crc32(0, data, size));
+	put_u32_le(gz, static_cast<uint32_t>(size));
+}
+
+SourceDumper::SourceDumper(SourceDumpOptions const& options)
+	: options_(options)
+	, busy_(false)
+	, stopping_(false)
+{
+	memset(&stats_, 0, sizeof(stats_));
+	worker_ = thread([this]() { run(); });
+}
+
+SourceDumper::~SourceDumper()
+{
+	{
+		lock_guard<mutex> guard(lock_);
+		stopping_ = true;
+	}
+	queued_.notify_all();
+	worker_.join();
+}
+
+bool SourceDumper::submit(string const& path, function<string()> source)
+{
+	if (path.empty() || !source) {
+		return false;
+	}
+
+	{
+		lock_guard<mutex> guard(lock_);
+		stats_.submitted++;
+		if (queue_.size() >= max(1u, options_.depth))
+		{
+			stats_.dropped++;
+			return false;
+		}
+
+		// the source can be large ... it is moved, never copied
+		Job job;
+		job.path = path;
+		job.source = move(source);
+		queue_.push_back(move(job));
+		stats_.max_queued = max(stats_.max_queued, static_cast<uint32_t>(queue_.size()));
+	}
+	queued_.notify_one();
+	return true;
+}
+
+void SourceDumper::flush()
+{
+	unique_lock<mutex> guard(lock_);
+	idle_.wait(guard, [this]() { return queue_.empty() && !busy_; });
+}
+
+SourceDumpStats SourceDumper::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	auto stats = stats_;
+	stats.queued = static_cast<uint32_t>(queue_.size());
+	stats.write = write_.summary();
+	return stats;
+}
+
+void SourceDumper::run()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> guard(lock_);
+			queued_.wait(guard, [this]() { return stopping_ || !queue_.empty(); });
+			if (queue_.empty()) {
+				return;
+			}
+			job = move(queue_.front());
+			queue_.pop_front();
+			busy_ = true;
+		}
+
+		auto const start = time_now();
+		auto const ok = write(job);
+		auto const elapsed = time_now() - start;
+
+		{
+			lock_guard<mutex> guard(lock_);
+			write_.record(static_cast<int64_t>(elapsed));
+			if (ok) {
+				stats_.written++;
+			}
+			else {
+				stats_.failed++;
+			}
+			busy_ = false;
+		}
+		idle_.notify_all();
+	}
+}
+
+bool SourceDumper::write(Job const& job)
+{
+	auto source = job.source();
+
+	auto truncated = false;
+	if (options_.max_bytes && source.size() > options_.max_bytes)
+	{
+		// don't leave half a UTF-8 sequence at the end
+		auto cut = static_cast<size_t>(options_.max_bytes);
+		while (cut > 0 && (static_cast<uint8_t>(source[cut]) & 0xc0) == 0x80) {
+			--cut;
+		}
+		source.resize(cut);
+		truncated = true;
+	}
+
+	auto data = reinterpret_cast<const uint8_t*>(source.data());
+	auto size = source.size();
+
+	vector<uint8_t> gz;
+	auto path = job.path;
+	if (options_.compress)
+	{
+		encode_gzip(data, size, gz);
+		data = gz.data();
+		size = gz.size();
+		path += ".gz";
+	}
+
+	auto const file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		log_message("source dump: could not create %s\n", path.c_str());
+		return false;
+	}
+	auto const written = (fwrite(data, 1, size, file) == size);
+	auto const ok = (fclose(file) == 0) && written;
+
+	if (ok)
+	{
+		lock_guard<mutex> guard(lock_);
+		if (truncated) {
+			stats_.truncated++;
+		}
+		stats_.bytes_in += source.size();
+		stats_.bytes_out += size;
+	}
+	return ok;
+}
+
+shared_ptr<SourceDumper> create_source_dumper(SourceDumpOptions const& options)
+{
+	return make_shared<SourceDumper>(options);
+}
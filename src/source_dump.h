@@ -0,0 +1,110 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SourceDumpOptions
+{
+	uint32_t depth;				// dumps waiting to be written
+	uint64_t max_bytes;			// a larger source is cut to this (0 = no cap)
+	bool compress;				// gzip the file (".gz" is appended)
+};
+
+SourceDumpOptions default_source_dump_options();
+
+//
+// source dump counters (write times in microseconds):
+//
+//   submitted  - dumps handed over
+//   dropped    - dumps lost because the queue was full
+//   truncated  - dumps cut to max_bytes
+//   written    - dumps written out
+//   failed     - dumps that could not be written
+//   bytes_in   - source bytes written (after truncation)
+//   bytes_out  - file bytes written (after compression)
+//   queued     - dumps waiting right now (max_queued at most)
+//   write      - convert + compress + write time of a dump
+//
+struct SourceDumpStats
+{
+	uint64_t submitted;
+	uint64_t dropped;
+	uint64_t truncated;
+	uint64_t written;
+	uint64_t failed;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint32_t queued;
+	uint32_t max_queued;
+	Histogram::Summary write;
+};
+
+//
+// page sources (view_source) written by a background thread
+//
+// submit() never touches the disk ... it queues the job and returns so
+// the caller (the CEF UI thread, which also delivers paints) is never
+// held up by a large DOM.  The source itself is produced on the writer
+// thread too (e.g. the UTF-16 to UTF-8 conversion).  The queue is
+// bounded by depth and a dump that doesn't fit is dropped.  Destroying
+// the dumper writes out whatever is still queued.
+//
+class SourceDumper
+{
+public:
+	SourceDumper(SourceDumpOptions const& options);
+	~SourceDumper();
+
+	SourceDumpOptions const& options() const { return options_; }
+
+	//
+	// queue source() to be written to path ... returns false if it was
+	// dropped
+	//
+	bool submit(std::string const& path, std::function<std::string()> source);
+
+	// wait until everything queued has been written
+	void flush();
+
+	SourceDumpStats stats() const;
+
+private:
+
+	struct Job
+	{
+		std::string path;
+		std::function<std::string()> source;
+	};
+
+	SourceDumper(SourceDumper const&);
+	SourceDumper& operator=(SourceDumper const&);
+
+	void run();
+	bool write(Job const& job);
+
+	SourceDumpOptions const options_;
+
+	mutable std::mutex lock_;
+	std::condition_variable queued_;
+	std::condition_variable idle_;
+	std::deque<Job> queue_;
+	std::thread worker_;
+	bool busy_;
+	bool stopping_;
+	SourceDumpStats stats_;
+	Histogram write_;
+};
+
+std::shared_ptr<SourceDumper> create_source_dumper(SourceDumpOptions const& options);
+
+// a gzip member (single fixed-Huffman deflate block) holding data
+void encode_gzip(const uint8_t* data, size_t size, std::vector<uint8_t>& gz);
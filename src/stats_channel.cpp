@@ -0,0 +1,169 @@
+#include "stats_channel.h"
+
+using namespace std;
+
+StatValue stat_bool(bool value)
+{
+	StatValue v;
+	v.type = StatValue::Bool;
+	v.number = value ? 1.0 : 0.0;
+	return v;
+}
+
+StatValue stat_int(int64_t value)
+{
+	StatValue v;
+	v.type = StatValue::Int;
+	v.number = static_cast<double>(value);
+	return v;
+}
+
+StatValue stat_double(double value)
+{
+	StatValue v;
+	v.type = StatValue::Double;
+	v.number = value;
+	return v;
+}
+
+StatValue stat_string(string const& value)
+{
+	StatValue v;
+	v.type = StatValue::String;
+	v.number = 0.0;
+	v.text = value;
+	return v;
+}
+
+bool operator==(StatValue const& a, StatValue const& b)
+{
+	return (a.type == b.type) && (a.number == b.number) && (a.text == b.text);
+}
+
+bool operator!=(StatValue const& a, StatValue const& b)
+{
+	return !(a == b);
+}
+
+string stat_path(string const& a, string const& b)
+{
+	return a + stat_path_separator + b;
+}
+
+string stat_path(string const& a, string const& b, string const& c)
+{
+	return stat_path(stat_path(a, b), c);
+}
+
+StatsEncoder::StatsEncoder(double rate, uint32_t keyframe_interval)
+	: cadence_(rate)
+	, keyframe_interval_(keyframe_interval ? keyframe_interval : 1)
+	, sequence_(0)
+	, since_keyframe_(0)
+	, keyframe_(true)
+{
+	stats_.messages = 0;
+	stats_.keyframes = 0;
+	stats_.values = 0;
+	stats_.unchanged = 0;
+	stats_.throttled = 0;
+}
+
+bool StatsEncoder::due(int64_t now)
+{
+	if (!cadence_.due(now))
+	{
+		stats_.throttled++;
+		return false;
+	}
+	return true;
+}
+
+bool StatsEncoder::encode(StatMap const& current, StatsDelta& delta)
+{
+	delta.values.clear();
+
+	// a stat that went away can only be dropped by a keyframe
+	auto keyframe = keyframe_ || (since_keyframe_ >= keyframe_interval_);
+	if (!keyframe)
+	{
+		for (auto const& s : sent_)
+		{
+			if (current.find(s.first) == current.end())
+			{
+				keyframe = true;
+				break;
+			}
+		}
+	}
+
+	if (keyframe)
+	{
+		delta.values.assign(current.begin(), current.end());
+		since_keyframe_ = 0;
+		keyframe_ = false;
+		stats_.keyframes++;
+	}
+	else
+	{
+		// both maps are sorted by path ... walk them together
+		auto s = sent_.begin();
+		for (auto const& c : current)
+		{
+			while (s != sent_.end() && s->first < c.first) {
+				++s;
+			}
+			if (s != sent_.end() && s->first == c.first && s->second == c.second) {
+				stats_.unchanged++;
+			}
+			else {
+				delta.values.push_back(c);
+			}
+		}
+
+		if (delta.values.empty()) {
+			return false;
+		}
+	}
+
+	sent_ = current;
+	delta.sequence = ++sequence_;
+	delta.keyframe = keyframe;
+	since_keyframe_++;
+	stats_.messages++;
+	stats_.values += delta.values.size();
+	return true;
+}
+
+void StatsEncoder::reset()
+{
+	cadence_.restart();
+	sent_.clear();
+	keyframe_ = true;
+}
+
+StatsDecoder::StatsDecoder()
+	: sequence_(0)
+	, synced_(false)
+{
+}
+
+bool StatsDecoder::apply(StatsDelta const& delta)
+{
+	if (delta.keyframe)
+	{
+		values_.clear();
+		synced_ = true;
+	}
+	else if (!synced_ || (delta.sequence != sequence_ + 1))
+	{
+		synced_ = false;
+		return false;
+	}
+
+	for (auto const& v : delta.values) {
+		values_[v.first] = v.second;
+	}
+	sequence_ = delta.sequence;
+	return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "timing.h"
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//
+// a single statistic ... ints and bools are kept as numbers too so a
+// value compares the same however it was set
+//
+struct StatValue
+{
+	enum Type
+	{
+		Bool,
+		Int,
+		Double,
+		String
+	};
+
+	Type type;
+	double number;
+	std::string text;
+};
+
+StatValue stat_bool(bool value);
+StatValue stat_int(int64_t value);
+StatValue stat_double(double value);
+StatValue stat_string(std::string const& value);
+
+bool operator==(StatValue const& a, StatValue const& b);
+bool operator!=(StatValue const& a, StatValue const& b);
+
+//
+// statistics by path ... each step of a path nests an object for the
+// page (e.g. "fps" or stat_path("layers", "0", "fps")).  The steps are
+// joined by stat_path_separator so names (urls) can hold anything printable.
+//
+typedef std::map<std::string, StatValue> StatMap;
+
+char const stat_path_separator = '\x1f';
+
+std::string stat_path(std::string const& a, std::string const& b);
+std::string stat_path(std::string const& a, std::string const& b, std::string const& c);
+
+// messages a second to a page and how often one is a keyframe
+double const default_stats_rate = 10.0;
+uint32_t const default_stats_keyframe_interval = 50;
+
+//
+// one message of the stats channel: the values that changed since the
+// last message ... or all of them for a keyframe (anything not in a
+// keyframe is gone)
+//
+struct StatsDelta
+{
+	uint64_t sequence;
+	bool keyframe;
+	std::vector<std::pair<std::string, StatValue>> values;
+};
+
+//
+// the browser side of the stats channel
+//
+// the owner asks due() every tick and only collects the stats when it
+// is ... at most rate messages a second go out, with only what changed
+// since the last one.  A keyframe goes out first, after reset() (e.g. a
+// page subscribed again), every keyframe_interval messages and whenever
+// a stat disappeared.
+//
+// note: not thread-safe
+//
+class StatsEncoder
+{
+public:
+	struct Stats
+	{
+		uint64_t messages;			// messages encoded
+		uint64_t keyframes;			// ... that were keyframes
+		uint64_t values;			// values sent
+		uint64_t unchanged;			// values left out of a delta
+		uint64_t throttled;			// calls to due() that said no
+	};
+
+	StatsEncoder(double rate, uint32_t keyframe_interval);
+
+	double rate() const { return cadence_.rate(); }
+
+	// is it time to collect and encode again? (rate 0 = always)
+	bool due(int64_t now);
+
+	// the changes since the last message ... false if nothing changed
+	bool encode(StatMap const& current, StatsDelta& delta);
+
+	// start over (e.g. a new page) ... the next message is a keyframe, sent when next asked
+	void reset();
+
+	Stats stats() const { return stats_; }
+
+private:
+
+	Cadence cadence_;
+	uint32_t const keyframe_interval_;
+	uint64_t sequence_;
+	uint32_t since_keyframe_;
+	bool keyframe_;
+	StatMap sent_;
+	Stats stats_;
+};
+
+//
+// the page side of the stats channel ... applies messages in order to
+// rebuild what the encoder has.  A missing message leaves the decoder
+// out of sync (deltas are ignored) until the next keyframe.
+//
+// note: not thread-safe
+//
+class StatsDecoder
+{
+public:
+	StatsDecoder();
+
+	// false if the delta was ignored (out of sync)
+	bool apply(StatsDelta const& delta);
+
+	bool synced() const { return synced_; }
+
+	StatMap const& values() const { return values_; }
+
+private:
+	uint64_t sequence_;
+	bool synced_;
+	StatMap values_;
+};
@@ -0,0 +1,257 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+	int log2_floor(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long bit;
+		_BitScanReverse64(&bit, value);
+		return static_cast<int>(bit);
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+}
+
+Histogram::Histogram()
+{
+	reset();
+}
+
+void Histogram::reset()
+{
+	memset(counts_, 0, sizeof(counts_));
+	count_ = 0;
+	min_ = numeric_limits<int64_t>::max();
+	max_ = 0;
+	sum_ = 0.0;
+}
+
+//
+// values below 2^sub_bits get a bucket each ... above that each
+// power of two gets 2^sub_bits buckets
+//
+int Histogram::index(uint64_t value)
+{
+	auto const sub_count = uint64_t(1) << sub_bits;
+	if (value < sub_count) {
+		return static_cast<int>(value);
+	}
+	auto const shift = log2_floor(value) - sub_bits;
+	auto const mantissa = value >> shift;
+	return static_cast<int>(((shift + 1) << sub_bits) + (mantissa - sub_count));
+}
+
+// largest value that falls in a bucket
+int64_t Histogram::bucket_max(int index)
+{
+	auto const sub_count = 1 << sub_bits;
+	if (index < sub_count) {
+		return index;
+	}
+	auto const shift = (index >> sub_bits) - 1;
+	auto const mantissa = int64_t(sub_count + (index & (sub_count - 1)));
+	return ((mantissa + 1) << shift) - 1;
+}
+
+void Histogram::record(int64_t value)
+{
+	auto const limit = (int64_t(1) << max_bits) - 1;
+	value = std::min(std::max<int64_t>(value, 0), limit);
+
+	counts_[index(static_cast<uint64_t>(value))]++;
+	count_++;
+	min_ = std::min(min_, value);
+	max_ = std::max(max_, value);
+	sum_ += value;
+}
+
+void Histogram::merge(Histogram const& other)
+{
+	for (int n = 0; n < bucket_count; ++n) {
+		counts_[n] += other.counts_[n];
+	}
+	count_ += other.count_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+	sum_ += other.sum_;
+}
+
+int64_t Histogram::min_value() const {
+	return count_ ? min_ : 0;
+}
+
+int64_t Histogram::max_value() const {
+	return max_;
+}
+
+double Histogram::mean() const {
+	return count_ ? (sum_ / count_) : 0.0;
+}
+
+int64_t Histogram::percentile(double percent) const
+{
+	if (!count_) {
+		return 0;
+	}
+
+	percent = std::min(std::max(percent, 0.0), 100.0);
+	auto const target = std::max<uint64_t>(1,
+			static_cast<uint64_t>(ceil((percent / 100.0) * count_)));
+
+	uint64_t total = 0;
+	for (int n = 0; n < bucket_count; ++n)
+	{
+		total += counts_[n];
+		if (total >= target) {
+			return std::min(bucket_max(n), max_);
+		}
+	}
+	return max_;
+}
+
+Histogram::Summary Histogram::summary() const
+{
+	Summary s;
+	s.count = count();
+	s.min = min_value();
+	s.max = max_value();
+	s.mean = mean();
+	s.p50 = percentile(50.0);
+	s.p99 = percentile(99.0);
+	s.p999 = percentile(99.9);
+	return s;
+}
+
+Cadence::Cadence(double rate)
+	: rate_(0.0)
+	, interval_(0)
+	, next_(0)
+{
+	set_rate(rate);
+}
+
+void Cadence::set_rate(double rate)
+{
+	rate_ = max(0.0, rate);
+	interval_ = (rate_ > 0.0) ? static_cast<int64_t>(1000000.0 / rate_) : 0;
+	next_ = 0;
+}
+
+bool Cadence::due(int64_t now)
+{
+	if (interval_ && now < (next_ - (interval_ / 4))) {
+		return false;
+	}
+	next_ = (next_ + interval_ > now) ? (next_ + interval_) : (now + interval_);
+	return true;
+}
+
+LayerTiming::LayerTiming()
+{
+	reset();
+}
+
+void LayerTiming::reset()
+{
+	lock_guard<mutex> guard(lock_);
+	paint_interval_.reset();
+	paint_to_composite_.reset();
+	composite_to_present_.reset();
+	frames_ = 0;
+	dropped_ = 0;
+	duplicated_ = 0;
+	last_paint_ = 0;
+	pending_paint_ = 0;
+	last_composite_ = 0;
+	first_sequence_ = 0;
+	drawn_sequence_ = 0;
+	has_paint_ = false;
+	has_drawn_ = false;
+	has_pending_ = false;
+	has_composite_ = false;
+}
+
+void LayerTiming::paint(uint64_t sequence, int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	if (has_paint_) {
+		paint_interval_.record(now - last_paint_);
+	}
+	else {
+		first_sequence_ = sequence;
+	}
+
+	frames_++;
+	last_paint_ = now;
+	has_paint_ = true;
+}
+
+void LayerTiming::drawn(uint64_t sequence, int64_t painted)
+{
+	lock_guard<mutex> guard(lock_);
+
+	// frames skipped since the last one taken were never drawn
+	auto const last = has_drawn_ ? drawn_sequence_ : 
+		(has_paint_ ? first_sequence_ - 1 : sequence - 1);
+	if (sequence <= last) {
+		return;
+	}
+
+	dropped_ += sequence - last - 1;
+	drawn_sequence_ = sequence;
+	pending_paint_ = painted;
+	has_drawn_ = true;
+	has_pending_ = true;
+}
+
+void LayerTiming::composite(int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	if (has_pending_)
+	{
+		paint_to_composite_.record(now - pending_paint_);
+		has_pending_ = false;
+	}
+	else if (has_paint_) {
+		duplicated_++;
+	}
+
+	last_composite_ = now;
+	has_composite_ = true;
+}
+
+void LayerTiming::present(int64_t now)
+{
+	lock_guard<mutex> guard(lock_);
+	if (has_composite_)
+	{
+		composite_to_present_.record(now - last_composite_);
+		has_composite_ = false;
+	}
+}
+
+LayerTiming::Report LayerTiming::report() const
+{
+	lock_guard<mutex> guard(lock_);
+	Report r;
+	r.paint_interval = paint_interval_.summary();
+	r.paint_to_composite = paint_to_composite_.summary();
+	r.composite_to_present = composite_to_present_.summary();
+	r.frames = frames_;
+	r.dropped = dropped_;
+	r.duplicated = duplicated_;
+	return r;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+
+//
+// a fixed-size histogram with HDR-style (log-linear) buckets
+//
+// each power of two is split into 32 linear buckets so any recorded
+// value is reported within ~3% no matter its magnitude.  Recording
+// never allocates.  Values are clamped to [0, 2^40).
+//
+// note: not thread-safe
+//
+class Histogram
+{
+public:
+
+	struct Summary
+	{
+		uint64_t count;
+		int64_t min;
+		int64_t max;
+		double mean;
+		int64_t p50;
+		int64_t p99;
+		int64_t p999;
+	};
+
+	Histogram();
+
+	void record(int64_t value);
+	void reset();
+	void merge(Histogram const& other);
+
+	uint64_t count() const { return count_; }
+	int64_t min_value() const;
+	int64_t max_value() const;
+	double mean() const;
+
+	// the value that percent (0..100) of the samples are at or below
+	int64_t percentile(double percent) const;
+
+	Summary summary() const;
+
+private:
+
+	static int const sub_bits = 5;
+	static int const max_bits = 40;
+	static int const bucket_count = (max_bits - sub_bits + 1) << sub_bits;
+
+	static int index(uint64_t value);
+	static int64_t bucket_max(int index);
+
+	uint64_t counts_[bucket_count];
+	uint64_t count_;
+	int64_t min_;
+	int64_t max_;
+	double sum_;
+};
+
+//
+// keeps to a rate on ticks that don't line up with it (times in
+// microseconds, rate 0 = every tick)
+//
+// a tick up to a quarter of the interval early still counts so a rate
+// close to the tick rate isn't halved by jitter ... and the cadence is
+// kept unless we fell a whole interval behind
+//
+// note: not thread-safe
+//
+class Cadence
+{
+public:
+	Cadence(double rate);
+
+	double rate() const { return rate_; }
+
+	// a new rate ... the next tick is due
+	void set_rate(double rate);
+
+	// is the tick at now due? ... if so the one after is scheduled
+	bool due(int64_t now);
+
+	// the next tick is due whenever it comes
+	void restart() { next_ = 0; }
+
+private:
+	double rate_;
+	int64_t interval_;
+	int64_t next_;
+};
+
+//
+// frame timing for a single layer (all times in microseconds):
+//
+//   paint_interval       - between frames arriving from the source
+//   paint_to_composite   - a frame arriving to it being drawn
+//   composite_to_present - being drawn to the output being presented
+//
+// frames are identified by their sequence: the source reports each one
+// as it is painted and again when it is taken for drawing (queued
+// frames are taken long after newer ones were painted) ... dropped
+// counts sequences skipped over once a later one is taken, duplicated
+// counts draws that reused an already drawn frame
+//
+// paint() and drawn() may be called from any thread
+//
+class LayerTiming
+{
+public:
+
+	struct Report
+	{
+		Histogram::Summary paint_interval;
+		Histogram::Summary paint_to_composite;
+		Histogram::Summary composite_to_present;
+		uint64_t frames;
+		uint64_t dropped;
+		uint64_t duplicated;
+	};
+
+	LayerTiming();
+
+	// a new frame is available from the source
+	void paint(uint64_t sequence, int64_t now);
+
+	// the frame painted at the given time is the one drawn from now on
+	void drawn(uint64_t sequence, int64_t painted);
+
+	// the layer was drawn into an output frame
+	void composite(int64_t now);
+
+	// the output frame the layer was drawn into was presented
+	void present(int64_t now);
+
+	Report report() const;
+	void reset();
+
+private:
+
+	mutable std::mutex lock_;
+	Histogram paint_interval_;
+	Histogram paint_to_composite_;
+	Histogram composite_to_present_;
+	uint64_t frames_;
+	uint64_t dropped_;
+	uint64_t duplicated_;
+	int64_t last_paint_;
+	int64_t pending_paint_;
+	int64_t last_composite_;
+	uint64_t first_sequence_;
+	uint64_t drawn_sequence_;
+	bool has_paint_;
+	bool has_drawn_;
+	bool has_pending_;
+	bool has_composite_;
+};
@@ -0,0 +1,154 @@
+#include "transform.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+Transform identity_transform()
+{
+	Transform t;
+	t.x = 0.0f;
+	t.y = 0.0f;
+	t.scale_x = 1.0f;
+	t.scale_y = 1.0f;
+	t.rotation = 0.0f;
+	t.opacity = 1.0f;
+	return t;
+}
+
+bool operator==(Transform const& lhs, Transform const& rhs)
+{
+	return lhs.x == rhs.x &&
+		lhs.y == rhs.y &&
+		lhs.scale_x == rhs.scale_x &&
+		lhs.scale_y == rhs.scale_y &&
+		lhs.rotation == rhs.rotation &&
+		lhs.opacity == rhs.opacity;
+}
+
+bool operator!=(Transform const& lhs, Transform const& rhs)
+{
+	return !(lhs == rhs);
+}
+
+Affine to_affine(float x, float y, float width, float height,
+		Transform const& transform, float aspect)
+{
+	if (aspect <= 0.0f) {
+		aspect = 1.0f;
+	}
+
+	// size and center in pixels (scaled so the height is 1)
+	auto const w = width * aspect * transform.scale_x;
+	auto const h = height * transform.scale_y;
+	auto const cx = (x + (width * 0.5f) + transform.x) * aspect;
+	auto const cy = y + (height * 0.5f) + transform.y;
+
+	auto const radians = transform.rotation * 3.14159265358979f / 180.0f;
+	auto const c = cosf(radians);
+	auto const s = sinf(radians);
+
+	// rotate the centered quad then map back to normalized units
+	Affine m;
+	m.m11 = (c * w) / aspect;
+	m.m12 = s * w;
+	m.m21 = (-s * h) / aspect;
+	m.m22 = c * h;
+	m.dx = (cx - (0.5f * c * w) + (0.5f * s * h)) / aspect;
+	m.dy = cy - (0.5f * s * w) - (0.5f * c * h);
+	return m;
+}
+
+namespace {
+
+	float ease(Animation::Easing easing, float t)
+	{
+		switch (easing)
+		{
+			case Animation::Easing::EaseInOut:
+				return t * t * (3.0f - (2.0f * t));
+			case Animation::Easing::Step:
+				return 0.0f;
+			default:
+				return t;
+		}
+	}
+
+	float lerp(float a, float b, float t) {
+		return a + ((b - a) * t);
+	}
+}
+
+Animation::Animation(bool loop)
+	: loop_(loop)
+{
+}
+
+void Animation::add_keyframe(double time, Transform const& value, Easing easing)
+{
+	Keyframe const key = { max(0.0, time), value, easing };
+
+	// keep keyframes sorted by time
+	auto const i = upper_bound(keyframes_.begin(), keyframes_.end(), key,
+		[](Keyframe const& lhs, Keyframe const& rhs) {
+			return lhs.time < rhs.time;
+		});
+	keyframes_.insert(i, key);
+}
+
+bool Animation::empty() const {
+	return keyframes_.empty();
+}
+
+bool Animation::loop() const {
+	return loop_;
+}
+
+double Animation::duration() const {
+	return keyframes_.empty() ? 0.0 : keyframes_.back().time;
+}
+
+bool Animation::finished(double time) const {
+	return !loop_ && (time >= duration());
+}
+
+Transform Animation::evaluate(double time) const
+{
+	if (keyframes_.empty()) {
+		return identity_transform();
+	}
+
+	auto const length = duration();
+	if (loop_ && length > 0.0) {
+		time = fmod(max(0.0, time), length);
+	}
+
+	if (time <= keyframes_.front().time) {
+		return keyframes_.front().value;
+	}
+	if (time >= length) {
+		return keyframes_.back().value;
+	}
+
+	// first keyframe after time ... we know it is not the first
+	auto const next = upper_bound(keyframes_.begin(), keyframes_.end(), time,
+		[](double t, Keyframe const& key) {
+			return t < key.time;
+		});
+	auto const& b = *next;
+	auto const& a = *(next - 1);
+
+	auto const span = b.time - a.time;
+	auto const t = ease(a.easing,
+		span > 0.0 ? static_cast<float>((time - a.time) / span) : 1.0f);
+
+	Transform value;
+	value.x = lerp(a.value.x, b.value.x, t);
+	value.y = lerp(a.value.y, b.value.y, t);
+	value.scale_x = lerp(a.value.scale_x, b.value.scale_x, t);
+	value.scale_y = lerp(a.value.scale_y, b.value.scale_y, t);
+	value.rotation = lerp(a.value.rotation, b.value.rotation, t);
+	value.opacity = lerp(a.value.opacity, b.value.opacity, t);
+	return value;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+//
+// per-layer transform applied on top of the layer's bounds
+//
+// scale and rotation are about the center of the bounds, rotation
+// is in degrees (clockwise on screen) and the offset is in normalized
+// composition units
+//
+struct Transform
+{
+	float x;
+	float y;
+	float scale_x;
+	float scale_y;
+	float rotation;
+	float opacity;
+};
+
+Transform identity_transform();
+
+bool operator==(Transform const& lhs, Transform const& rhs);
+bool operator!=(Transform const& lhs, Transform const& rhs);
+
+//
+// 2D affine matrix that maps the unit quad (0..1, y down) to
+// normalized composition units:
+//
+//   x' = (u * m11) + (v * m21) + dx
+//   y' = (u * m12) + (v * m22) + dy
+//
+struct Affine
+{
+	float m11;
+	float m12;
+	float m21;
+	float m22;
+	float dx;
+	float dy;
+
+	void apply(float u, float v, float& x, float& y) const
+	{
+		x = (u * m11) + (v * m21) + dx;
+		y = (u * m12) + (v * m22) + dy;
+	}
+};
+
+//
+// matrix for a layer at (x, y, width, height) with the given transform
+//
+// aspect is the composition's width / height so rotation happens
+// in pixels (and does not shear the layer)
+//
+Affine to_affine(float x, float y, float width, float height,
+		Transform const& transform, float aspect);
+
+//
+// a simple keyframe animation of a layer transform
+//
+// keyframes are interpolated with the easing of the keyframe that
+// starts each segment.  Evaluating never allocates so it is safe to
+// call every frame from Layer::tick.
+//
+class Animation
+{
+public:
+
+	enum class Easing
+	{
+		Linear,
+		EaseInOut,
+		Step
+	};
+
+	Animation(bool loop);
+
+	// time is in seconds from the start of the animation
+	void add_keyframe(double time, Transform const& value, Easing easing);
+
+	bool empty() const;
+	bool loop() const;
+	double duration() const;
+
+	// true once a non-looping animation has reached its last keyframe
+	bool finished(double time) const;
+
+	Transform evaluate(double time) const;
+
+private:
+
+	struct Keyframe
+	{
+		double time;
+		Transform value;
+		Easing easing;
+	};
+
+	std::vector<Keyframe> keyframes_;
+	bool const loop_;
+};
@@ -1,4 +1,6 @@
+#if defined(_WIN32)
 #include "platform.h"
+#endif
 #include "util.h"
 
 #include <stdio.h>
@@ -6,9 +8,12 @@
 
 #include <memory>
 #include <sstream>
+#include <chrono>
 
 using namespace std;
 
+#if defined(_WIN32)
+
 LARGE_INTEGER qi_freq_ = {};
 
 uint64_t time_now()
@@ -22,6 +27,17 @@ uint64_t time_now()
 		(t.QuadPart / double(qi_freq_.QuadPart)) * 1000000);
 }
 
+#else
+
+uint64_t time_now()
+{
+	return static_cast<uint64_t>(
+		chrono::duration_cast<chrono::microseconds>(
+			chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#endif
+
 void log_message(const char* msg, ...)
 {
 	// old-school, printf style logging
@@ -30,11 +46,29 @@ void log_message(const char* msg, ...)
 		char buff[512];
 		va_list args;
 		va_start(args, msg);
-		vsprintf(buff, msg, args);
+		vsnprintf(buff, sizeof(buff), msg, args);
+		va_end(args);
+#if defined(_WIN32)
 		OutputDebugStringA(buff);
+#else
+		fputs(buff, stderr);
+#endif
 	}
 }
 
+int to_int(std::string s, int default_val)
+{
+	int n;
+	istringstream in(s);
+	in >> n;
+	if (!in.fail()) {
+		return n;
+	}
+	return default_val;
+}
+
+#if defined(_WIN32)
+
 string to_utf8(wstring const& utf16)
 {
 	return to_utf8(utf16.c_str());
@@ -110,18 +144,6 @@ string to_file_url(string const& filename)
 	return url;
 }
 
-int to_int(std::string s, int default_val)
-{
-	int n;
-	istringstream in(s);
-	in >> n;
-	if (!in.fail()) {
-		return n;
-	}
-	return default_val;
-}
-
-
 bool file_exists(LPCWSTR filename)
 {
 	auto const attribs = GetFileAttributes(filename);
@@ -177,3 +199,5 @@ std::shared_ptr<std::string> locate_media(std::string const& filespec)
 	}
 	return nullptr;
 }
+
+#endif
@@ -14,48 +14,157 @@
 #include <functional>
 #include <map>
 #include <vector>
-#include <fstream>
 #include <algorithm>
 
 #include "util.h"
+#include "frame_pool.h"
+#include "partial_copy.h"
+#include "mailbox.h"
+#include "delivery.h"
+#include "input_queue.h"
+#include "keyed_sync.h"
+#include "lru_cache.h"
+#include "scheduler.h"
+#include "source_dump.h"
+#include "stats_channel.h"
 
 using namespace std;
 
 //
-// helper function to convert a 
-// CefDictionaryValue to a CefV8Object
+// a stats delta as the arguments of a "mixer-update-stats" message:
 //
-CefRefPtr<CefV8Value> to_v8object(CefRefPtr<CefDictionaryValue> const& dictionary)
+//   [ sequence, keyframe, [ paths ], [ values ] ]
+//
+void to_message(StatsDelta const& delta, CefRefPtr<CefListValue> const& args)
 {
-	auto const obj = CefV8Value::CreateObject(nullptr, nullptr);
-	if (dictionary) 
+	auto paths = CefListValue::Create();
+	auto values = CefListValue::Create();
+	paths->SetSize(delta.values.size());
+	values->SetSize(delta.values.size());
+
+	for (size_t n = 0; n < delta.values.size(); ++n)
 	{
-		auto const attrib = V8_PROPERTY_ATTRIBUTE_READONLY;
-		CefDictionaryValue::KeyList keys;
-		dictionary->GetKeys(keys);
-		for (auto const& k : keys)
+		auto const& v = delta.values[n].second;
+		paths->SetString(n, delta.values[n].first);
+		switch (v.type)
 		{
-			auto const type = dictionary->GetType(k);
-			switch (type)
-			{
-				case VTYPE_BOOL: obj->SetValue(k,
-					CefV8Value::CreateBool(dictionary->GetBool(k)), attrib);
-					break;
-				case VTYPE_INT: obj->SetValue(k,
-					CefV8Value::CreateInt(dictionary->GetInt(k)), attrib);
-					break;
-				case VTYPE_DOUBLE: obj->SetValue(k, 
-					CefV8Value::CreateDouble(dictionary->GetDouble(k)), attrib);
-					break;
-				case VTYPE_STRING: obj->SetValue(k,
-					CefV8Value::CreateString(dictionary->GetString(k)), attrib);
-					break;
-
-				default: break;
-			}
+			case StatValue::Bool: values->SetBool(n, v.number != 0.0); break;
+			case StatValue::String: values->SetString(n, v.text); break;
+			case StatValue::Int:
+				// a CefValue int is only 32 bits
+				if (v.number >= INT32_MIN && v.number <= INT32_MAX) {
+					values->SetInt(n, static_cast<int>(v.number));
+				}
+				else {
+					values->SetDouble(n, v.number);
+				}
+				break;
+			default: values->SetDouble(n, v.number); break;
+		}
+	}
+
+	args->SetDouble(0, static_cast<double>(delta.sequence));
+	args->SetBool(1, delta.keyframe);
+	args->SetList(2, paths);
+	args->SetList(3, values);
+}
+
+bool from_message(CefRefPtr<CefListValue> const& args, StatsDelta& delta)
+{
+	if (args->GetSize() < 4 || 
+		args->GetType(2) != VTYPE_LIST || 
+		args->GetType(3) != VTYPE_LIST) {
+		return false;
+	}
+
+	auto const paths = args->GetList(2);
+	auto const values = args->GetList(3);
+	if (paths->GetSize() != values->GetSize()) {
+		return false;
+	}
+
+	delta.sequence = static_cast<uint64_t>(args->GetDouble(0));
+	delta.keyframe = args->GetBool(1);
+	delta.values.clear();
+	delta.values.reserve(paths->GetSize());
+	for (size_t n = 0; n < paths->GetSize(); ++n)
+	{
+		StatValue v;
+		switch (values->GetType(n))
+		{
+			case VTYPE_BOOL: v = stat_bool(values->GetBool(n)); break;
+			case VTYPE_INT: v = stat_int(values->GetInt(n)); break;
+			case VTYPE_DOUBLE: v = stat_double(values->GetDouble(n)); break;
+			case VTYPE_STRING: v = stat_string(values->GetString(n).ToString()); break;
+			default: continue;
 		}
+		delta.values.push_back(make_pair(paths->GetString(n).ToString(), v));
 	}
-	return obj;
+	return true;
+}
+
+CefRefPtr<CefV8Value> to_v8value(StatValue const& v)
+{
+	switch (v.type)
+	{
+		case StatValue::Bool: return CefV8Value::CreateBool(v.number != 0.0);
+		case StatValue::String: return CefV8Value::CreateString(v.text);
+		default: break;
+	}
+	return CefV8Value::CreateDouble(v.number);
+}
+
+//
+// set a stat within a V8 object ... creating the objects along its path
+//
+void set_v8stat(CefRefPtr<CefV8Value> obj, string const& path, StatValue const& value)
+{
+	size_t start = 0;
+	for (;;)
+	{
+		auto const end = path.find(stat_path_separator, start);
+		if (end == string::npos) {
+			break;
+		}
+
+		auto const key = path.substr(start, end - start);
+		auto child = obj->GetValue(key);
+		if (!child || !child->IsObject())
+		{
+			child = CefV8Value::CreateObject(nullptr, nullptr);
+			obj->SetValue(key, child, V8_PROPERTY_ATTRIBUTE_NONE);
+		}
+		obj = child;
+		start = end + 1;
+	}
+	obj->SetValue(path.substr(start), to_v8value(value), V8_PROPERTY_ATTRIBUTE_NONE);
+}
+
+//
+// delete what values no longer has from a V8 stats object (prefix is the
+// path of obj itself) ... returns true if nothing is left in obj
+//
+bool prune_v8stats(CefRefPtr<CefV8Value> obj, string const& prefix, StatMap const& values)
+{
+	vector<CefString> keys;
+	obj->GetKeys(keys);
+
+	size_t kept = 0;
+	for (auto const& key : keys)
+	{
+		auto const path = prefix + key.ToString();
+		auto const child = obj->GetValue(key);
+		auto const keep = (child && child->IsObject())
+			? !prune_v8stats(child, path + stat_path_separator, values)
+			: (values.find(path) != values.end());
+		if (keep) {
+			kept++;
+		}
+		else {
+			obj->DeleteValue(key);
+		}
+	}
+	return (kept == 0);
 }
 
 class WebView;
@@ -83,7 +192,8 @@ shared_ptr<Layer> create_web_layer(
 // internal factory method so popups (dropdowns, PET_POPUP) 
 // can create simple layers on the fly
 //
-shared_ptr<Layer> create_popup_layer(
+class PopupLayer;
+shared_ptr<PopupLayer> create_popup_layer(
 	shared_ptr<d3d11::Device> const& device,
 	shared_ptr<FrameBuffer> const& buffer);
 
@@ -91,6 +201,10 @@ shared_ptr<Layer> create_popup_layer(
 // V8 handler for our 'mixer' object available to javascript
 // running in a page within this application
 //
+// stats arrive a few times a second with only what changed ... they are
+// applied to one object kept for the page, which is handed to the
+// mixer.requestStats callback and can be read from mixer.stats any time
+//
 class MixerHandler : 
 			public CefV8Accessor
 {
@@ -104,19 +218,48 @@ public:
 		auto window = context->GetGlobal();
 		auto const obj = CefV8Value::CreateObject(this, nullptr);
 		obj->SetValue("requestStats", V8_ACCESS_CONTROL_DEFAULT, V8_PROPERTY_ATTRIBUTE_NONE);
+		obj->SetValue("stats", V8_ACCESS_CONTROL_DEFAULT, V8_PROPERTY_ATTRIBUTE_READONLY);
 		window->SetValue("mixer", obj, V8_PROPERTY_ATTRIBUTE_NONE);
 	}
 
-	void update(CefRefPtr<CefDictionaryValue> const& dictionary)
+	void update(StatsDelta const& delta)
 	{
-		if (!request_stats_) {
+		// we missed a message (e.g. the page reloaded) ... ask for a keyframe
+		if (!decoder_.apply(delta))
+		{
+			request();
 			return;
 		}
 
 		context_->Enter();
-		CefV8ValueList values;
-		values.push_back(to_v8object(dictionary));
-		request_stats_->ExecuteFunction(request_stats_, values);
+
+		// a keyframe has everything (stats may have gone, so they are
+		// deleted) ... deltas are applied in place.  Either way it is the
+		// same object, a page may hold on to mixer.stats
+		auto const created = !stats_;
+		if (created) {
+			stats_ = CefV8Value::CreateObject(nullptr, nullptr);
+		}
+		if (delta.keyframe || created)
+		{
+			prune_v8stats(stats_, string(), decoder_.values());
+			for (auto const& v : decoder_.values()) {
+				set_v8stat(stats_, v.first, v.second);
+			}
+		}
+		else
+		{
+			for (auto const& v : delta.values) {
+				set_v8stat(stats_, v.first, v.second);
+			}
+		}
+
+		if (request_stats_)
+		{
+			CefV8ValueList values;
+			values.push_back(stats_);
+			request_stats_->ExecuteFunction(request_stats_, values);
+		}
 		context_->Exit();
 	}
 
@@ -130,6 +273,11 @@ public:
 			return true;
 		}
 
+		if (name == "stats" && stats_ != nullptr) {
+			retval = stats_;
+			return true;
+		}
+
 		// Value does not exist.
 		return false;
 	}
@@ -141,12 +289,7 @@ public:
 	{
 		if (name == "requestStats") {
 			request_stats_ = value;
-
-			// notify the browser process that we want stats
-			auto message = CefProcessMessage::Create("mixer-request-stats");
-			if (message != nullptr && browser_ != nullptr) {
-				browser_->SendProcessMessage(PID_BROWSER, message);
-			}
+			request();
 			return true;
 		}
 		return false;
@@ -156,9 +299,20 @@ public:
 
 private:
 
+	// notify the browser process that we want stats (starting with a keyframe)
+	void request()
+	{
+		auto message = CefProcessMessage::Create("mixer-request-stats");
+		if (message != nullptr && browser_ != nullptr) {
+			browser_->SendProcessMessage(PID_BROWSER, message);
+		}
+	}
+
 	CefRefPtr<CefBrowser> const browser_;
 	CefRefPtr<CefV8Context> const context_;
 	CefRefPtr<CefV8Value> request_stats_;
+	CefRefPtr<CefV8Value> stats_;
+	StatsDecoder decoder_;
 };
 
 
@@ -249,14 +403,10 @@ public:
 		{
 			if (mixer_handler_ != nullptr)
 			{
-				// we expect just 1 param that is a dictionary of stat values
-				auto const args = message->GetArgumentList();
-				auto const size = args->GetSize();
-				if (size > 0) {
-					auto const dict = args->GetDictionary(0);
-					if (dict && dict->GetSize() > 0) {
-						mixer_handler_->update(dict);
-					}
+				// a delta (or keyframe) of the stat values
+				StatsDelta delta;
+				if (from_message(message->GetArgumentList(), delta)) {
+					mixer_handler_->update(delta);
 				}
 			}
 			return true;
@@ -272,143 +422,889 @@ private:
 };
 
 
+//
+// the keyed mutex of a shared texture for FrameSync
+//
+class TextureKeyedMutex : public KeyedMutex
+{
+public:
+	TextureKeyedMutex(shared_ptr<d3d11::Texture2D> const& texture)
+		: texture_(texture) {
+	}
+
+	bool acquire(uint64_t key, uint32_t timeout_ms) override {
+		return texture_->lock_key(key, timeout_ms);
+	}
+
+	void release(uint64_t key) override {
+		texture_->unlock_key(key);
+	}
+
+private:
+	shared_ptr<d3d11::Texture2D> const texture_;
+};
+
+//
+// frames from a browser (CEF UI thread) to the composition (render thread)
+//
+// frames are passed through a triple-buffered Mailbox (latest wins) or a
+// FrameQueue (queue / hold delivery) so neither thread waits on the other:
+// a paint fills the producer's slot and publishes it, swap() takes the
+// next frame.  lock_ only guards the small damage list and timing.
+//
+// Note: with shared textures CEF draws into the same texture every time,
+// so queue and hold only pace frames ... the content is always the latest
+//
 class FrameBuffer
 {
 public:
-	FrameBuffer(shared_ptr<d3d11::Device> const& device)
+	FrameBuffer(shared_ptr<d3d11::Device> const& device, DeliveryPolicy const& policy)
 		: device_(device)
-		, dirty_(false)
+		, policy_(policy)
+		, width_(0)
+		, height_(0)
+		, paint_width_(0)
+		, paint_height_(0)
+		, sequence_(0)
+		, paints_(0)
+		, consumed_(0)
+		, uploaded_width_(0)
+		, uploaded_height_(0)
+		, started_(false)
+		, repeated_(0)
+		, shared_cache_(shared_cache_size)
+		, shared_stale_(false)
+		, shared_hits_(0)
+		, shared_misses_(0)
+		, sync_(policy.sync_timeout_ms)
+		, timeouts_(0)
 	{
+		if (policy_.mode != Delivery::Latest) {
+			queue_.reset(new FrameQueue<Frame>(policy_.depth));
+		}
+		stale_.resize(queue_ ? queue_->slot_count() : 3);
 	}
 	
 	int32_t width() {
-		if (shared_buffer_) {
-			return shared_buffer_->width();
-		}
-		return 0;
+		return width_;
+	}
+
+	// frames painted so far
+	uint64_t paints() const {
+		return paints_;
 	}
 
 	int32_t height() {
-		if (shared_buffer_) {
-			return shared_buffer_->height();
-		}
-		return 0;
+		return height_;
 	}
 
-	void on_paint(const void* buffer, uint32_t width, uint32_t height)
+	DeliveryStats stats() const
 	{
-		uint32_t stride = width * 4;
-		size_t cb = stride * height;
+		DeliveryStats stats;
+		stats.policy = policy_;
+		stats.delivered = queue_ ? queue_->consumed() : mailbox_.consumed();
+		stats.dropped = queue_ ? queue_->dropped() : mailbox_.superseded();
+		stats.repeated = repeated_;
+		stats.timeouts = timeouts_;
+		stats.queued = queue_ ? queue_->queued() : 0;
+		stats.shared_hits = shared_hits_;
+		stats.shared_misses = shared_misses_;
+		stats.begin_frames = 0;
+		stats.begin_timeouts = 0;
+		stats.begin_to_paint = Histogram::Summary();
+		stats.hidden = false;
+		stats.hides = 0;
+		stats.input_events = 0;
+		stats.input_coalesced = 0;
+		stats.input_delay = Histogram::Summary();
+		return stats;
+	}
+
+	//
+	// should the browser be asked for another frame (BeginFrame)? ...
+	// not while a held frame is waiting to be drawn
+	//
+	bool ready() const {
+		return (policy_.mode != Delivery::Hold) || !queue_->full();
+	}
 
-		if (!shared_buffer_ ||
-			(shared_buffer_->width() != width) ||
-			(shared_buffer_->height() != height))
+	void on_paint(
+		const void* buffer, 
+		uint32_t width, 
+		uint32_t height, 
+		CefRenderHandler::RectList const& dirty_rects)
+	{
+		uint32_t const stride = width * 4;
+		IntRect const all{ 0, 0, int32_t(width), int32_t(height) };
+
+		// what changed in this paint (everything if the size changed)
+		auto const resized = (width != paint_width_) || (height != paint_height_);
+		paint_width_ = width;
+		paint_height_ = height;
+
+		Region dirty;
+		if (resized) {
+			dirty.add(all);
+		}
+		else
 		{
-			shared_buffer_ = device_->create_texture(
-				width, height, DXGI_FORMAT_B8G8R8A8_UNORM, nullptr, 0);
-			
-			sw_buffer_ = shared_ptr<uint8_t>((uint8_t*)malloc(cb), free);
+			for (auto const& r : dirty_rects) {
+				dirty.add(IntRect{ r.x, r.y, r.width, r.height });
+			}
 		}
+		dirty.clip(width, height);
 
-		if (sw_buffer_ && buffer) 
+		// every slot we don't write now falls behind by this much
+		for (auto& stale : stale_) {
+			stale.add(dirty);
+		}
+
+		auto const slot = back_index();
+		auto& frame = back();
+		if (!frame.pixels || frame.width != width || frame.height != height)
+		{
+			// release first: a size in the same bucket gets the same buffer back
+			frame.pixels.reset();
+			frame.pixels = frame_pool()->acquire(stride * height);
+			frame.width = width;
+			frame.height = height;
+			stale_[slot].clear();
+			stale_[slot].add(all);
+		}
+		frame.shared.reset();
+
+		// bring the slot up to date with the current frame
+		if (frame.pixels && buffer) 
+		{
+			copy_region(frame.pixels.get(), stride, 
+				static_cast<const uint8_t*>(buffer), stride, width, height, stale_[slot]);
+		}
+		stale_[slot].clear();
+
+		//
+		// the texture (on the render thread) needs everything that changed 
+		// since the last frame it took ... which may be a few frames back
+		//
+		sequence_++;
+		history_[sequence_ % history_size] = dirty;
+		frame.sequence = sequence_;
+		auto const painted = static_cast<int64_t>(time_now());
+		frame.painted = painted;
+		frame.upload.clear();
+		auto const consumed = consumed_.load();
+		if (resized || (sequence_ - consumed) > history_size) {
+			frame.upload.add(all);
+		}
+		else
 		{
-			// todo: support dirty rect(s)
-			memcpy(sw_buffer_.get(), buffer, cb);		
+			for (auto n = consumed + 1; n <= sequence_; ++n) {
+				frame.upload.add(history_[n % history_size]);
+			}
 		}
 
-		dirty_ = true;
+		// queued frames carry their own damage (reported when drawn)
+		if (queue_) {
+			add_damage(frame.damage, dirty_rects, width, height, resized);
+		}
+
+		publish();
+		paints_++;
+		width_ = width;
+		height_ = height;
+
+		lock_guard<mutex> guard(lock_);
+		if (!queue_) {
+			add_damage(damage_, dirty_rects, width, height, resized);
+		}
+
+		if (timing_) {
+			timing_->paint(sequence_, painted);
+		}
 	}
 
 	//
 	// called in response to Cef's OnAcceleratedPaint notification
 	//
-	void on_gpu_paint(void* shared_handle)
+	void on_gpu_paint(void* shared_handle, CefRenderHandler::RectList const& dirty_rects)
 	{
-		// Note: we're not handling keyed mutexes yet
+		// a keyed mutex (if the texture has one) is handled in render()
 
-		lock_guard<mutex> guard(lock_);
+		// the view was resized ... what we opened belongs to the old size
+		if (shared_stale_.exchange(false))
+		{
+			shared_cache_.clear();
+			shared_.reset();
+		}
 
-		// did the shared texture change?
-		if (shared_buffer_)
+		//
+		// the producer may rotate between a few shared textures ... they
+		// are only opened the first time we see their handle
+		//
+		bool opened = false;
+		if (!shared_ || (shared_handle != shared_->share_handle()))
 		{
-			if (shared_handle != shared_buffer_->share_handle()) {
-				shared_buffer_.reset();
+			auto const previous = shared_;
+			auto const cached = shared_cache_.find(shared_handle);
+			if (cached) {
+				shared_ = *cached;
+			}
+			else
+			{
+				shared_ = device_->open_shared_texture((void*)shared_handle);
+				if (!shared_) {
+					log_message("could not open shared texture!");
+				}
+				else
+				{
+					// textures of another size belong to the producer before a resize
+					if (previous && ((previous->width() != shared_->width()) || 
+						(previous->height() != shared_->height()))) {
+						shared_cache_.clear();
+					}
+					shared_cache_.insert(shared_handle, shared_);
+				}
 			}
+
+			// dirty rects are relative to the last frame unless the size changed
+			opened = !shared_ || !previous || 
+				(previous->width() != shared_->width()) || 
+				(previous->height() != shared_->height());
+
+			auto const stats = shared_cache_.stats();
+			shared_hits_ = stats.hits;
+			shared_misses_ = stats.misses;
 		}
 
-		// open the shared texture
-		if (!shared_buffer_) 
+		auto& frame = back();
+		frame.shared = shared_;
+		frame.sequence = ++sequence_;
+		auto const painted = static_cast<int64_t>(time_now());
+		frame.painted = painted;
+		if (queue_ && shared_) {
+			add_damage(frame.damage, dirty_rects, shared_->width(), shared_->height(), opened);
+		}
+		publish();
+		paints_++;
+
+		// a later software paint has to upload everything
+		paint_width_ = 0;
+		paint_height_ = 0;
+
+		if (shared_)
 		{
-			shared_buffer_ = device_->open_shared_texture((void*)shared_handle);				
-			if (!shared_buffer_) {
-				log_message("could not open shared texture!");
+			width_ = shared_->width();
+			height_ = shared_->height();
+		}
+
+		lock_guard<mutex> guard(lock_);
+		if (shared_ && !queue_) {
+			add_damage(damage_, dirty_rects, shared_->width(), shared_->height(), opened);
+		}
+
+		if (timing_) {
+			timing_->paint(sequence_, painted);
+		}
+	}
+
+	//
+	// the view was resized ... shared textures opened so far are let go
+	// (on the producer's thread) before the next paint
+	//
+	void resized() {
+		shared_stale_ = true;
+	}
+
+	//
+	// paints are reported to the timing of the layer showing this buffer
+	//
+	void set_timing(shared_ptr<LayerTiming> const& timing)
+	{
+		lock_guard<mutex> guard(lock_);
+		timing_ = timing;
+	}
+
+	//
+	// hand over the areas that changed since the last call
+	// (in normalized 0..1 units of this buffer)
+	//
+	void take_damage(vector<Rect>& damage)
+	{
+		// the frame the next swap() will draw
+		if (queue_)
+		{
+			auto const next = queue_->peek();
+			if (next) {
+				damage.insert(damage.end(), next->damage.begin(), next->damage.end());
 			}
+			return;
 		}
 
-		dirty_ = true;
+		lock_guard<mutex> guard(lock_);
+		damage.insert(damage.end(), damage_.begin(), damage_.end());
+		damage_.clear();
 	}
 
 	//
-	// this method returns what should be considered the front buffer
-	// we're simply using the shared texture directly 
+	// draw what should be considered the front buffer ... the next frame
+	// (or the last one if nothing is new)
+	//
+	// shared textures are used directly, software frames are uploaded
+	// to our own texture (only what changed since the last upload)
 	//
-	// ... this method could be expanded on to handle 
-	// synchronization through a keyed mutex
+	// shared textures with a keyed mutex are drawn while we hold the key
+	// (see draw_keyed)
 	// 
-	shared_ptr<d3d11::Texture2D> swap(shared_ptr<d3d11::Context> const& ctx)
+	void render(
+		shared_ptr<d3d11::Context> const& ctx, 
+		function<void(shared_ptr<d3d11::Texture2D> const&)> const& draw)
+	{
+		auto const fresh = acquire();
+		if (fresh) {
+			started_ = true;
+		}
+
+		// a keyed shared texture may still be pending from an earlier call
+		auto const& frame = front();
+		if (frame.shared && frame.shared->has_mutex())
+		{
+			draw_keyed(frame.shared, fresh, draw);
+			return;
+		}
+
+		draw(swap(ctx, fresh));
+	}
+
+private:
+
+	shared_ptr<d3d11::Texture2D> swap(shared_ptr<d3d11::Context> const& ctx, bool fresh)
+	{
+		auto const& frame = front();
+
+		if (!fresh)
+		{
+			if (started_) {
+				repeated_++;
+			}
+			return current_;
+		}
+
+		if (frame.shared) {
+			current_ = frame.shared;
+		}
+		else if (frame.pixels)
+		{
+			Region upload(frame.upload);
+			if (!texture_ || 
+				(uploaded_width_ != frame.width) || 
+				(uploaded_height_ != frame.height))
+			{
+				texture_.reset();
+				texture_ = device_->texture_pool()->acquire(
+					frame.width, frame.height, DXGI_FORMAT_B8G8R8A8_UNORM);
+				uploaded_width_ = frame.width;
+				uploaded_height_ = frame.height;
+				upload.clear();
+				upload.add(IntRect{ 0, 0, int32_t(frame.width), int32_t(frame.height) });
+			}
+
+			if (texture_)
+			{
+				d3d11::ScopedBinder<d3d11::Texture2D> binder(ctx, texture_);
+				texture_->copy_from(frame.pixels.get(), frame.width * 4, upload);
+			}
+			consumed_ = frame.sequence;
+			current_ = texture_;
+		}
+
+		if (current_) {
+			report_drawn(frame);
+		}
+		return current_;
+	}
+
+	struct Frame
+	{
+		Frame() : width(0), height(0), sequence(0), painted(0) {}
+
+		// software paints
+		shared_ptr<uint8_t> pixels;
+		uint32_t width;
+		uint32_t height;
+		Region upload;
+
+		// gpu paints
+		shared_ptr<d3d11::Texture2D> shared;
+
+		// normalized dirty rects (queue / hold delivery only)
+		vector<Rect> damage;
+
+		uint64_t sequence;
+		int64_t painted;
+	};
+
+	// damage of the last few paints (to build Frame::upload)
+	static uint64_t const history_size = 8;
+
+	// opened shared textures kept per buffer (double / triple buffering)
+	static size_t const shared_cache_size = 4;
+
+	//
+	// the slots of whichever container the policy uses
+	//
+	Frame& back() {
+		return queue_ ? queue_->back() : mailbox_.back();
+	}
+
+	uint32_t back_index() const {
+		return queue_ ? queue_->back_index() : mailbox_.back_index();
+	}
+
+	Frame& front() {
+		return queue_ ? queue_->front() : mailbox_.front();
+	}
+
+	void publish()
+	{
+		if (!queue_) {
+			mailbox_.publish();
+		}
+		else if (queue_->publish()) {
+			queue_->back().damage.clear();
+		}
+	}
+
+	bool acquire() {
+		return queue_ ? queue_->acquire() : mailbox_.acquire();
+	}
+
+	//
+	// let the timing know which frame is being drawn ... with queue and
+	// hold delivery that is not necessarily the last one painted
+	//
+	void report_drawn(Frame const& frame)
+	{
+		shared_ptr<LayerTiming> timing;
+		{
+			lock_guard<mutex> guard(lock_);
+			timing = timing_;
+		}
+
+		if (timing) {
+			timing->drawn(frame.sequence, frame.painted);
+		}
+	}
+
+	//
+	// draw a shared texture that has a keyed mutex while we hold its key
+	// ... no copy is made, the browser waits for the key at most as long
+	// as our draw takes.  Until a new frame is handed over we draw the
+	// last one again (its texture is only written once we hand it back).
+	//
+	void draw_keyed(
+		shared_ptr<d3d11::Texture2D> const& shared, 
+		bool fresh,
+		function<void(shared_ptr<d3d11::Texture2D> const&)> const& draw)
+	{
+		TextureKeyedMutex mutex(shared);
+		auto const taken = sync_.take(&mutex, fresh, [&]() { draw(shared); });
+		if (taken) 
+		{
+			current_ = shared;
+			report_drawn(front());
+		}
+		else 
+		{
+			if (started_) {
+				repeated_++;
+			}
+
+			// don't wait twice on the texture that just timed out
+			if (current_)
+			{
+				auto const waited = sync_.pending() && (current_ == shared);
+				TextureKeyedMutex last(current_);
+				sync_.repeat(current_->has_mutex() ? &last : nullptr,
+					waited ? 0 : sync_.timeout(), [&]() { draw(current_); });
+			}
+		}
+		timeouts_ = sync_.stats().timeouts;
+	}
+
+	//
+	// convert CEF dirty rects (in pixels) to normalized units ... 
+	// note: lock_ should be held by the caller when adding to damage_
+	//
+	static void add_damage(
+		vector<Rect>& damage,
+		CefRenderHandler::RectList const& dirty_rects, 
+		uint32_t width, 
+		uint32_t height, 
+		bool everything)
+	{
+		if (!width || !height) {
+			return;
+		}
+
+		if (everything)
+		{
+			damage.clear();
+			Rect const all = { 0.0f, 0.0f, 1.0f, 1.0f };
+			damage.push_back(all);
+			return;
+		}
+
+		for (auto const& r : dirty_rects)
+		{
+			Rect n;
+			n.x = r.x / float(width);
+			n.y = r.y / float(height);
+			n.width = r.width / float(width);
+			n.height = r.height / float(height);
+			damage.push_back(n);
+		}
+
+		// don't let damage grow without bound if nobody is consuming it
+		if (damage.size() > 32)
+		{
+			auto x0 = 1.0f, y0 = 1.0f, x1 = 0.0f, y1 = 0.0f;
+			for (auto const& r : damage)
+			{
+				x0 = min(x0, r.x);
+				y0 = min(y0, r.y);
+				x1 = max(x1, r.x + r.width);
+				y1 = max(y1, r.y + r.height);
+			}
+			damage.clear();
+			Rect const bounds = { x0, y0, x1 - x0, y1 - y0 };
+			damage.push_back(bounds);
+		}
+	}
+
+	std::shared_ptr<d3d11::Device> const device_;
+	DeliveryPolicy const policy_;
+	Mailbox<Frame> mailbox_;
+	unique_ptr<FrameQueue<Frame>> queue_;
+	atomic<int32_t> width_;
+	atomic<int32_t> height_;
+
+	// producer (CEF UI thread)
+	uint32_t paint_width_;
+	uint32_t paint_height_;
+	uint64_t sequence_;
+	atomic<uint64_t> paints_;
+	vector<Region> stale_;
+	Region history_[history_size];
+	shared_ptr<d3d11::Texture2D> shared_;
+	LruCache<void*, shared_ptr<d3d11::Texture2D>> shared_cache_;
+	atomic<bool> shared_stale_;
+	atomic<uint64_t> shared_hits_;
+	atomic<uint64_t> shared_misses_;
+
+	// last frame taken by the consumer
+	atomic<uint64_t> consumed_;
+
+	// consumer (render thread)
+	shared_ptr<d3d11::Texture2D> texture_;
+	shared_ptr<d3d11::Texture2D> current_;
+	uint32_t uploaded_width_;
+	uint32_t uploaded_height_;
+	bool started_;
+	atomic<uint64_t> repeated_;
+	FrameSync sync_;
+	atomic<uint64_t> timeouts_;
+
+	mutex lock_;
+	vector<Rect> damage_;
+	shared_ptr<LayerTiming> timing_;
+};
+
+//
+// a simple layer that will render out PET_POPUP for a
+// corresponding view
+//
+// a view keeps one of these for its lifetime and shows / hides it as
+// CEF opens and closes popups ... the frame buffer (and its textures)
+// stay with it between openings.  A new size or position is held until
+// the popup paints at it so the move and the new pixels show up in the
+// same frame, and nothing is drawn after show() until the popup paints
+// again (the last frame belongs to the previous opening).
+//
+class PopupLayer : public Layer
+{
+public:
+	PopupLayer(
+		shared_ptr<d3d11::Device> const& device,
+		shared_ptr<FrameBuffer> const& buffer)
+		: Layer(device, false, true)
+		, frame_buffer_(buffer)
+		, shown_after_(0)
+		, placed_after_(0)
+		, placing_(false) {
+		frame_buffer_->set_timing(timing());
+		set_name("popup");
+	}
+
+	// about to be added (again) to the composition
+	void show()
 	{
 		lock_guard<mutex> guard(lock_);
+		shown_after_ = frame_buffer_->paints();
+	}
 
-		// using software buffer? just copy to texture
-		if (sw_buffer_ && shared_buffer_ && dirty_)
+	// where the popup goes (in view pixels) once it has painted for it
+	void place(CefRect const& rect)
+	{
+		lock_guard<mutex> guard(lock_);
+		placement_ = rect;
+		placed_after_ = frame_buffer_->paints();
+		placing_ = true;
+	}
+
+	void render(shared_ptr<d3d11::Context> const& ctx) override
+	{
+		uint64_t shown_after;
 		{
-			d3d11::ScopedBinder<d3d11::Texture2D> binder(ctx, shared_buffer_);			
-			shared_buffer_->copy_from(
-				sw_buffer_.get(), 
-				shared_buffer_->width() * 4, 
-				shared_buffer_->height());
+			lock_guard<mutex> guard(lock_);
+			shown_after = shown_after_;
+		}
+
+		if (frame_buffer_->paints() > shown_after) {
+			frame_buffer_->render(ctx, [&](shared_ptr<d3d11::Texture2D> const& texture) {
+				render_texture(ctx, texture);
+			});
+		}
+	}
+
+	void take_damage(vector<Rect>& damage) override
+	{
+		apply_placement();
+
+		vector<Rect> dirty;
+		frame_buffer_->take_damage(dirty);
+		for (auto const& r : dirty) {
+			invalidate(r);
 		}
+		Layer::take_damage(damage);
+	}
 
-		dirty_ = false;
-		return shared_buffer_;
+	DeliveryStats delivery() const override
+	{
+		return frame_buffer_->stats();
 	}
 
 private:
 
+	//
+	// move to a pending placement if the popup has painted since
+	//
+	void apply_placement()
+	{
+		CefRect rect;
+		{
+			lock_guard<mutex> guard(lock_);
+			if (!placing_ || frame_buffer_->paints() <= placed_after_) {
+				return;
+			}
+			rect = placement_;
+			placing_ = false;
+		}
+
+		auto const composition = this->composition();
+		if (composition)
+		{
+			auto const outer_width = composition->width();
+			auto const outer_height = composition->height();
+			if (outer_width > 0 && outer_height > 0)
+			{
+				auto const x = rect.x / float(outer_width);
+				auto const y = rect.y / float(outer_height);
+				auto const w = rect.width / float(outer_width);
+				auto const h = rect.height / float(outer_height);
+				move(x, y, w, h);
+			}
+		}
+	}
+
+	shared_ptr<FrameBuffer> const frame_buffer_;
+
 	mutex lock_;
-	atomic_bool abort_;
-	shared_ptr<d3d11::Texture2D> shared_buffer_;
-	std::shared_ptr<d3d11::Device> const device_;
-	shared_ptr<uint8_t> sw_buffer_;
-	bool dirty_;
+	uint64_t shown_after_;
+	uint64_t placed_after_;
+	bool placing_;
+	CefRect placement_;
 };
 
+//
+// the background writer shared by all views (see set_source_dump) ...
+// created with the defaults on first use
+//
+shared_ptr<SourceDumper> source_dumper(bool create);
+
 //
 // Simple string visitor that will dump the contents
 // to a file
 //
+// CEF calls us on the UI thread (which also delivers paints) so only a
+// copy of the source is made here ... converting, compressing and
+// writing it happen on the dumper's thread
+//
 class HtmlSourceWriter : public CefStringVisitor
 {
 public:
-	HtmlSourceWriter(string const& filename) {
-		fout_ = make_shared<ofstream>(filename);
+	HtmlSourceWriter(string const& filename) 
+		: filename_(filename) {
 	}
 
-	void Visit(const CefString& string) override
+	void Visit(const CefString& source) override
 	{
-		if (fout_ && fout_->is_open())
-		{
-			auto const utf8 = string.ToString();
-			fout_->write(utf8.c_str(), utf8.size());
+		auto const dumper = source_dumper(true);
+		if (!dumper) {
+			return;
+		}
+
+		// UTF-8 is never shorter ... there is no need to copy past the cap
+		auto length = source.length();
+		auto const max_bytes = dumper->options().max_bytes;
+		if (max_bytes && length > max_bytes) {
+			length = static_cast<size_t>(max_bytes);
+		}
+
+		auto const copy = make_shared<CefString>(source.c_str(), length, true);
+		if (!dumper->submit(filename_, [copy]() { return copy->ToString(); })) {
+			log_message("source dump queue full, dropped %s\n", filename_.c_str());
 		}
 	}
 
 private:
 	IMPLEMENT_REFCOUNTING(HtmlSourceWriter);
-	shared_ptr<ofstream> fout_;
+	string const filename_;
 };
 
 
+//
+// remove a layer from a composition later on the CEF UI thread
+//
+class RemoveLayerTask : public CefTask
+{
+public:
+	RemoveLayerTask(
+		shared_ptr<Composition> const& composition,
+		shared_ptr<Layer> const& layer)
+		: composition_(composition)
+		, layer_(layer) {
+	}
+
+	void Execute() override
+	{
+		auto const composition = composition_.lock();
+		if (composition) {
+			composition->remove_layer(layer_);
+		}
+	}
+
+private:
+	IMPLEMENT_REFCOUNTING(RemoveLayerTask);
+	weak_ptr<Composition> const composition_;
+	shared_ptr<Layer> const layer_;
+};
+
+//
+// counters for the pool of warm browsers (first paints in microseconds):
+//
+//   size        - browsers the pool keeps warm
+//   warm        - ... parked on about:blank, ready to be claimed
+//   warming     - ... still being created
+//   claimed     - web layers that got a warm browser
+//   misses      - ... that had to create their own (the pool was empty)
+//   recycled    - closed web layers whose browser went back to the pool
+//   first_paint - from claim (warm) or create (cold) to the first paint
+//                 of the new page
+//
+struct BrowserPoolStats
+{
+	uint32_t size;
+	uint32_t warm;
+	uint32_t warming;
+	uint64_t claimed;
+	uint64_t misses;
+	uint64_t recycled;
+	Histogram::Summary warm_first_paint;
+	Histogram::Summary cold_first_paint;
+};
+
+//
+// windowless browsers created ahead of time (shared textures, external 
+// BeginFrames) and parked on about:blank ... a new web layer (or a 
+// window.open() popup) claims one and navigates it instead of paying for 
+// a renderer process and a first load.  A closed web layer hands its
+// browser back if there is room and the pool tops itself up after each
+// claim.
+//
+// parked browsers are hidden (WasHidden) and get no BeginFrames, the
+// layer that claims one wakes it like any hidden browser.
+//
+class BrowserPool
+{
+public:
+	BrowserPool();
+
+	// keep size browsers warm (width x height to start) ... 0 closes them
+	void configure(shared_ptr<d3d11::Device> const& device, 
+				int size, int width, int height);
+
+	// a warm browser loading url for a new layer ... nullptr if none is ready
+	CefRefPtr<WebView> claim(
+				string const& name,
+				string const& url,
+				shared_ptr<d3d11::Device> const& device,
+				int width,
+				int height,
+				DeliveryPolicy const& delivery);
+
+	// take back the browser of a closed layer ... false if it should be closed
+	bool recycle(CefRefPtr<WebView> const& view);
+
+	// a view painted the first frame of a new page
+	void first_paint(bool warm, uint64_t elapsed);
+
+	// count a layer that created its own browser
+	void missed();
+
+	BrowserPoolStats stats() const;
+
+	// close every parked browser (before CEF shuts down)
+	void close();
+
+private:
+	BrowserPool(BrowserPool const&);
+	BrowserPool& operator=(BrowserPool const&);
+
+	// lock is held
+	void fill();
+
+	mutable mutex lock_;
+	vector<CefRefPtr<WebView>> views_;
+	shared_ptr<d3d11::Device> device_;
+	int size_;
+	int width_;
+	int height_;
+	uint64_t claimed_;
+	uint64_t misses_;
+	uint64_t recycled_;
+	Histogram warm_first_paint_;
+	Histogram cold_first_paint_;
+};
+
+// the pool shared by all compositions
+BrowserPool& browser_pool();
+
+//
+// start a windowless browser (shared textures, external BeginFrames)
+// loading url for a view
+//
+void create_browser(CefRefPtr<WebView> const& view, string const& url);
+
+
 class WebView : public CefClient,
 	public CefRenderHandler,
 	public CefLifeSpanHandler,
@@ -421,15 +1317,26 @@ public:
 			int width, 
 			int height, 
 			bool use_shared_textures,
-			bool send_begin_Frame)
+			bool send_begin_Frame,
+			DeliveryPolicy const& delivery)
 		: name_(name)
 		, width_(width)
 		, height_(height)
-		, view_buffer_(make_shared<FrameBuffer>(device))
-		, popup_buffer_(make_shared<FrameBuffer>(device))
+		, view_buffer_(make_shared<FrameBuffer>(device, delivery))
+		, popup_buffer_(make_shared<FrameBuffer>(device, latest_delivery()))
 		, needs_stats_update_(false)
 		, use_shared_textures_(use_shared_textures)
 		, send_begin_frame_(send_begin_Frame)
+		, pacer_(delivery.frame_rate, delivery.begin_frame_timeout_ms * 1000ll)
+		, hidden_(false)
+		, hides_(0)
+		, hidden_since_(0)
+		, warm_(false)
+		, awaiting_load_(false)
+		, awaiting_paint_(false)
+		, load_from_(0)
+		, stats_encoder_(default_stats_rate, default_stats_keyframe_interval)
+		, stats_resync_(false)
 		, device_(device)
 	{
 		frame_ = 0;
@@ -444,6 +1351,119 @@ public:
 		return use_shared_textures_;
 	}
 
+	// has the browser been created? (a pooled view can't be claimed before)
+	bool created() {
+		return safe_browser().get() != nullptr;
+	}
+
+	//
+	// hand a parked (pooled) view to a new layer ... it starts over with
+	// the layer's delivery policy and device and navigates to url.  The
+	// view stays hidden until its layer is first drawn.
+	//
+	bool claim(
+		string const& name,
+		string const& url,
+		shared_ptr<d3d11::Device> const& device,
+		int width,
+		int height,
+		DeliveryPolicy const& delivery)
+	{
+		auto const browser = safe_browser();
+		if (!browser) {
+			return false;
+		}
+
+		{
+			lock_guard<mutex> guard(lock_);
+			name_ = name;
+			device_ = device;
+		}
+		atomic_store(&view_buffer_, make_shared<FrameBuffer>(device, delivery));
+		atomic_store(&popup_buffer_, make_shared<FrameBuffer>(device, latest_delivery()));
+		pacer_.reset(delivery.frame_rate, delivery.begin_frame_timeout_ms * 1000ll);
+		input_.reset();
+		hides_ = 0;
+
+		// the new page's first stats are a keyframe (once it asks for them)
+		needs_stats_update_ = false;
+		stats_resync_ = true;
+
+		expect_first_paint(true);
+		resize(width, height);
+		browser->GetMainFrame()->LoadURL(url);
+		return true;
+	}
+
+	//
+	// the layer showing this view is gone ... hide the browser and park 
+	// it on about:blank for the next layer to claim
+	//
+	bool park()
+	{
+		auto const browser = safe_browser();
+		if (!browser) {
+			return false;
+		}
+
+		shared_ptr<Composition> composition;
+		shared_ptr<Layer> popup;
+		{
+			lock_guard<mutex> guard(lock_);
+			composition = composition_.lock();
+			popup = popup_layer_;
+			composition_.reset();
+			popup_layer_.reset();
+			name_.clear();
+		}
+		// we might be called from within the composition (a layer released)
+		if (composition && popup) 
+		{
+			CefRefPtr<CefTask> task(new RemoveLayerTask(composition, popup));
+			CefPostTask(TID_UI, task.get());
+		}
+
+		awaiting_load_ = false;
+		awaiting_paint_ = false;
+		input_.reset();
+
+		// about:blank doesn't want the layer's stats
+		needs_stats_update_ = false;
+		stats_resync_ = true;
+
+		hidden_ = true;
+		hidden_since_ = 0;
+		browser->GetHost()->WasHidden(true);
+		browser->GetMainFrame()->LoadURL("about:blank");
+
+		// let go of the layer's frames (and textures) while parked
+		shared_ptr<d3d11::Device> device;
+		{
+			lock_guard<mutex> guard(lock_);
+			device = device_;
+		}
+		atomic_store(&view_buffer_, make_shared<FrameBuffer>(device, latest_delivery()));
+		atomic_store(&popup_buffer_, make_shared<FrameBuffer>(device, latest_delivery()));
+		return true;
+	}
+
+	// a pooled view is hidden from the start
+	void start_hidden() {
+		hidden_ = true;
+	}
+
+	//
+	// time the next page load from now to its first paint (reported to
+	// the pool as a warm or a cold start)
+	//
+	void expect_first_paint(bool warm)
+	{
+		warm_ = warm;
+		load_from_ = time_now();
+		awaiting_paint_ = false;
+		awaiting_load_ = true;
+	}
+
 	//
 	// we'll use the composition to handle new popup layer
 	//
@@ -491,8 +1511,10 @@ public:
 		if (name == "mixer-request-stats")
 		{
 			// just flag that we need to deliver stats updates
-			// to the render process via a message
+			// to the render process via a message ... starting over
+			// with a keyframe (a new page or one that lost track)
 			needs_stats_update_ = true;
+			stats_resync_ = true;
 			return true;
 		}
 		return false;
@@ -516,18 +1538,24 @@ public:
 				fps_start_ = now;
 			}
 
-			if (view_buffer_) {
-				view_buffer_->on_paint(buffer, width, height);
+			pacer_.painted(static_cast<int64_t>(now));
+			first_paint(now);
+
+			auto const view_buffer = safe_view_buffer();
+			if (view_buffer) {
+				view_buffer->on_paint(buffer, width, height, dirtyRects);
 			}
 
 			if ((now - fps_start_) > 1000000)
 			{
 				auto const fps = frame_ / double((now - fps_start_) / 1000000.0);
 
-				auto const w = view_buffer_ ? view_buffer_->width() : 0;
-				auto const h = view_buffer_ ? view_buffer_->height() : 0;
+				auto const w = view_buffer ? view_buffer->width() : 0;
+				auto const h = view_buffer ? view_buffer->height() : 0;
+				auto const dropped = view_buffer ? view_buffer->stats().dropped : 0;
 
-				log_message("html: OnAcceleratedPaint (%dx%d), fps: %3.2f\n", w, h, fps);
+				log_message("html: OnAcceleratedPaint (%dx%d), fps: %3.2f, dropped: %llu\n", 
+					w, h, fps, (unsigned long long)dropped);
 
 				frame_ = 0;
 				fps_start_ = time_now();
@@ -538,8 +1566,9 @@ public:
 			// just update the popup frame ... we are only tracking 
 			// metrics for the view
 
-			if (popup_buffer_) {
-				popup_buffer_->on_paint(buffer, width, height);
+			auto const popup_buffer = safe_popup_buffer();
+			if (popup_buffer) {
+				popup_buffer->on_paint(buffer, width, height, dirtyRects);
 			}
 		}
 
@@ -559,18 +1588,24 @@ public:
 				fps_start_ = now;
 			}
 			
-			if (view_buffer_) {
-				view_buffer_->on_gpu_paint((void*)share_handle);
+			pacer_.painted(static_cast<int64_t>(now));
+			first_paint(now);
+
+			auto const view_buffer = safe_view_buffer();
+			if (view_buffer) {
+				view_buffer->on_gpu_paint((void*)share_handle, dirtyRects);
 			}
 			
 			if ((now - fps_start_) > 1000000)
 			{
 				auto const fps = frame_ / double((now - fps_start_) / 1000000.0);
 
-				auto const w = view_buffer_ ? view_buffer_->width() : 0;
-				auto const h = view_buffer_ ? view_buffer_->height() : 0;
+				auto const w = view_buffer ? view_buffer->width() : 0;
+				auto const h = view_buffer ? view_buffer->height() : 0;
+				auto const dropped = view_buffer ? view_buffer->stats().dropped : 0;
 
-				log_message("html: OnAcceleratedPaint (%dx%d), fps: %3.2f\n", w, h, fps);
+				log_message("html: OnAcceleratedPaint (%dx%d), fps: %3.2f, dropped: %llu\n", 
+					w, h, fps, (unsigned long long)dropped);
 
 				frame_ = 0;
 				fps_start_ = time_now();
@@ -581,8 +1616,9 @@ public:
 			// just update the popup frame ... we are only tracking 
 			// metrics for the view
 
-			if (popup_buffer_) {
-				popup_buffer_->on_gpu_paint((void*)share_handle);
+			auto const popup_buffer = safe_popup_buffer();
+			if (popup_buffer) {
+				popup_buffer->on_gpu_paint((void*)share_handle, dirtyRects);
 			}
 		}
 	}
@@ -606,6 +1642,10 @@ public:
 				browser_ = browser;
 			}
 		}
+
+		if (hidden_) {
+			browser->GetHost()->WasHidden(true);
+		}
 	}
 
 	void OnPopupShow(CefRefPtr<CefBrowser> browser, bool show) override 
@@ -618,12 +1658,18 @@ public:
 		{
 			if (show) 
 			{
-				// remove existing
-				composition->remove_layer(popup_layer_);
-				
-				// create new layer
-				popup_layer_ = create_popup_layer(device_, popup_buffer_);
-				composition->add_layer(popup_layer_);
+				// one layer for the life of the view (or until parked)
+				if (!popup_layer_) {
+					popup_layer_ = create_popup_layer(device_, safe_popup_buffer());
+				}
+
+				// re-adding puts it back on top
+				if (popup_layer_)
+				{
+					composition->remove_layer(popup_layer_);
+					popup_layer_->show();
+					composition->add_layer(popup_layer_);
+				}
 			}
 			else{
 				composition->remove_layer(popup_layer_);
@@ -642,22 +1688,9 @@ public:
 			layer = popup_layer_;
 		}
 
-		if (layer) 
-		{
-			auto const composition = layer->composition();
-			if (composition)
-			{
-				auto const outer_width = composition->width();
-				auto const outer_height = composition->height();
-				if (outer_width > 0 && outer_height > 0)
-				{
-					auto const x = rect.x / float(outer_width);
-					auto const y = rect.y / float(outer_height);
-					auto const w = rect.width / float(outer_width);
-					auto const h = rect.height / float(outer_height);
-					layer->move(x, y, w, h);
-				}
-			}
+		// moved when the popup paints at the new size
+		if (layer) {
+			layer->place(rect);
 		}
 	}
 
@@ -674,9 +1707,11 @@ public:
 		bool* no_javascript_access) override 
 	{
 		shared_ptr<Composition> composition;
+		shared_ptr<d3d11::Device> device;
 		{
 			lock_guard<mutex> guard(lock_);
 			composition = composition_.lock();
+			device = device_;
 		}
 
 		// we need a composition to add new popup layers to
@@ -692,26 +1727,41 @@ public:
 		auto const width = popup_features.widthSet ? popup_features.width : 400;
 		auto const height = popup_features.heightSet ? popup_features.height : 300;
 
-		CefRefPtr<WebView> view(new WebView(
-			target_frame_name, 
-			device_, 
-			width, 
-			height, 
-			use_shared_textures(),
-			send_begin_frame_));
-		
-		CefBrowserHost::CreateBrowser(
-			window_info,
-			view,
-			target_url,
-			settings,
-			nullptr);
+		// a warm browser from the pool (they are all like us) if there is one
+		CefRefPtr<WebView> view;
+		if (use_shared_textures() && send_begin_frame_)
+		{
+			view = browser_pool().claim(target_frame_name, 
+				target_url, device, width, height, latest_delivery());
+		}
+
+		if (!view)
+		{
+			view = new WebView(
+				target_frame_name, 
+				device, 
+				width, 
+				height, 
+				use_shared_textures(),
+				send_begin_frame_,
+				latest_delivery());
+			view->expect_first_paint(false);
+			browser_pool().missed();
+
+			CefBrowserHost::CreateBrowser(
+				window_info,
+				view,
+				target_url,
+				settings,
+				nullptr);
+		}
 
 		// create a new layer to handle drawing for the web popup
-		auto const layer = create_web_layer(device_, true, view);
+		auto const layer = create_web_layer(device, true, view);
 		if (!layer) {
 			return true; // prevent popup
 		}
+		layer->set_name(target_url.ToString());
 
 		composition->add_layer(layer);
 
@@ -730,6 +1780,19 @@ public:
 		return false;
 	}
 
+	void OnLoadStart(CefRefPtr<CefBrowser> browser,
+		CefRefPtr<CefFrame> frame,
+		TransitionType /*transition_type*/) override
+	{
+		// paints from here on are of the new page (not of the blank one 
+		// a pooled browser might still have been loading)
+		if (frame->IsMain() && awaiting_load_ && frame->GetURL().ToString() != "about:blank")
+		{
+			awaiting_load_ = false;
+			awaiting_paint_ = true;
+		}
+	}
+
 	void OnLoadEnd(CefRefPtr<CefBrowser> browser, 
 		CefRefPtr<CefFrame> frame,
 		int /*httpStatusCode*/)
@@ -737,12 +1800,88 @@ public:
 		dump_source(frame);
 	}
 
-	shared_ptr<d3d11::Texture2D> texture(shared_ptr<d3d11::Context> const& ctx)
-	{
-		if (view_buffer_) {
-			return view_buffer_->swap(ctx);
+	void render(
+		shared_ptr<d3d11::Context> const& ctx, 
+		function<void(shared_ptr<d3d11::Texture2D> const&)> const& draw)
+	{
+		auto const view_buffer = safe_view_buffer();
+		if (view_buffer) {
+			view_buffer->render(ctx, draw);
+		}
+	}
+
+	void take_damage(vector<Rect>& damage)
+	{
+		auto const view_buffer = safe_view_buffer();
+		if (view_buffer) {
+			view_buffer->take_damage(damage);
+		}
+	}
+
+	void set_timing(shared_ptr<LayerTiming> const& timing)
+	{
+		auto const view_buffer = safe_view_buffer();
+		if (view_buffer) {
+			view_buffer->set_timing(timing);
+		}
+	}
+
+	DeliveryStats delivery() const
+	{
+		auto const view_buffer = safe_view_buffer();
+		auto stats = view_buffer ? view_buffer->stats() : no_delivery();
+		auto const pacing = pacer_.stats();
+		stats.begin_frames = pacing.sent;
+		stats.begin_timeouts = pacing.timeouts;
+		stats.begin_to_paint = pacing.begin_to_paint;
+		stats.hidden = hidden_;
+		stats.hides = hides_;
+		auto const input = input_.stats();
+		stats.input_events = input.events;
+		stats.input_coalesced = input.coalesced;
+		stats.input_delay = input.delay;
+		return stats;
+	}
+
+	//
+	// was the layer showing us drawn? ... a browser that stays hidden for
+	// hide_delay is told so (WasHidden) and gets no BeginFrames, so its
+	// renderer goes idle.  It is woken (and asked to repaint) as soon as
+	// it is visible again.
+	//
+	void set_visible(bool visible)
+	{
+		auto const browser = safe_browser();
+		if (!browser) {
+			return;
+		}
+
+		if (visible)
+		{
+			hidden_since_ = 0;
+			if (hidden_)
+			{
+				hidden_ = false;
+				pacer_.restart();
+				browser->GetHost()->WasHidden(false);
+				browser->GetHost()->Invalidate(PET_VIEW);
+				log_message("html view visible - %s\n", name().c_str());
+			}
+			return;
+		}
+
+		// the delay keeps a layer passing behind another from flapping
+		auto const now = time_now();
+		if (!hidden_since_) {
+			hidden_since_ = now;
+		}
+		if (!hidden_ && (now - hidden_since_) >= hide_delay)
+		{
+			hidden_ = true;
+			hides_++;
+			browser->GetHost()->WasHidden(true);
+			log_message("html view hidden - %s\n", name().c_str());
 		}
-		return nullptr;
 	}
 
 	void tick(double t)
@@ -755,17 +1894,45 @@ public:
 		}
 
 		// the javascript might be interested in our 
-		// rendering statistics (e.g. HUD) ...
-		if (needs_stats_update_) {
-			update_stats(browser, composition);
+		// rendering statistics (e.g. HUD) ... a few times a second
+		if (needs_stats_update_)
+		{
+			if (stats_resync_.exchange(false)) {
+				stats_encoder_.reset();
+			}
+			if (stats_encoder_.due(static_cast<int64_t>(time_now()))) {
+				update_stats(browser, composition);
+			}
+		}
+
+		//
+		// optionally issue a BeginFrame request ... unless the last frame 
+		// is being held until it is drawn, the layer's rate says it isn't
+		// time yet or the browser hasn't painted the last one we asked for
+		//
+		auto const now = static_cast<int64_t>(time_now());
+		auto const view_buffer = safe_view_buffer();
+		auto const ready = (!view_buffer || view_buffer->ready()) && !hidden_;
+		auto const begin = send_begin_frame_ && browser && ready && pacer_.begin(now);
+
+		//
+		// input goes out (coalesced) just ahead of the BeginFrame that will
+		// draw it ... or when it has waited too long for one (a slow rate,
+		// a held frame or no BeginFrames at all)
+		//
+		if (browser && (begin || !send_begin_frame_ || input_.age(now) >= max_input_delay)) {
+			send_input(browser, now);
 		}
 
-		// optionally issue a BeginFrame request
-		if (send_begin_frame_ && browser) {		
+		if (begin) {
 			browser->GetHost()->SendExternalBeginFrame();
 		}
 	}
 
+	//
+	// send the page what changed in our rendering statistics since the
+	// last message (everything if it needs a keyframe)
+	//
 	void update_stats(CefRefPtr<CefBrowser> const& browser, 
 			shared_ptr<Composition> const& composition)
 	{
@@ -773,24 +1940,123 @@ public:
 			return;
 		}
 
-		auto message = CefProcessMessage::Create("mixer-update-stats");
-		auto args = message->GetArgumentList();
-		
-		// create a dictionary to hold all of individual statistic values
-		// it will get converted by the Render process into a V8 Object
-		// that gets passed to the script running in the page
-		auto dict = CefDictionaryValue::Create();
-		dict->SetInt("width", composition->width());
-		dict->SetInt("height", composition->height());
-		dict->SetDouble("fps", composition->fps());
-		dict->SetDouble("time", composition->time());
-		dict->SetBool("vsync", composition->is_vsync());
-
-		args->SetDictionary(0, dict);
+		StatMap stats;
+		collect_stats(composition, stats);
 
+		StatsDelta delta;
+		if (!stats_encoder_.encode(stats, delta)) {
+			return;
+		}
+
+		auto message = CefProcessMessage::Create("mixer-update-stats");
+		to_message(delta, message->GetArgumentList());
 		browser->SendProcessMessage(PID_RENDERER, message);
 	}
 
+	void collect_stats(shared_ptr<Composition> const& composition, StatMap& stats)
+	{
+		stats["width"] = stat_int(composition->width());
+		stats["height"] = stat_int(composition->height());
+		stats["fps"] = stat_double(composition->fps());
+		stats["time"] = stat_double(composition->time());
+		stats["vsync"] = stat_bool(composition->is_vsync());
+
+		//
+		// frame timing and delivery for each layer ... keyed by its index
+		// in the layer list since names repeat (the same url twice, or
+		// "popup" for every popup)
+		//
+		auto const reports = composition->timing_report();
+		for (size_t n = 0; n < reports.size(); ++n)
+		{
+			auto const& report = reports[n];
+			auto const& d = report.delivery;
+			auto const& t = report.timing;
+			auto const layer = stat_path("layers", to_string(n));
+			auto const set = [&](char const* key, StatValue const& value) {
+				stats[stat_path(layer, key)] = value;
+			};
+
+			set("name", stat_string(report.name));
+
+			set("fps", stat_double((t.paint_interval.mean > 0.0) ? 
+				1000000.0 / t.paint_interval.mean : 0.0));
+			set("frames", stat_int(static_cast<int64_t>(t.frames)));
+			set("latency_ms", stat_double(
+				(t.paint_to_composite.mean + t.composite_to_present.mean) / 1000.0));
+			set("paint_to_composite_p99_ms", stat_double(t.paint_to_composite.p99 / 1000.0));
+			set("delivery", stat_string(to_string(d.policy.mode)));
+			set("delivered", stat_int(static_cast<int64_t>(d.delivered)));
+			set("dropped", stat_int(static_cast<int64_t>(d.dropped)));
+			set("repeated", stat_int(static_cast<int64_t>(d.repeated)));
+			set("queued", stat_int(static_cast<int64_t>(d.queued)));
+			set("sync_timeouts", stat_int(static_cast<int64_t>(d.timeouts)));
+			set("shared_hits", stat_int(static_cast<int64_t>(d.shared_hits)));
+			set("shared_misses", stat_int(static_cast<int64_t>(d.shared_misses)));
+			set("frame_rate", stat_double(d.policy.frame_rate));
+			set("begin_frames", stat_int(static_cast<int64_t>(d.begin_frames)));
+			set("begin_timeouts", stat_int(static_cast<int64_t>(d.begin_timeouts)));
+			set("begin_to_paint_ms", stat_double(d.begin_to_paint.mean / 1000.0));
+			set("begin_to_paint_p99_ms", stat_double(d.begin_to_paint.p99 / 1000.0));
+			set("hidden", stat_bool(d.hidden));
+			set("hides", stat_int(static_cast<int64_t>(d.hides)));
+			set("input_events", stat_int(static_cast<int64_t>(d.input_events)));
+			set("input_coalesced", stat_int(static_cast<int64_t>(d.input_coalesced)));
+			set("input_delay_ms", stat_double(d.input_delay.mean / 1000.0));
+		}
+
+		auto const capture = composition->capture();
+		if (capture)
+		{
+			auto const c = capture->stats();
+			auto const set = [&](char const* key, StatValue const& value) {
+				stats[stat_path("capture", key)] = value;
+			};
+			set("format", stat_string(to_string(capture->options().format)));
+			set("captured", stat_int(static_cast<int64_t>(c.captured)));
+			set("dropped", stat_int(static_cast<int64_t>(c.dropped)));
+			set("written", stat_int(static_cast<int64_t>(c.written)));
+			set("failed", stat_int(static_cast<int64_t>(c.failed)));
+			set("queued", stat_int(c.queued));
+			set("max_queued", stat_int(c.max_queued));
+			set("encode_ms", stat_double(c.encode.mean / 1000.0));
+			set("encode_p99_ms", stat_double(c.encode.p99 / 1000.0));
+		}
+
+		auto const pool = browser_pool().stats();
+		if (pool.size > 0)
+		{
+			auto const set = [&](char const* key, StatValue const& value) {
+				stats[stat_path("browser_pool", key)] = value;
+			};
+			set("size", stat_int(pool.size));
+			set("warm", stat_int(pool.warm));
+			set("warming", stat_int(pool.warming));
+			set("claimed", stat_int(static_cast<int64_t>(pool.claimed)));
+			set("misses", stat_int(static_cast<int64_t>(pool.misses)));
+			set("recycled", stat_int(static_cast<int64_t>(pool.recycled)));
+			set("warm_first_paint_ms", stat_double(pool.warm_first_paint.mean / 1000.0));
+			set("cold_first_paint_ms", stat_double(pool.cold_first_paint.mean / 1000.0));
+		}
+
+		auto const dumper = source_dumper(false);
+		if (dumper)
+		{
+			auto const d = dumper->stats();
+			auto const set = [&](char const* key, StatValue const& value) {
+				stats[stat_path("source_dump", key)] = value;
+			};
+			set("submitted", stat_int(static_cast<int64_t>(d.submitted)));
+			set("dropped", stat_int(static_cast<int64_t>(d.dropped)));
+			set("truncated", stat_int(static_cast<int64_t>(d.truncated)));
+			set("written", stat_int(static_cast<int64_t>(d.written)));
+			set("failed", stat_int(static_cast<int64_t>(d.failed)));
+			set("queued", stat_int(d.queued));
+			set("bytes_out", stat_int(static_cast<int64_t>(d.bytes_out)));
+			set("write_ms", stat_double(d.write.mean / 1000.0));
+		}
+	}
+
 	void resize(int width, int height)
 	{
 		// only signal change if necessary
@@ -798,6 +2064,11 @@ public:
 		{
 			width_ = width;
 			height_ = height;
+
+			auto const view_buffer = safe_view_buffer();
+			if (view_buffer) {
+				view_buffer->resized();
+			}
 			
 			auto const browser = safe_browser();
 			if (browser)
@@ -808,11 +2079,19 @@ public:
 		}
 	}
 
+	// the layer name ... empty while the view is parked in the pool
+	string name()
+	{
+		lock_guard<mutex> guard(lock_);
+		return name_;
+	}
+
 	void dump_source(CefRefPtr<CefFrame> frame)
 	{
-		if (frame.get() && !name_.empty())
+		auto const name = this->name();
+		if (frame.get() && !name.empty())
 		{
-			auto const filename = get_temp_filename(name_);
+			auto const filename = get_temp_filename(name);
 			CefRefPtr<CefStringVisitor> writer(new HtmlSourceWriter(filename));
 			frame->GetSource(writer);
 		}
@@ -841,38 +2120,22 @@ public:
 		}
 	}
 
+	//
+	// mouse input waits (coalesced) for the next frame ... see tick()
+	//
 	void mouse_click(MouseButton button, bool up, int32_t x, int32_t y)
 	{
-		auto const browser = safe_browser();
-		if (browser) 
-		{
-			CefMouseEvent mouse;
-			mouse.x = x;
-			mouse.y = y;
-			mouse.modifiers = 0;
-			
-			cef_mouse_button_type_t ctype;
-			switch (button)
-			{
-				case MouseButton::Middle: ctype = MBT_MIDDLE; break;
-				case MouseButton::Right: ctype = MBT_RIGHT; break;
-				case MouseButton::Left: ctype = MBT_LEFT;
-				default:break;			
-			}
-			browser->GetHost()->SendMouseClickEvent(mouse, ctype, up, 1);
-		}
+		input_.click(button, up, x, y, static_cast<int64_t>(time_now()));
 	}
 
 	void mouse_move(bool leave, int32_t x, int32_t y)
 	{
-		auto const browser = safe_browser();
-		if (browser)
-		{
-			CefMouseEvent mouse;
-			mouse.x = x;
-			mouse.y = y;
-			mouse.modifiers = 0;
-			browser->GetHost()->SendMouseMoveEvent(mouse, leave);
+		auto const now = static_cast<int64_t>(time_now());
+		if (leave) {
+			input_.leave(x, y, now);
+		}
+		else {
+			input_.move(x, y, now);
 		}
 	}
 
@@ -885,6 +2148,55 @@ private:
 		return browser_;
 	}
 
+	// the buffers are replaced when a pooled view changes hands
+	shared_ptr<FrameBuffer> safe_view_buffer() const {
+		return atomic_load(&view_buffer_);
+	}
+
+	shared_ptr<FrameBuffer> safe_popup_buffer() const {
+		return atomic_load(&popup_buffer_);
+	}
+
+	void send_input(CefRefPtr<CefBrowser> const& browser, int64_t now)
+	{
+		if (!input_.take(input_events_, now)) {
+			return;
+		}
+
+		auto const host = browser->GetHost();
+		for (auto const& e : input_events_)
+		{
+			CefMouseEvent mouse;
+			mouse.x = e.x;
+			mouse.y = e.y;
+			mouse.modifiers = 0;
+
+			if (e.type == InputQueue::Type::Click)
+			{
+				cef_mouse_button_type_t ctype;
+				switch (e.button)
+				{
+					case MouseButton::Middle: ctype = MBT_MIDDLE; break;
+					case MouseButton::Right: ctype = MBT_RIGHT; break;
+					case MouseButton::Left: ctype = MBT_LEFT;
+					default:break;			
+				}
+				host->SendMouseClickEvent(mouse, ctype, e.up, 1);
+			}
+			else {
+				host->SendMouseMoveEvent(mouse, e.type == InputQueue::Type::Leave);
+			}
+		}
+	}
+
+	// the first paint after the load we are timing started
+	void first_paint(uint64_t now)
+	{
+		if (awaiting_paint_.exchange(false)) {
+			browser_pool().first_paint(warm_, now - load_from_);
+		}
+	}
+
 	string name_;
 	int width_;
 	int height_;
@@ -897,10 +2209,32 @@ private:
 	bool needs_stats_update_;
 	bool use_shared_textures_;
 	bool send_begin_frame_;
+	BeginFramePacer pacer_;
+
+	// visibility of the layer (render thread)
+	static uint64_t const hide_delay = 250000;
+	atomic<bool> hidden_;
+	atomic<uint64_t> hides_;
+	uint64_t hidden_since_;
+
+	// time to first paint of a new page
+	atomic<bool> warm_;
+	atomic<bool> awaiting_load_;
+	atomic<bool> awaiting_paint_;
+	atomic<uint64_t> load_from_;
+
+	// mouse input waiting for a frame
+	static int64_t const max_input_delay = 33000;
+	InputQueue input_;
+	vector<InputQueue::Event> input_events_;
+
+	// stats for the page (render thread)
+	StatsEncoder stats_encoder_;
+	atomic<bool> stats_resync_;
 	
-	shared_ptr<Layer> popup_layer_;
+	shared_ptr<PopupLayer> popup_layer_;
 	weak_ptr<Composition> composition_;
-	shared_ptr<d3d11::Device> const device_;
+	shared_ptr<d3d11::Device> device_;
 };
 
 
@@ -913,10 +2247,12 @@ public:
 		CefRefPtr<WebView> const& view)
 		: Layer(device, want_input, view->use_shared_textures())
 		, view_(view) {
+		view_->set_timing(timing());
 	}
 
 	~WebLayer() {
-		if (view_) {
+		// the browser goes back to the pool if there is room
+		if (view_ && !browser_pool().recycle(view_)) {
 			view_->close();
 		}
 	}
@@ -960,7 +2296,12 @@ public:
 					show_devtools_ = false;
 				}
 
-				view_->resize(width, height);
+				// a zero-sized layer is hidden rather than resized to nothing
+				auto const sized = (width > 0) && (height > 0);
+				if (sized) {
+					view_->resize(width, height);
+				}
+				view_->set_visible(sized && visible());
 				view_->tick(t);
 			}
 		}
@@ -971,9 +2312,28 @@ public:
 	void render(shared_ptr<d3d11::Context> const& ctx) override
 	{
 		// simply use the base class method to draw our texture
-		if (view_)  {
-			render_texture(ctx, view_->texture(ctx));
+		if (view_)  
+		{
+			view_->render(ctx, [&](shared_ptr<d3d11::Texture2D> const& texture) {
+				render_texture(ctx, texture);
+			});
+		}
+	}
+
+	//
+	// forward the dirty rects from the browser paints
+	//
+	void take_damage(vector<Rect>& damage) override
+	{
+		if (view_)
+		{
+			vector<Rect> dirty;
+			view_->take_damage(dirty);
+			for (auto const& r : dirty) {
+				invalidate(r);
+			}
 		}
+		Layer::take_damage(damage);
 	}
 
 	void mouse_click(MouseButton button, bool up, int32_t x, int32_t y) override
@@ -989,38 +2349,253 @@ public:
 			view_->mouse_move(leave, x, y);
 		}
 	}
+
+	DeliveryStats delivery() const override
+	{
+		if (view_) {
+			return view_->delivery();
+		}
+		return Layer::delivery();
+	}
 	
 private:
 
 	CefRefPtr<WebView> const view_;
 };
 
-//
-// a simple layer that will render out PET_POPUP for a
-// corresponding view
-//
-class PopupLayer : public Layer
+
+
+
+BrowserPool::BrowserPool()
+	: size_(0)
+	, width_(0)
+	, height_(0)
+	, claimed_(0)
+	, misses_(0)
+	, recycled_(0)
 {
-public:
-	PopupLayer(
-		shared_ptr<d3d11::Device> const& device,
-		shared_ptr<FrameBuffer> const& buffer)
-		: Layer(device, false, true)
-		, frame_buffer_(buffer) {
+}
+
+void BrowserPool::configure(
+	shared_ptr<d3d11::Device> const& device, int size, int width, int height)
+{
+	vector<CefRefPtr<WebView>> closing;
+	{
+		lock_guard<mutex> guard(lock_);
+		if (!device_) {
+			device_ = device;
+		}
+		size_ = max(0, size);
+		width_ = max(1, width);
+		height_ = max(1, height);
+
+		while (views_.size() > static_cast<size_t>(size_))
+		{
+			closing.push_back(views_.back());
+			views_.pop_back();
+		}
+		fill();
 	}
 
-	void render(shared_ptr<d3d11::Context> const& ctx) override
+	for (auto const& view : closing) {
+		view->close();
+	}
+
+	if (size > 0) {
+		log_message("browser pool: %d warm\n", size);
+	}
+}
+
+CefRefPtr<WebView> BrowserPool::claim(
+	string const& name,
+	string const& url,
+	shared_ptr<d3d11::Device> const& device,
+	int width,
+	int height,
+	DeliveryPolicy const& delivery)
+{
+	CefRefPtr<WebView> view;
 	{
-		if (frame_buffer_) {
-			render_texture(ctx, frame_buffer_->swap(ctx));
+		lock_guard<mutex> guard(lock_);
+
+		// the first parked view whose browser is up (the rest are warming)
+		for (auto i = views_.begin(); i != views_.end(); ++i)
+		{
+			if ((*i)->created())
+			{
+				view = *i;
+				views_.erase(i);
+				break;
+			}
+		}
+		if (!view) {
+			return nullptr;
 		}
+
+		claimed_++;
+		fill();
 	}
 
-private:
-	shared_ptr<FrameBuffer> const frame_buffer_;
+	if (!view->claim(name, url, device, width, height, delivery)) 
+	{
+		view->close();
+		return nullptr;
+	}
+	return view;
+}
+
+bool BrowserPool::recycle(CefRefPtr<WebView> const& view)
+{
+	{
+		lock_guard<mutex> guard(lock_);
+		if (views_.size() >= static_cast<size_t>(size_)) {
+			return false;
+		}
+	}
+
+	if (!view->park()) {
+		return false;
+	}
+
+	lock_guard<mutex> guard(lock_);
+	if (views_.size() >= static_cast<size_t>(size_)) {
+		return false;
+	}
+	views_.push_back(view);
+	recycled_++;
+	return true;
+}
+
+void BrowserPool::first_paint(bool warm, uint64_t elapsed)
+{
+	lock_guard<mutex> guard(lock_);
+	if (warm) {
+		warm_first_paint_.record(static_cast<int64_t>(elapsed));
+	}
+	else {
+		cold_first_paint_.record(static_cast<int64_t>(elapsed));
+	}
+}
+
+void BrowserPool::missed()
+{
+	lock_guard<mutex> guard(lock_);
+	if (size_ > 0) {
+		misses_++;
+	}
+}
+
+BrowserPoolStats BrowserPool::stats() const
+{
+	lock_guard<mutex> guard(lock_);
+	BrowserPoolStats stats;
+	stats.size = static_cast<uint32_t>(size_);
+	stats.warm = 0;
+	for (auto const& view : views_) {
+		stats.warm += view->created() ? 1 : 0;
+	}
+	stats.warming = static_cast<uint32_t>(views_.size()) - stats.warm;
+	stats.claimed = claimed_;
+	stats.misses = misses_;
+	stats.recycled = recycled_;
+	stats.warm_first_paint = warm_first_paint_.summary();
+	stats.cold_first_paint = cold_first_paint_.summary();
+	return stats;
+}
+
+void BrowserPool::close()
+{
+	vector<CefRefPtr<WebView>> closing;
+	{
+		lock_guard<mutex> guard(lock_);
+		size_ = 0;
+		closing.swap(views_);
+		device_.reset();
+	}
+
+	for (auto const& view : closing) {
+		view->close();
+	}
+}
+
+void BrowserPool::fill()
+{
+	while (views_.size() < static_cast<size_t>(size_))
+	{
+		CefRefPtr<WebView> view(new WebView(
+			"", device_, width_, height_, true, true, latest_delivery()));
+		view->start_hidden();
+		create_browser(view, "about:blank");
+		views_.push_back(view);
+	}
+}
+
+BrowserPool& browser_pool()
+{
+	static BrowserPool pool;
+	return pool;
+}
+
+struct SourceDumpState
+{
+	mutex lock;
+	shared_ptr<SourceDumper> dumper;
+	vector<thread> retiring;		// letting replaced dumpers finish
 };
 
+SourceDumpState& source_dump_state()
+{
+	static SourceDumpState state;
+	return state;
+}
+
+shared_ptr<SourceDumper> source_dumper(bool create)
+{
+	auto& state = source_dump_state();
+	lock_guard<mutex> guard(state.lock);
+	if (!state.dumper && create) {
+		state.dumper = create_source_dumper(default_source_dump_options());
+	}
+	return state.dumper;
+}
+
+//
+// swap in a new dumper ... the old one writes out what it still has
+// queued as it goes, which waits for its writer thread, so it is let go
+// on a thread of its own rather than the caller's
+//
+void replace_source_dumper(shared_ptr<SourceDumper> const& dumper)
+{
+	auto& state = source_dump_state();
+	lock_guard<mutex> guard(state.lock);
+	auto old = state.dumper;
+	state.dumper = dumper;
+	if (old) {
+		state.retiring.push_back(thread([old]() mutable { old.reset(); }));
+	}
+}
+
+//
+// no more dumps ... waits until everything queued has been written
+// (by the current dumper and any replaced ones)
+//
+void close_source_dumper()
+{
+	shared_ptr<SourceDumper> old;
+	vector<thread> retiring;
+	{
+		auto& state = source_dump_state();
+		lock_guard<mutex> guard(state.lock);
+		old = state.dumper;
+		state.dumper.reset();
+		retiring.swap(state.retiring);
+	}
 
+	old.reset();
+	for (auto& t : retiring) {
+		t.join();
+	}
+}
 
 //
 // Lifetime management for CEF components.  
@@ -1146,16 +2721,7 @@ shared_ptr<Layer> create_web_layer(
 	return nullptr;
 }
 
-//
-// use CEF to load and render a web page within a layer
-//
-shared_ptr<Layer> create_web_layer(
-	std::shared_ptr<d3d11::Device> const& device,
-	string const& url,
-	int width, 
-	int height, 
-	bool want_input,
-	bool view_source)
+void create_browser(CefRefPtr<WebView> const& view, string const& url)
 {
 	CefWindowInfo window_info;
 	window_info.SetAsWindowless(nullptr);
@@ -1179,6 +2745,27 @@ shared_ptr<Layer> create_web_layer(
 	//
 	settings.windowless_frame_rate = 120;
 
+	CefBrowserHost::CreateBrowser(
+			window_info,
+			view, 
+			url, 
+			settings, 
+			nullptr);
+}
+
+//
+// use CEF to load and render a web page within a layer ... in a warm
+// browser from the pool if one is ready
+//
+shared_ptr<Layer> create_web_layer(
+	std::shared_ptr<d3d11::Device> const& device,
+	string const& url,
+	int width, 
+	int height, 
+	bool want_input,
+	bool view_source,
+	DeliveryPolicy const& delivery)
+{
 	string name;
 
 	// generate a name for the view based on the url - with the view
@@ -1196,22 +2783,19 @@ shared_ptr<Layer> create_web_layer(
 		}
 	}
 
-	CefRefPtr<WebView> view(new WebView(
-			name, device, width, height, 
-			window_info.shared_texture_enabled, 
-			window_info.external_begin_frame_enabled));
-
-	CefBrowserHost::CreateBrowser(
-			window_info,
-			view, 
-			url, 
-			settings, 
-			nullptr);
+	auto view = browser_pool().claim(name, url, device, width, height, delivery);
+	if (!view)
+	{
+		view = new WebView(name, device, width, height, true, true, delivery);
+		view->expect_first_paint(false);
+		browser_pool().missed();
+		create_browser(view, url);
+	}
 
 	return create_web_layer(device, want_input, view);
 }
 
-shared_ptr<Layer> create_popup_layer(
+shared_ptr<PopupLayer> create_popup_layer(
 	shared_ptr<d3d11::Device> const& device,
 	shared_ptr<FrameBuffer> const& buffer)
 {
@@ -1249,9 +2833,34 @@ int cef_initialize(HINSTANCE instance)
 //
 void cef_uninitialize()
 {
+	browser_pool().close();
+	close_source_dumper();
 	CefModule::shutdown();
 }
 
+void set_browser_pool(
+	shared_ptr<d3d11::Device> const& device, int size, int width, int height)
+{
+	browser_pool().configure(device, size, width, height);
+}
+
+void set_source_dump(SourceDumpOptions const& options)
+{
+	// the same settings (e.g. another composition from the same file)
+	// keep the writer there is
+	auto const current = source_dumper(false);
+	if (current)
+	{
+		auto const& o = current->options();
+		if (o.depth == options.depth &&
+			o.max_bytes == options.max_bytes &&
+			o.compress == options.compress) {
+			return;
+		}
+	}
+	replace_source_dumper(create_source_dumper(options));
+}
+
 //
 // return the CEF + Chromium version
 //